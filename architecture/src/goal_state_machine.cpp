@@ -62,6 +62,7 @@ namespace goal_state_machine
 		if(!first_request) global = false;
 		new_map = true;
 		frontier_srv.response.success = false;
+		++LazyThetaStarOctree::default_planner_context.map_sequence;
 	}
 
 	bool hasLineOfSight_UnknownAsFree(LazyThetaStarOctree::InputData const& input)
@@ -444,22 +445,22 @@ namespace goal_state_machine
 		octomath::Vector3 cell_center_coordinates_start (getCurrentOPPairs().get_current_start().x(), getCurrentOPPairs().get_current_start().y(), getCurrentOPPairs().get_current_start().z());
 
     	double cell_size_start = -1;
-		LazyThetaStarOctree::updateToCellCenterAndFindSize(cell_center_coordinates_start, *octree, cell_size_start, sidelength_lookup_table);
+		LazyThetaStarOctree::VoxelId voxel_id_start = LazyThetaStarOctree::updateToCellCenterAndFindSize(cell_center_coordinates_start, *octree, cell_size_start, sidelength_lookup_table);
 
 		LazyThetaStarOctree::unordered_set_pointers neighbors;
-		LazyThetaStarOctree::generateNeighbors_filter_pointers(neighbors, cell_center_coordinates_start, cell_size_start, octree->getResolution(), *octree);
+		LazyThetaStarOctree::generateNeighbors_keys(neighbors, voxel_id_start, *octree);
 		int n_id = 1500;
-		for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)
+		for(auto const& neighbor : neighbors)
 		{
-			octomap::OcTreeKey key = octree->coordToKey(*n_coordinates);
-		    int depth = LazyThetaStarOctree::getNodeDepth_Octomap(key, *octree);
+			octomath::Vector3 const& n_coordinates = neighbor.second;
+		    int depth = neighbor.first.depth();
 		    double cell_size = LazyThetaStarOctree::findSideLenght(octree->getTreeDepth(), depth, sidelength_lookup_table);
 
 			geometry_msgs::Point neighbor_v;
-			neighbor_v.x = n_coordinates->x();
-			neighbor_v.y = n_coordinates->y();
-			neighbor_v.z = n_coordinates->z();
-			if( ! LazyThetaStarOctree::is_flight_corridor_free( LazyThetaStarOctree::InputData(*octree, cell_center_coordinates_start, *n_coordinates, path_safety_margin ), pi) )
+			neighbor_v.x = n_coordinates.x();
+			neighbor_v.y = n_coordinates.y();
+			neighbor_v.z = n_coordinates.z();
+			if( ! LazyThetaStarOctree::is_flight_corridor_free( LazyThetaStarOctree::InputData(*octree, cell_center_coordinates_start, n_coordinates, path_safety_margin ), pi) )
 			{
 				// rviz_interface::publish_rejected_neighbor(neighbor_v, publish_input.marker_pub, marker_array_single_loop, n_id, cell_size);
 				
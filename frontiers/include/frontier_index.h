@@ -0,0 +1,153 @@
+#ifndef FRONTIER_INDEX_H
+#define FRONTIER_INDEX_H
+
+#include <frontiers_common.h>
+#include <neighbors.h>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Frontiers{
+
+    class NearestFrontierQuery;
+
+    /**
+     * @brief
+     The frontier cells of a map: unknown voxels, at the finest resolution, next to a free voxel on one of their
+      sides or right below them. These are the cells searchFrontier reports, its neighbors of a free leaf leave out
+      the face below the leaf (the blind spot).
+      update() follows a sequence of maps. It walks the previous and the new octree together, only down to the
+      leafs, and re-evaluates the voxels on both sides of the faces of every leaf whose state changed. The walk
+      still visits every node of both maps, since two maps share no nodes to tell what did not change, but it only
+      compares states; the expensive part, looking up the neighbors of voxels, grows with what changed instead of
+      with the explored volume. The frontiers can then be listed without scanning the map.
+     */
+    class FrontierIndex
+    {
+    public:
+        // Cube of keys from low, width keys on each side, with one state in the previous map and another in the new one
+        struct ChangedLeaf
+        {
+            int low [3];
+            int width;
+        };
+
+        FrontierIndex();
+
+        /**
+         * @brief      Moves the index from previous to current. previous is NULL for the first map, the whole
+         *             current map is then indexed. Both maps are only read, previous can be deleted afterwards.
+         *
+         * @return     Number of leafs whose state changed
+         */
+        std::size_t update(octomap::OcTree const* previous, octomap::OcTree const& current);
+        // The cubes whose state changed in the last update, everything else has the state it had in previous
+        std::vector<ChangedLeaf> const& changedLeafs() const;
+
+        /**
+         * @brief      Appends the first frontier_amount frontier cells inside the geofence of the request, with the
+         *             size of the free leaf next to them as searchFrontier does. The cells come in key order, z then
+         *             y then x, bucket by bucket, so the same index always gives the same frontiers. Only the buckets
+         *             the geofence reaches are visited, it takes time in proportion to the fewer of those and of all
+         *             the buckets, plus the frontier cells handed out.
+         */
+        void findFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+            int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const;
+
+        /**
+         * @brief      Appends the frontier_amount frontier cells inside the geofence of the request closest to its
+         *             current_position, closest first, as findFrontiers builds them. Only the cells of the buckets
+         *             around the position that can hold them are looked at, see NearestFrontierQuery.
+         */
+        void findNearestFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+            int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const;
+        /**
+         * @brief      Same, continuing query where it stopped instead of starting from current_position, so paging
+         *             through the nearest frontiers visits each bucket once. query must be one of this index.
+         */
+        void findNearestFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+            NearestFrontierQuery & query, int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const;
+
+        /**
+         * @brief      Appends the frontier cells whose center is at most radius away from position, closest first
+         */
+        void findFrontiersWithin(octomath::Vector3 const& position, double radius, std::vector<octomap::OcTreeKey> & keys) const;
+
+        bool contains(octomap::OcTreeKey const& key) const;
+        std::size_t size() const;
+        void clear();
+
+    private:
+        friend class NearestFrontierQuery;
+        typedef std::unordered_set<octomap::OcTreeKey, octomap::OcTreeKey::KeyHash> KeySet;
+        // Cells by bucket, the cube of kBucketWidth keys per side holding them, keyed by the key of the cells shifted by kBucketShift
+        typedef std::unordered_map<octomap::OcTreeKey, std::vector<octomap::OcTreeKey>, octomap::OcTreeKey::KeyHash> Buckets;
+        static int const kBucketShift = 3;
+        static int const kBucketWidth = 1 << kBucketShift;
+
+        void diff(octomap::OcTree const* previous, octomap::OcTreeNode const* before, octomap::OcTree const& current, octomap::OcTreeNode const* after,
+            int const low [3], int width, std::vector<ChangedLeaf> & changed) const;
+        void evaluate(octomap::OcTree const& octree, int x, int y, int z, LazyThetaStarOctree::LeafCache & leaf_cache, KeySet & evaluated);
+        bool isFrontierCell(octomap::OcTree const& octree, octomap::OcTreeKey const& key, LazyThetaStarOctree::LeafCache & leaf_cache) const;
+        void insertCell(octomap::OcTreeKey const& key);
+        void eraseCell(octomap::OcTreeKey const& key);
+        frontiers_msgs::VoxelMsg toVoxelMsg(octomap::OcTree const& octree, octomap::OcTreeKey const& key, LazyThetaStarOctree::LeafCache & leaf_cache) const;
+        // Center of the voxels of key along one axis, as OcTree::keyToCoord
+        double coordinateOf(int key) const;
+        // Bucket holding the voxels of coordinate along one axis, can be outside of the octree
+        int bucketOf(double coordinate) const;
+
+        KeySet frontier_cells;
+        Buckets buckets;
+        std::vector<ChangedLeaf> changed_leafs;
+        // Bounds of the buckets ever used, the nearest queries stop once past them
+        int bucket_low [3];
+        int bucket_high [3];
+        double resolution;
+        unsigned int tree_depth;
+    };
+
+    /**
+     * @brief
+     The frontier cells of a FrontierIndex in increasing distance from a position, one at a time, so the search can
+      stop once it has the ones it wants. The buckets are visited in rings around the one of the position and a cell
+      is only handed out when every bucket that could hold a closer one was already visited.
+      The index must not change while the query is used.
+     */
+    class NearestFrontierQuery
+    {
+    public:
+        NearestFrontierQuery(FrontierIndex const& index, octomath::Vector3 const& position);
+
+        /**
+         * @return     False once every cell was handed out
+         */
+        bool next(octomap::OcTreeKey & key, double & distance);
+
+    private:
+        typedef std::pair<double, octomap::OcTreeKey> Candidate;
+        struct Farther
+        {
+            bool operator()(Candidate const& lhs, Candidate const& rhs) const
+            {
+                return lhs.first > rhs.first;
+            }
+        };
+
+        void visitRing();
+        void visitBucket(int x, int y, int z);
+        // Lower bound of the distance to the cells of the buckets not visited yet
+        double unvisitedDistance() const;
+
+        FrontierIndex const& index;
+        double position [3];
+        // Bucket of the position, can be outside of the octree
+        int center [3];
+        // Buckets at this Chebyshev distance from center are the next to visit
+        int ring;
+        int last_ring;
+        std::priority_queue<Candidate, std::vector<Candidate>, Farther> candidates;
+    };
+}
+#endif // FRONTIER_INDEX_H
@@ -2,6 +2,11 @@
 #define FRONTIERS_H
 
 #include <frontiers_common.h>
+#include <subtree_summary.h>
+#include <atomic>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace Frontiers{
 
@@ -10,6 +15,81 @@ namespace Frontiers{
     bool isOccupied(octomath::Vector3 const& grid_coordinates_toTest, octomap::OcTree const& octree);
     bool isExplored(octomath::Vector3 const& grid_coordinates_toTest, octomap::OcTree const& octree);
     bool isFrontier(octomap::OcTree& octree, octomath::Vector3 const&  candidate); 
+    // Same as isFrontier, answered without looking at the neighbors when the summary rules out the parent of the leaf.
+    // The summary must be built for this octree
+    bool isFrontier(octomap::OcTree& octree, octomath::Vector3 const&  candidate, SubtreeSummary const& summary);
+    bool isInsideGeofence(octomath::Vector3 const&  candidate, geometry_msgs::Point geofence_min, geometry_msgs::Point geofence_max);
+    /**
+     * @brief
+     Searches the frontiers of a request in pages: each findMore continues where the last one stopped, so paging
+      through k frontiers scans the request box once instead of once per page.
+      The frontiers are the unknown neighbors of the free leafs in the request box, as searchFrontier defines them,
+      but not in its order: the box is split in octree aligned blocks scanned by thread_count threads and merged
+      in block scan order, so a request for fewer frontiers than there are keeps other ones than searchFrontier.
+      The order does not depend on the threads. With a summary built for the octree, the subtrees without free
+      leafs next to unknown space are skipped, the same frontiers are found but the order inside a block changes.
+      The octree and the summary must outlive the search and not change while it is used.
+     */
+    class FrontierSearch
+    {
+    public:
+        FrontierSearch();
+
+        /**
+         * @brief      Forgets the last search and splits the box of the request in blocks, nothing is scanned yet
+         *
+         * @return     False if the request box is outside of the octree
+         */
+        bool start(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request, int thread_count,
+            SubtreeSummary const* summary = NULL);
+
+        /**
+         * @brief      Appends the next frontiers, at most frontier_amount. Blocks already scanned are not scanned again.
+         *
+         * @return     Number of frontiers appended, fewer than frontier_amount once the search is finished
+         */
+        int findMore(int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers);
+        // Every frontier was handed out
+        bool finished() const;
+
+    private:
+        typedef std::vector<std::pair<octomap::OcTreeKey, frontiers_msgs::VoxelMsg>> KeyedFrontiers;
+
+        struct Block
+        {
+            octomap::OcTreeKey min;
+            octomap::OcTreeKey max;
+            KeyedFrontiers found;
+            bool done;
+        };
+
+        // Frontiers next to the free leafs owned by the block, the ones whose lowest key inside the request box
+        // falls in it, so a leaf that spans several blocks is only scanned once. Blocks are scanned whole, a
+        // frontier can also be found from a neighboring block and only the merge knows which one comes first.
+        // With a summary only the leafs it cannot rule out are scanned.
+        // Returns false when cancelled before the end, the block is then incomplete.
+        bool scanBlock(Block & block, std::atomic<bool> const& cancelled) const;
+
+        octomap::OcTree const* octree;
+        frontiers_msgs::FindFrontiers::Request request;
+        SubtreeSummary const* summary;
+        int thread_count;
+        octomap::OcTreeKey box_min;
+        // In scan order
+        std::vector<Block> blocks;
+        // Blocks before merged_blocks were handed out, and the first merged_in_block frontiers of the next one
+        std::size_t merged_blocks;
+        std::size_t merged_in_block;
+        std::unordered_set<octomap::OcTreeKey, octomap::OcTreeKey::KeyHash> merged;
+    };
+
+    /**
+     * @brief      The first frontier_amount frontiers of a FrontierSearch of the request, in one go.
+     *
+     * @return     False if the request box is outside of the octree
+     */
+    bool searchFrontierParallel(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+        int frontier_amount, int thread_count, std::vector<frontiers_msgs::VoxelMsg> & frontiers, SubtreeSummary const* summary = NULL);
     void searchFrontier(octomap::OcTree const& octree, octomap::OcTree::leaf_bbx_iterator & it, frontiers_msgs::FindFrontiers::Request  &request,
         frontiers_msgs::FindFrontiers::Response &reply, ros::Publisher const& marker_pub, bool publish);
     
@@ -4,52 +4,84 @@
 
 #include <chrono>
 #include <unordered_set>
+#include <vector>
 #include <octomap/math/Vector3.h>
 #include <octomap/OcTree.h>
 #include <memory>
 #include <ros/ros.h>
 #include <cmath>
+#include <voxel_id.h>
 
 namespace LazyThetaStarOctree{
 
-    struct Vector3PointerHash
+    /**
+     * @brief      Set of neighbors, each identified by its voxel. The coordinates are the ones of the point that
+     *             generated it (the cell center for generateNeighbors_filter_pointers).
+     *             Entries are stored by value in insertion order and clear() keeps the memory, so a set that is
+     *             reused between expansions stops allocating once it has seen the largest neighborhood.
+     *             Iterators are invalidated by insertion.
+     */
+    class NeighborSet
     {
-        std::size_t operator()(const std::shared_ptr<octomath::Vector3> & v) const 
-        {
-            double scale = 0.0001;
-            std::size_t hx = std::hash<float>{}( (int)std::round(v->x() / scale) * scale );
-            std::size_t hy = std::hash<float>{}( (int)std::round(v->y() / scale) * scale );
-            std::size_t hz = std::hash<float>{}( (int)std::round(v->z() / scale) * scale );
-
-            // ROS_WARN_STREAM(*v << " => " << (int)(v->x() / scale) * scale << "  " << (int)(v->y() / scale) * scale << "  " << (int)(v->z() / scale) * scale);
-            // ROS_WARN_STREAM(*v << " => " << hx << "  " << hy << "  " << hz);
-
-
-            std::size_t return_value = ((hx 
-               ^ (hy << 1)) >> 1)
-               ^ (hz << 1);
-            // std::cout << return_value << std::endl;
-            return return_value;
+    public:
+        typedef std::pair<VoxelId, octomath::Vector3> value_type;
+        typedef std::vector<value_type>::const_iterator const_iterator;
+        typedef const_iterator iterator;
 
+        std::pair<const_iterator, bool> insert(value_type const& neighbor)
+        {
+            return emplace(neighbor.first, neighbor.second);
         }
+        std::pair<const_iterator, bool> emplace(VoxelId const& voxel_id, octomath::Vector3 const& coordinates)
+        {
+            std::pair<std::size_t*, bool> slot = index.insert(voxel_id, entries.size());
+            if(!slot.second)
+            {
+                return std::make_pair(entries.cbegin() + *(slot.first), false);
+            }
+            entries.push_back( value_type(voxel_id, coordinates) );
+            return std::make_pair(entries.cend() - 1, true);
+        }
+        const_iterator find(VoxelId const& voxel_id) const
+        {
+            std::size_t const* position = index.find(voxel_id);
+            if(position == NULL)
+            {
+                return entries.cend();
+            }
+            return entries.cbegin() + *position;
+        }
+        const_iterator begin() const
+        {
+            return entries.cbegin();
+        }
+        const_iterator end() const
+        {
+            return entries.cend();
+        }
+        std::size_t size() const
+        {
+            return entries.size();
+        }
+        bool empty() const
+        {
+            return entries.empty();
+        }
+        void clear()
+        {
+            entries.clear();
+            index.clear();
+        }
+    private:
+        std::vector<value_type> entries;
+        VoxelIdMap<std::size_t> index;
     };
+    // Name kept for the callers that were written when neighbors were a set of pointers
+    typedef NeighborSet unordered_set_pointers;
 
-    struct VectorPointerComparatorEqual // for unordered_map
-    { 
-        bool operator () (const std::shared_ptr<octomath::Vector3> & lhs, const std::shared_ptr<octomath::Vector3> & rhs) const 
-        { 
-            double scale = 0.0001;
-            // ROS_WARN_STREAM("Distance from " << *lhs << " and  " << *rhs << " is " << lhs->distance(*rhs) << " <= " << scale << " returning " << (lhs->distance(*rhs) <= scale)   );
-            return lhs->distance(*rhs) <= scale;
-            // returns !0 if the two container object keys passed as arguments are to be considered equal.
-        } 
-    };
-
-    typedef std::unordered_set<std::shared_ptr<octomath::Vector3>, Vector3PointerHash, VectorPointerComparatorEqual> unordered_set_pointers;
-
-	bool addIfUnique(unordered_set_pointers & neighbors, float x, float y, float z );
-    bool addIfUnique(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert );
-    bool addIfUniqueValue(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert );
+	bool addIfUnique(unordered_set_pointers & neighbors, float x, float y, float z, float resolution );
+    bool addIfUnique(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert, float resolution );
+    bool addIfUniqueValue(unordered_set_pointers & neighbors, VoxelId const& voxel_id, octomath::Vector3 & toInsert );
 	// TODO reduce neighbor number by finding cell center and removing duplicates
 	void generateNeighbors_pointers(unordered_set_pointers & neighbors, 
 		octomath::Vector3 const& center_coords, 
@@ -61,6 +93,32 @@ namespace LazyThetaStarOctree{
         octomath::Vector3 const& center_coords, 
         float node_size, float resolution, octomap::OcTree const& octree, bool debug_on = false);
     bool addSparseNeighbor(unordered_set_pointers & neighbors, double x, double y, double z, octomap::OcTree const& octree);
+
+    /**
+     * @brief      Known leaf that shares part of a face with a voxel.
+     */
+    struct FaceNeighbor
+    {
+        VoxelId voxel_id;
+        // Key of the leaf center at depth, as given by OcTree::adjustKeyAtDepth
+        octomap::OcTreeKey key;
+        unsigned int depth;
+        double size;
+        octomap::OcTreeNode const* node;
+    };
+    /**
+     * @brief      Replaces neighbors with the known leafs across the six faces of voxel_id, each of them once.
+     *             Works on keys: descends the octree only into the nodes that touch the layer just outside each
+     *             face, so a face covered by one big leaf costs a single descent instead of one lookup per
+     *             resolution step. Unknown space is skipped, as in generateNeighbors_filter_pointers.
+     *             Faces on the border of the key space have no neighbors.
+     */
+    void generateFaceNeighbors(std::vector<FaceNeighbor> & neighbors, VoxelId const& voxel_id, octomap::OcTree const& octree);
+    /**
+     * @brief      Same neighbors as generateNeighbors_filter_pointers for the voxel voxel_id, each with its cell center,
+     *             found through generateFaceNeighbors.
+     */
+    void generateNeighbors_keys(unordered_set_pointers & neighbors, VoxelId const& voxel_id, octomap::OcTree const& octree);
     // void generateNeighbors_pointers_sparse(octomap::OcTree const& octree, double const* lookup_table, std::unordered_set<std::shared_ptr<octomath::Vector3>> & neighbors, 
         // octomath::Vector3 const& center_coords, 
         // float node_size, float resolution, bool debug_on = false);
@@ -70,7 +128,110 @@ namespace LazyThetaStarOctree{
     //     double margin_neighbor_res, // security margin neighbor count
     //     bool debug_on = false);
 
+    /**
+     * @brief      Known leaf that contains a point.
+     */
+    struct LeafLocation
+    {
+        LeafLocation()
+            : node(NULL), depth(0), side_length(0)
+        {}
+        octomap::OcTreeNode* node;
+        VoxelId voxel_id;
+        unsigned int depth;
+        octomath::Vector3 center;
+        double side_length;
+    };
+    /**
+     * @brief      Finds the leaf that contains key in a single descent from the root, the one search() would return,
+     *             together with its depth, cell center and side length.
+     *
+     * @return     False if key is in unknown space, location is untouched then
+     */
+    bool locateLeaf(octomap::OcTreeKey const& key, octomap::OcTree const& octree, LeafLocation & location);
+    // Also false if the coordinates are outside of the octree's key range
+    bool locateLeaf(octomath::Vector3 const& coordinates, octomap::OcTree const& octree, LeafLocation & location);
+
+    /**
+     * @brief      Direct mapped cache in front of locateLeaf.
+     *             The slot of a key is chosen by the block of 4x4x4 keys it falls in and a slot answers every key
+     *             inside the leaf it holds, so looking up points near a recently found leaf does not descend again.
+     *             Unknown space is not cached. The cache belongs to one octree and empties itself when it is
+     *             given another octree object. A cache that outlives a map, where the next one can reuse the same
+     *             address, or that sees a map edited in place is told the map sequence number through useMap.
+     */
+    class LeafCache
+    {
+    public:
+        LeafCache()
+            : slots(slot_count), source(NULL), map_sequence(0)
+        {}
+
+        // Empties the cache when map_sequence is not the number of the map it holds leafs of
+        void useMap(uint64_t map_sequence)
+        {
+            if(map_sequence != this->map_sequence)
+            {
+                clear();
+                this->map_sequence = map_sequence;
+            }
+        }
+
+        bool locate(octomap::OcTreeKey const& key, octomap::OcTree const& octree, LeafLocation & location)
+        {
+            if(source != &octree)
+            {
+                clear();
+                source = &octree;
+            }
+            LeafLocation & slot = slots[indexOf(key)];
+            if(slot.node != NULL && VoxelId(key, slot.depth) == slot.voxel_id)
+            {
+                location = slot;
+                return true;
+            }
+            if(!locateLeaf(key, octree, location))
+            {
+                return false;
+            }
+            slot = location;
+            return true;
+        }
+        bool locate(octomath::Vector3 const& coordinates, octomap::OcTree const& octree, LeafLocation & location)
+        {
+            octomap::OcTreeKey key;
+            if(!octree.coordToKeyChecked(coordinates, key))
+            {
+                return false;
+            }
+            return locate(key, octree, location);
+        }
+        void clear()
+        {
+            for (LeafLocation & slot : slots)
+            {
+                slot.node = NULL;
+            }
+            source = NULL;
+        }
+
+    private:
+        // Power of two
+        static const std::size_t slot_count = 256;
+
+        static std::size_t indexOf(octomap::OcTreeKey const& key)
+        {
+            std::size_t h = (std::size_t(key[0] >> 2) * 73856093u) ^ (std::size_t(key[1] >> 2) * 19349663u) ^ (std::size_t(key[2] >> 2) * 83492791u);
+            return h & (slot_count - 1);
+        }
+
+        std::vector<LeafLocation> slots;
+        octomap::OcTree const* source;
+        uint64_t map_sequence;
+    };
+
     // Other way to find the depth based on the search code of the octree
+    // Throws out_of_range if key is in unknown space
     int getNodeDepth_Octomap (const octomap::OcTreeKey& key, 
     	octomap::OcTree const& octree)  ;
 
@@ -101,9 +262,9 @@ namespace LazyThetaStarOctree{
      * @param      octree       The octree
      * @param      cell_size    Variable to store the cell size
      *
-     * @return     true if the coordinates correspond to the cell center, false otherise
+     * @return     the id of the cell
      */
-    void updateToCellCenterAndFindSize(octomath::Vector3 & coordinates, octomap::OcTree const& octree, double& side_length, const double lookup_table []);
+    VoxelId updateToCellCenterAndFindSize(octomath::Vector3 & coordinates, octomap::OcTree const& octree, double& side_length, const double lookup_table []);
 
     void fillLookupTable(double resolution, int tree_depth, double lookup_table_ptr[]);
 	void findDifferentSizeCells_ptr_3D(octomap::OcTree const& octree);
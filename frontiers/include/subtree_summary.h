@@ -0,0 +1,102 @@
+#ifndef SUBTREE_SUMMARY_H
+#define SUBTREE_SUMMARY_H
+
+#include <frontiers_common.h>
+#include <frontier_index.h>
+#include <neighbors.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Frontiers{
+
+    /**
+     * @brief
+     What the subtree of every inner node of an octree holds: whether one of its free leafs might be next to unknown
+      space, on the faces searchFrontier looks at (the sides and above), and the volume of its known leafs.
+      Traversals skip the subtrees without boundary and take the explored volume of the subtrees inside their box at
+      once, so they cost in proportion to the exploration boundary instead of to the explored volume.
+      Built for one map, known by the sequence number its owner gives it; a new map or a map edited in place needs a
+      new number. update() follows the next map from the changes a FrontierIndex found between both.
+     */
+    class SubtreeSummary
+    {
+    public:
+        SubtreeSummary();
+
+        /**
+         * @brief      Summarizes the whole octree, replacing what was there
+         *
+         * @return     Number of inner nodes summarized
+         */
+        std::size_t build(octomap::OcTree const& octree, uint64_t map_sequence);
+        /**
+         * @brief      Moves the summary from the map previous_sequence to octree, which differs from it by the
+         *             changed cubes. Only the leafs within one voxel of a change are summarized again, with their
+         *             ancestors. Builds from scratch when the summary is not the one of previous_sequence.
+         *
+         * @return     Number of inner nodes summarized again
+         */
+        std::size_t update(octomap::OcTree const& octree, uint64_t map_sequence, uint64_t previous_sequence,
+            std::vector<FrontierIndex::ChangedLeaf> const& changed);
+        bool builtFor(uint64_t map_sequence) const;
+
+        /**
+         * @brief      False when the subtree of the node at depth holding key has no free leaf next to unknown space.
+         *             Leafs and nodes that were not summarized might have one.
+         */
+        bool mayHaveBoundary(octomap::OcTreeKey const& key, unsigned int depth) const;
+
+        /**
+         * @brief      Appends the free leafs overlapping the keys from min to max that might be next to unknown space.
+         *             Every free leaf next to unknown space is there, some others too: the leafs are pruned by
+         *             their parent.
+         */
+        void findBoundaryLeafs(octomap::OcTree const& octree, octomap::OcTreeKey const& min, octomap::OcTreeKey const& max,
+            std::vector<LazyThetaStarOctree::LeafLocation> & leafs) const;
+
+        /**
+         * @brief      Volume in cubic meters of the known leafs inside the box from min to max, as volume::calculateVolume
+         */
+        double exploredVolume(octomap::OcTree const& octree, octomath::Vector3 const& min, octomath::Vector3 const& max) const;
+
+        std::size_t size() const;
+        void clear();
+
+    private:
+        struct Summary
+        {
+            bool boundary;
+            double explored_volume;
+        };
+
+        // Keys from low to high, both included
+        struct KeyBox
+        {
+            int low [3];
+            int high [3];
+        };
+
+        Summary summarize(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low, unsigned int depth,
+            LazyThetaStarOctree::LeafCache & leaf_cache);
+        // Summarizes again the nodes overlapping dirty, the summaries of the other inner nodes are kept
+        Summary resummarize(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low, unsigned int depth,
+            std::vector<KeyBox> const& dirty, LazyThetaStarOctree::LeafCache & leaf_cache, std::size_t & resummarized);
+        Summary leafSummary(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low, unsigned int depth,
+            LazyThetaStarOctree::LeafCache & leaf_cache) const;
+        // Whether a voxel across the sides or the top of the cube of keys is unknown, outside of the octree counts as unknown
+        bool touchesUnknown(octomap::OcTree const& octree, octomap::OcTreeKey const& low, int width, LazyThetaStarOctree::LeafCache & leaf_cache) const;
+        void collectBoundaryLeafs(octomap::OcTree const& octree, octomap::OcTreeNode* node, octomap::OcTreeKey const& low, unsigned int depth,
+            octomap::OcTreeKey const& min, octomap::OcTreeKey const& max, std::vector<LazyThetaStarOctree::LeafLocation> & leafs) const;
+        double exploredVolume(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low, unsigned int depth,
+            octomath::Vector3 const& min, octomath::Vector3 const& max) const;
+        // Lowest key of the child of the node at depth with its lowest key at low
+        static octomap::OcTreeKey childLow(octomap::OcTreeKey const& low, unsigned int depth, unsigned int tree_depth, unsigned int child);
+
+        // By the packed VoxelId of the inner node
+        std::unordered_map<uint64_t, Summary> summaries;
+        bool built;
+        uint64_t map_sequence;
+    };
+}
+#endif // SUBTREE_SUMMARY_H
@@ -0,0 +1,267 @@
+#ifndef VOXEL_ID_H
+#define VOXEL_ID_H
+
+#include <octomap/OcTree.h>
+#include <octomap/math/Vector3.h>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <utility>
+
+namespace LazyThetaStarOctree{
+
+    /**
+     * @brief      Exact identity of an octree voxel packed in 64 bits.
+     *             Bits 0 to 47 hold the three 16 bit components of the OcTreeKey, with the bits finer than
+     *             the voxel's depth cleared. Bits 48 to 55 hold the depth (16 is the finest level).
+     *             Two voxels are the same if and only if their ids are equal, no floating point tolerance involved.
+     */
+    struct VoxelId
+    {
+        static const uint64_t invalid = ~uint64_t(0);
+        static const unsigned int max_depth = 16;
+
+        VoxelId()
+            : packed(invalid)
+        {}
+        VoxelId(octomap::OcTreeKey const& key, unsigned int depth)
+        {
+            unsigned int diff = max_depth - depth;
+            uint64_t x = (key[0] >> diff) << diff;
+            uint64_t y = (key[1] >> diff) << diff;
+            uint64_t z = (key[2] >> diff) << diff;
+            packed = x | (y << 16) | (z << 32) | (uint64_t(depth) << 48);
+        }
+
+        bool isValid() const
+        {
+            return packed != invalid;
+        }
+        unsigned int depth() const
+        {
+            return (packed >> 48) & 0xFF;
+        }
+        /**
+         * @brief      Key of the voxel center at depth(), as given by OcTree::adjustKeyAtDepth.
+         */
+        octomap::OcTreeKey key() const
+        {
+            unsigned int diff = max_depth - depth();
+            octomap::key_type center_offset = (diff == 0) ? 0 : (1 << (diff - 1));
+            return octomap::OcTreeKey(
+                (packed & 0xFFFF) + center_offset,
+                ((packed >> 16) & 0xFFFF) + center_offset,
+                ((packed >> 32) & 0xFFFF) + center_offset);
+        }
+        bool operator==(VoxelId const& other) const
+        {
+            return packed == other.packed;
+        }
+        bool operator!=(VoxelId const& other) const
+        {
+            return packed != other.packed;
+        }
+
+        uint64_t packed;
+    };
+
+    struct VoxelIdHash
+    {
+        std::size_t operator()(VoxelId const& id) const
+        {
+            // splitmix64 finalizer, the key bits are very regular so they need to be mixed
+            uint64_t h = id.packed;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+            return h ^ (h >> 31);
+        }
+    };
+
+    /**
+     * @brief      Builds the id of the voxel at depth that contains the coordinates.
+     *             Follows the same discretization as OcTree::coordToKey so it can be used when no octree is at hand.
+     *
+     * @param      coordinates  Any point inside the voxel, usually its center
+     * @param      resolution   Side of the smallest voxel of the octree
+     * @param      depth        Depth of the voxel, 16 for the smallest voxel
+     */
+    inline VoxelId voxelIdFromCoordinates(octomath::Vector3 const& coordinates, double resolution, unsigned int depth = VoxelId::max_depth)
+    {
+        double resolution_factor = 1.0 / resolution;
+        int tree_max_val = 1 << (VoxelId::max_depth - 1);
+        octomap::OcTreeKey key (
+            (octomap::key_type)( (int)std::floor(resolution_factor * coordinates.x()) + tree_max_val ),
+            (octomap::key_type)( (int)std::floor(resolution_factor * coordinates.y()) + tree_max_val ),
+            (octomap::key_type)( (int)std::floor(resolution_factor * coordinates.z()) + tree_max_val ));
+        return VoxelId(key, depth);
+    }
+
+    /**
+     * @brief      Flat hash table from VoxelId to a small value, open addressing with linear probing.
+     *             clear() is O(1): every slot is stamped with the generation it was written in and slots
+     *             from an older generation count as empty. Memory is only requested when the table grows,
+     *             so a table that is cleared and filled again reaches a steady state without allocations.
+     *             Pointers returned by find and insert are invalidated by the next insertion.
+     */
+    template <typename Value>
+    class VoxelIdMap
+    {
+    public:
+        VoxelIdMap()
+            : generation(1), count(0), mask(0)
+        {}
+
+        Value* find(VoxelId const& id)
+        {
+            return const_cast<Value*>( static_cast<VoxelIdMap const&>(*this).find(id) );
+        }
+        Value const* find(VoxelId const& id) const
+        {
+            if(slots.empty())
+            {
+                return NULL;
+            }
+            for (std::size_t i = indexOf(id); isLive(slots[i]); i = (i + 1) & mask)
+            {
+                if(slots[i].id == id)
+                {
+                    return &(slots[i].value);
+                }
+            }
+            return NULL;
+        }
+        bool contains(VoxelId const& id) const
+        {
+            return find(id) != NULL;
+        }
+        /**
+         * @brief      Inserts the value if there is no entry for id yet.
+         *
+         * @return     Pointer to the stored value and true if it was inserted, false if id was already there.
+         */
+        std::pair<Value*, bool> insert(VoxelId const& id, Value const& value)
+        {
+            if( (count + 1) * 2 > slots.size() )
+            {
+                grow();
+            }
+            std::size_t i = indexOf(id);
+            for (; isLive(slots[i]); i = (i + 1) & mask)
+            {
+                if(slots[i].id == id)
+                {
+                    return std::make_pair(&(slots[i].value), false);
+                }
+            }
+            slots[i].id = id;
+            slots[i].value = value;
+            slots[i].generation = generation;
+            ++count;
+            return std::make_pair(&(slots[i].value), true);
+        }
+        Value& operator[](VoxelId const& id)
+        {
+            return *(insert(id, Value()).first);
+        }
+        bool erase(VoxelId const& id)
+        {
+            if(slots.empty())
+            {
+                return false;
+            }
+            std::size_t i = indexOf(id);
+            for (; isLive(slots[i]); i = (i + 1) & mask)
+            {
+                if(slots[i].id == id)
+                {
+                    break;
+                }
+            }
+            if(!isLive(slots[i]))
+            {
+                return false;
+            }
+            // Backward shift deletion, keeps probe sequences unbroken without tombstones
+            std::size_t hole = i;
+            for (std::size_t j = (hole + 1) & mask; isLive(slots[j]); j = (j + 1) & mask)
+            {
+                std::size_t ideal = indexOf(slots[j].id);
+                bool stays = (hole <= j) ? (hole < ideal && ideal <= j) : (hole < ideal || ideal <= j);
+                if(!stays)
+                {
+                    slots[hole] = slots[j];
+                    hole = j;
+                }
+            }
+            slots[hole].generation = 0;
+            --count;
+            return true;
+        }
+        std::size_t size() const
+        {
+            return count;
+        }
+        bool empty() const
+        {
+            return count == 0;
+        }
+        void clear()
+        {
+            count = 0;
+            ++generation;
+            if(generation == 0)
+            {
+                // Wrapped around, stale stamps could look live again
+                for (Slot & slot : slots)
+                {
+                    slot.generation = 0;
+                }
+                generation = 1;
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            Slot()
+                : value(), generation(0)
+            {}
+            VoxelId id;
+            Value value;
+            uint32_t generation;
+        };
+
+        bool isLive(Slot const& slot) const
+        {
+            return slot.generation == generation;
+        }
+        std::size_t indexOf(VoxelId const& id) const
+        {
+            return VoxelIdHash()(id) & mask;
+        }
+        void grow()
+        {
+            std::vector<Slot> old_slots;
+            old_slots.swap(slots);
+            std::size_t new_size = old_slots.empty() ? 16 : old_slots.size() * 2;
+            slots.assign(new_size, Slot());
+            mask = new_size - 1;
+            uint32_t old_generation = generation;
+            generation = 1;
+            count = 0;
+            for (Slot const& slot : old_slots)
+            {
+                if(slot.generation == old_generation)
+                {
+                    insert(slot.id, slot.value);
+                }
+            }
+        }
+
+        std::vector<Slot> slots;
+        uint32_t generation;
+        std::size_t count;
+        std::size_t mask;
+    };
+}
+#endif // VOXEL_ID_H
@@ -0,0 +1,487 @@
+#include <frontier_index.h>
+#include <frontiers.h>
+#include <initializer_list>
+#include <limits>
+
+namespace Frontiers{
+
+    namespace
+    {
+        enum CellState { kFree, kOccupied, kUnknown };
+
+        CellState stateOf(octomap::OcTree const* octree, octomap::OcTreeNode const* node)
+        {
+            if(node == NULL)
+            {
+                return kUnknown;
+            }
+            return octree->isNodeOccupied(node) ? kOccupied : kFree;
+        }
+
+        bool isSplit(octomap::OcTree const* octree, octomap::OcTreeNode const* node)
+        {
+            return node != NULL && octree->nodeHasChildren(node);
+        }
+
+        // A leaf stands for all of its children
+        octomap::OcTreeNode const* childOf(octomap::OcTree const* octree, octomap::OcTreeNode const* node, unsigned int child)
+        {
+            if(!isSplit(octree, node))
+            {
+                return node;
+            }
+            if(!octree->nodeChildExists(node, child))
+            {
+                return NULL;
+            }
+            return octree->getNodeChild(node, child);
+        }
+
+        int floorDivide(int value, int divisor)
+        {
+            return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+        }
+    }
+
+    FrontierIndex::FrontierIndex()
+        : resolution(0), tree_depth(0)
+    {
+        clear();
+    }
+
+    std::size_t FrontierIndex::update(octomap::OcTree const* previous, octomap::OcTree const& current)
+    {
+        if(previous != NULL && (previous->getResolution() != current.getResolution() || previous->getTreeDepth() != current.getTreeDepth()))
+        {
+            previous = NULL;
+        }
+        if(previous == NULL)
+        {
+            clear();
+        }
+        resolution = current.getResolution();
+        tree_depth = current.getTreeDepth();
+        std::vector<ChangedLeaf> & changed = changed_leafs;
+        changed.clear();
+        int root_low [3] = {0, 0, 0};
+        diff(previous, previous == NULL ? NULL : previous->getRoot(), current, current.getRoot(), root_low, 1 << tree_depth, changed);
+
+        // Inside a leaf that did not change across states the voxels next to its faces are the only ones whose
+        // neighbors can differ, so each face is evaluated on both sides
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        KeySet evaluated;
+        int max_key = (1 << tree_depth) - 1;
+        for (ChangedLeaf const& leaf : changed)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                int a = (axis + 1) % 3;
+                int b = (axis + 2) % 3;
+                int faces [4] = {leaf.low[axis], leaf.low[axis] + leaf.width - 1, leaf.low[axis] - 1, leaf.low[axis] + leaf.width};
+                for (int face : faces)
+                {
+                    if(face < 0 || face > max_key)
+                    {
+                        continue;
+                    }
+                    for (int i = leaf.low[a]; i < leaf.low[a] + leaf.width; ++i)
+                    {
+                        for (int j = leaf.low[b]; j < leaf.low[b] + leaf.width; ++j)
+                        {
+                            int cell [3];
+                            cell[axis] = face;
+                            cell[a] = i;
+                            cell[b] = j;
+                            evaluate(current, cell[0], cell[1], cell[2], leaf_cache, evaluated);
+                        }
+                    }
+                }
+            }
+        }
+        return changed.size();
+    }
+
+    void FrontierIndex::diff(octomap::OcTree const* previous, octomap::OcTreeNode const* before, octomap::OcTree const& current, octomap::OcTreeNode const* after,
+        int const low [3], int width, std::vector<ChangedLeaf> & changed) const
+    {
+        bool before_split = isSplit(previous, before);
+        bool after_split = isSplit(&current, after);
+        if(!before_split && !after_split)
+        {
+            if(stateOf(previous, before) != stateOf(&current, after))
+            {
+                ChangedLeaf leaf;
+                std::copy(low, low + 3, leaf.low);
+                leaf.width = width;
+                changed.push_back(leaf);
+            }
+            return;
+        }
+        int half = width / 2;
+        for (unsigned int child = 0; child < 8; ++child)
+        {
+            // Same child order as octomap::computeChildIdx
+            int child_low [3] = { low[0] + ((child & 1) ? half : 0), low[1] + ((child & 2) ? half : 0), low[2] + ((child & 4) ? half : 0) };
+            diff(previous, before_split ? childOf(previous, before, child) : before, current, after_split ? childOf(&current, after, child) : after, child_low, half, changed);
+        }
+    }
+
+    void FrontierIndex::evaluate(octomap::OcTree const& octree, int x, int y, int z, LazyThetaStarOctree::LeafCache & leaf_cache, KeySet & evaluated)
+    {
+        octomap::OcTreeKey key (x, y, z);
+        if(!evaluated.insert(key).second)
+        {
+            return;
+        }
+        if(isFrontierCell(octree, key, leaf_cache))
+        {
+            insertCell(key);
+        }
+        else
+        {
+            eraseCell(key);
+        }
+    }
+
+    void FrontierIndex::insertCell(octomap::OcTreeKey const& key)
+    {
+        if(!frontier_cells.insert(key).second)
+        {
+            return;
+        }
+        octomap::OcTreeKey bucket (key[0] >> kBucketShift, key[1] >> kBucketShift, key[2] >> kBucketShift);
+        buckets[bucket].push_back(key);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bucket_low[axis] = std::min(bucket_low[axis], int(bucket[axis]));
+            bucket_high[axis] = std::max(bucket_high[axis], int(bucket[axis]));
+        }
+    }
+
+    void FrontierIndex::eraseCell(octomap::OcTreeKey const& key)
+    {
+        if(frontier_cells.erase(key) == 0)
+        {
+            return;
+        }
+        Buckets::iterator bucket = buckets.find(octomap::OcTreeKey(key[0] >> kBucketShift, key[1] >> kBucketShift, key[2] >> kBucketShift));
+        std::vector<octomap::OcTreeKey> & cells = bucket->second;
+        cells.erase(std::find(cells.begin(), cells.end(), key));
+        if(cells.empty())
+        {
+            buckets.erase(bucket);
+        }
+    }
+
+    double FrontierIndex::coordinateOf(int key) const
+    {
+        return (double(key - (1 << (tree_depth - 1))) + 0.5) * resolution;
+    }
+
+    int FrontierIndex::bucketOf(double coordinate) const
+    {
+        // Same discretization as OcTree::coordToKey
+        int key = int( std::floor(coordinate / resolution) ) + (1 << (tree_depth - 1));
+        return floorDivide(key, kBucketWidth);
+    }
+
+    bool FrontierIndex::isFrontierCell(octomap::OcTree const& octree, octomap::OcTreeKey const& key, LazyThetaStarOctree::LeafCache & leaf_cache) const
+    {
+        LazyThetaStarOctree::LeafLocation location;
+        if(leaf_cache.locate(key, octree, location))
+        {
+            return false;
+        }
+        // Sides and below, a free voxel right above an unknown one does not see it
+        int const steps [5][3] = { {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1} };
+        int max_key = (1 << tree_depth) - 1;
+        for (int n = 0; n < 5; ++n)
+        {
+            int neighbor [3] = { key[0] + steps[n][0], key[1] + steps[n][1], key[2] + steps[n][2] };
+            if(neighbor[0] < 0 || neighbor[1] < 0 || neighbor[2] < 0 || neighbor[0] > max_key || neighbor[1] > max_key || neighbor[2] > max_key)
+            {
+                continue;
+            }
+            if(leaf_cache.locate(octomap::OcTreeKey(neighbor[0], neighbor[1], neighbor[2]), octree, location) && !octree.isNodeOccupied(location.node))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void FrontierIndex::findFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+        int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const
+    {
+        if(buckets.empty() || frontier_amount <= 0)
+        {
+            return;
+        }
+        // Only on the bounds isInsideGeofence checks, which leaves out the bottom of the geofence
+        int low [3] = { std::max(bucket_low[0], bucketOf(request.min.x)), std::max(bucket_low[1], bucketOf(request.min.y)), bucket_low[2] };
+        int high [3] = { std::min(bucket_high[0], bucketOf(request.max.x)), std::min(bucket_high[1], bucketOf(request.max.y)), std::min(bucket_high[2], bucketOf(request.max.z)) };
+        std::size_t reached = 1;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if(high[axis] < low[axis])
+            {
+                return;
+            }
+            reached *= std::size_t(high[axis] - low[axis] + 1);
+        }
+        auto keyOrder = [](octomap::OcTreeKey const& lhs, octomap::OcTreeKey const& rhs)
+        {
+            return lhs[2] != rhs[2] ? lhs[2] < rhs[2] : (lhs[1] != rhs[1] ? lhs[1] < rhs[1] : lhs[0] < rhs[0]);
+        };
+        std::vector<Buckets::const_iterator> in_order;
+        if(reached <= buckets.size())
+        {
+            for (int z = low[2]; z <= high[2]; ++z)
+            {
+                for (int y = low[1]; y <= high[1]; ++y)
+                {
+                    for (int x = low[0]; x <= high[0]; ++x)
+                    {
+                        Buckets::const_iterator bucket = buckets.find(octomap::OcTreeKey(x, y, z));
+                        if(bucket != buckets.end())
+                        {
+                            in_order.push_back(bucket);
+                        }
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (Buckets::const_iterator bucket = buckets.begin(); bucket != buckets.end(); ++bucket)
+            {
+                bool reaches = true;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    reaches = reaches && bucket->first[axis] >= low[axis] && bucket->first[axis] <= high[axis];
+                }
+                if(reaches)
+                {
+                    in_order.push_back(bucket);
+                }
+            }
+            std::sort(in_order.begin(), in_order.end(), [&](Buckets::const_iterator lhs, Buckets::const_iterator rhs)
+            {
+                return keyOrder(lhs->first, rhs->first);
+            });
+        }
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        std::vector<octomap::OcTreeKey> cells;
+        int frontiers_count = 0;
+        for (Buckets::const_iterator bucket : in_order)
+        {
+            // The cells of a bucket are kept in the order they became frontiers
+            cells.clear();
+            for (octomap::OcTreeKey const& key : bucket->second)
+            {
+                if(isInsideGeofence(octree.keyToCoord(key), request.min, request.max))
+                {
+                    cells.push_back(key);
+                }
+            }
+            std::sort(cells.begin(), cells.end(), keyOrder);
+            for (octomap::OcTreeKey const& key : cells)
+            {
+                frontiers.push_back(toVoxelMsg(octree, key, leaf_cache));
+                if(++frontiers_count == frontier_amount)
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    void FrontierIndex::findNearestFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+        int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const
+    {
+        NearestFrontierQuery query (*this, octomath::Vector3(request.current_position.x, request.current_position.y, request.current_position.z));
+        findNearestFrontiers(octree, request, query, frontier_amount, frontiers);
+    }
+
+    void FrontierIndex::findNearestFrontiers(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+        NearestFrontierQuery & query, int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers) const
+    {
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        octomap::OcTreeKey key;
+        double distance;
+        int frontiers_count = 0;
+        while(frontiers_count < frontier_amount && query.next(key, distance))
+        {
+            if(!isInsideGeofence(octree.keyToCoord(key), request.min, request.max))
+            {
+                continue;
+            }
+            frontiers.push_back(toVoxelMsg(octree, key, leaf_cache));
+            ++frontiers_count;
+        }
+    }
+
+    void FrontierIndex::findFrontiersWithin(octomath::Vector3 const& position, double radius, std::vector<octomap::OcTreeKey> & keys) const
+    {
+        NearestFrontierQuery query (*this, position);
+        octomap::OcTreeKey key;
+        double distance;
+        while(query.next(key, distance) && distance <= radius)
+        {
+            keys.push_back(key);
+        }
+    }
+
+    frontiers_msgs::VoxelMsg FrontierIndex::toVoxelMsg(octomap::OcTree const& octree, octomap::OcTreeKey const& key, LazyThetaStarOctree::LeafCache & leaf_cache) const
+    {
+        octomath::Vector3 coordinates = octree.keyToCoord(key);
+        LazyThetaStarOctree::LeafLocation location;
+        frontiers_msgs::VoxelMsg voxel_msg;
+        voxel_msg.size = resolution;
+        // The free voxel below first, as the blind spot makes it the most common one
+        octomap::OcTreeKey const neighbors [5] = {
+            octomap::OcTreeKey(key[0], key[1], key[2] - 1), octomap::OcTreeKey(key[0] - 1, key[1], key[2]), octomap::OcTreeKey(key[0] + 1, key[1], key[2]),
+            octomap::OcTreeKey(key[0], key[1] - 1, key[2]), octomap::OcTreeKey(key[0], key[1] + 1, key[2]) };
+        for (octomap::OcTreeKey const& neighbor : neighbors)
+        {
+            if(leaf_cache.locate(neighbor, octree, location) && !octree.isNodeOccupied(location.node))
+            {
+                voxel_msg.size = location.side_length;
+                break;
+            }
+        }
+        voxel_msg.xyz_m.x = coordinates.x();
+        voxel_msg.xyz_m.y = coordinates.y();
+        voxel_msg.xyz_m.z = coordinates.z();
+        return voxel_msg;
+    }
+
+    std::vector<FrontierIndex::ChangedLeaf> const& FrontierIndex::changedLeafs() const
+    {
+        return changed_leafs;
+    }
+
+    bool FrontierIndex::contains(octomap::OcTreeKey const& key) const
+    {
+        return frontier_cells.count(key) > 0;
+    }
+
+    std::size_t FrontierIndex::size() const
+    {
+        return frontier_cells.size();
+    }
+
+    void FrontierIndex::clear()
+    {
+        frontier_cells.clear();
+        buckets.clear();
+        changed_leafs.clear();
+        std::fill(bucket_low, bucket_low + 3, std::numeric_limits<int>::max());
+        std::fill(bucket_high, bucket_high + 3, std::numeric_limits<int>::min());
+    }
+
+    NearestFrontierQuery::NearestFrontierQuery(FrontierIndex const& index, octomath::Vector3 const& position)
+        : index(index), ring(0), last_ring(-1)
+    {
+        if(index.buckets.empty())
+        {
+            return;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            this->position[axis] = position(axis);
+            center[axis] = index.bucketOf(position(axis));
+            last_ring = std::max(last_ring, std::max(center[axis] - index.bucket_low[axis], index.bucket_high[axis] - center[axis]));
+        }
+    }
+
+    bool NearestFrontierQuery::next(octomap::OcTreeKey & key, double & distance)
+    {
+        while(true)
+        {
+            if(!candidates.empty() && (ring > last_ring || candidates.top().first <= unvisitedDistance()))
+            {
+                distance = candidates.top().first;
+                key = candidates.top().second;
+                candidates.pop();
+                return true;
+            }
+            if(ring > last_ring)
+            {
+                return false;
+            }
+            visitRing();
+            ++ring;
+        }
+    }
+
+    void NearestFrontierQuery::visitRing()
+    {
+        // Only the part of the ring that overlaps the buckets in use
+        int low [3];
+        int high [3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            low[axis] = std::max(center[axis] - ring, index.bucket_low[axis]);
+            high[axis] = std::min(center[axis] + ring, index.bucket_high[axis]);
+        }
+        for (int x = low[0]; x <= high[0]; ++x)
+        {
+            for (int y = low[1]; y <= high[1]; ++y)
+            {
+                if(std::abs(x - center[0]) == ring || std::abs(y - center[1]) == ring)
+                {
+                    for (int z = low[2]; z <= high[2]; ++z)
+                    {
+                        visitBucket(x, y, z);
+                    }
+                }
+                else
+                {
+                    // Inside the ring on x and y, only its bottom and top faces
+                    for (int z : {center[2] - ring, center[2] + ring})
+                    {
+                        if(z >= low[2] && z <= high[2])
+                        {
+                            visitBucket(x, y, z);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void NearestFrontierQuery::visitBucket(int x, int y, int z)
+    {
+        FrontierIndex::Buckets::const_iterator bucket = index.buckets.find(octomap::OcTreeKey(x, y, z));
+        if(bucket == index.buckets.end())
+        {
+            return;
+        }
+        for (octomap::OcTreeKey const& key : bucket->second)
+        {
+            double distance_sq = 0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                double difference = index.coordinateOf(key[axis]) - position[axis];
+                distance_sq += difference * difference;
+            }
+            candidates.push(Candidate(std::sqrt(distance_sq), key));
+        }
+    }
+
+    double NearestFrontierQuery::unvisitedDistance() const
+    {
+        // The rings visited make a cube of buckets around the position, the cells left are out of it
+        double distance = std::numeric_limits<double>::max();
+        double width = FrontierIndex::kBucketWidth * index.resolution;
+        double tree_offset = (1 << (index.tree_depth - 1)) * index.resolution;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            double low = (center[axis] - ring + 1) * width - tree_offset;
+            double high = (center[axis] + ring) * width - tree_offset;
+            distance = std::min(distance, std::min(position[axis] - low, high - position[axis]));
+        }
+        return std::max(distance, 0.0);
+    }
+}
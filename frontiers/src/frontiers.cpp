@@ -1,6 +1,9 @@
 #include <frontiers.h>
 #include <neighbors.h>
 #include <ordered_neighbors.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 // #define SAVE_LOG 1
 // #define RUNNING_ROS 1
@@ -42,6 +45,17 @@ namespace Frontiers{
         }
     }
 
+    State getState(octomath::Vector3 const& grid_coordinates_toTest, octomap::OcTree const& octree, LazyThetaStarOctree::LeafCache & leaf_cache)
+    {
+        LazyThetaStarOctree::LeafLocation location;
+        if(!leaf_cache.locate(grid_coordinates_toTest, octree, location))
+        {
+            return unknown;
+        }
+        if (octree.isNodeOccupied(location.node)) return occupied;
+        else return free;
+    }
+
 
     void paintState(State state, octomath::Vector3 const& position, visualization_msgs::MarkerArray & marker_array, int id)
     {
@@ -85,6 +99,8 @@ namespace Frontiers{
         int frontiers_count = 0;
         visualization_msgs::MarkerArray marker_array;
         LazyThetaStarOctree::unordered_set_pointers analyzed;
+        // Neighbors of consecutive leafs fall in the same leafs
+        LazyThetaStarOctree::LeafCache leaf_cache;
 
         if(it == octree.end_leafs_bbx())
         {
@@ -108,30 +124,31 @@ namespace Frontiers{
             {
                 LazyThetaStarOctree::unordered_set_pointers neighbors;
                 LazyThetaStarOctree::generateNeighbors_frontiers_pointers(neighbors, grid_coordinates_curr, currentVoxel.size, resolution);
-                for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)
+                for(auto const& neighbor : neighbors)
                 {
-                    auto out = analyzed.insert(std::make_shared<octomath::Vector3> (n_coordinates->x(), n_coordinates->y(), n_coordinates->z() )   );
+                    octomath::Vector3 const& n_coordinates = neighbor.second;
+                    auto out = analyzed.insert(neighbor);
                     if(!out.second)
                     {
                         continue;
                     }
-                    if(!isInsideGeofence(*n_coordinates, request.min, request.max))
+                    if(!isInsideGeofence(n_coordinates, request.min, request.max))
                     {
                         // Octomap's bounding box is not accurate at all. The neighbors are outside the bounding box anyway, we just want to recover data from what is inside the bouding box. This is to enforce the geofence.
                         continue;
                     }   
-                    State n_state = getState(*n_coordinates, octree);
+                    State n_state = getState(n_coordinates, octree, leaf_cache);
                     if(n_state == unknown)
                     {
                         #ifdef RUNNING_ROS
-                            paintState(n_state, *n_coordinates, marker_array, n_id);
+                            paintState(n_state, n_coordinates, marker_array, n_id);
                         #endif
                         n_id++;
                         frontiers_msgs::VoxelMsg voxel_msg;
                         voxel_msg.size = currentVoxel.size;
-                        voxel_msg.xyz_m.x = n_coordinates->x();
-                        voxel_msg.xyz_m.y = n_coordinates->y();
-                        voxel_msg.xyz_m.z = n_coordinates->z();
+                        voxel_msg.xyz_m.x = n_coordinates.x();
+                        voxel_msg.xyz_m.y = n_coordinates.y();
+                        voxel_msg.xyz_m.z = n_coordinates.z();
                         #ifdef BASELINE 
                         allNeighbors.insert(voxel_msg);
                         #else
@@ -159,6 +176,250 @@ namespace Frontiers{
         #endif
     }
 
+    FrontierSearch::FrontierSearch()
+        : octree(NULL), summary(NULL), thread_count(1), merged_blocks(0), merged_in_block(0)
+    {}
+
+    bool FrontierSearch::start(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request, int thread_count,
+        SubtreeSummary const* summary/* = NULL*/)
+    {
+        this->octree = &octree;
+        this->request = request;
+        this->summary = summary;
+        this->thread_count = std::max(thread_count, 1);
+        blocks.clear();
+        merged_blocks = 0;
+        merged_in_block = 0;
+        merged.clear();
+        double resolution = octree.getResolution();
+        octomath::Vector3  max = octomath::Vector3(request.max.x-resolution, request.max.y-resolution, request.max.z-resolution);
+        octomath::Vector3  min = octomath::Vector3(request.min.x+resolution, request.min.y+resolution, request.min.z+resolution);
+        octomap::OcTreeKey bbxMaxKey;
+        if(!octree.coordToKeyChecked(min, box_min) || !octree.coordToKeyChecked(max, bbxMaxKey))
+        {
+            ROS_ERROR_STREAM("[Frontiers] Problems with the octree");
+            return false;
+        }
+        // Octree aligned blocks, halved until each thread has a few to take
+        int extent = 1;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            extent = std::max(extent, int(bbxMaxKey[axis]) - int(box_min[axis]) + 1);
+        }
+        int block_width = 1;
+        while(block_width < extent)
+        {
+            block_width <<= 1;
+        }
+        int blocks_per_axis [3];
+        while(true)
+        {
+            std::size_t block_count = 1;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                blocks_per_axis[axis] = bbxMaxKey[axis] / block_width - box_min[axis] / block_width + 1;
+                block_count *= blocks_per_axis[axis];
+            }
+            if(block_width == 1 || block_count >= std::size_t(4 * this->thread_count))
+            {
+                break;
+            }
+            block_width >>= 1;
+        }
+        // In scan order, x first
+        for (int z = 0; z < blocks_per_axis[2]; ++z)
+        {
+            for (int y = 0; y < blocks_per_axis[1]; ++y)
+            {
+                for (int x = 0; x < blocks_per_axis[0]; ++x)
+                {
+                    int index [3] = {x, y, z};
+                    Block block;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        int low = (box_min[axis] / block_width + index[axis]) * block_width;
+                        block.min[axis] = std::max(low, int(box_min[axis]));
+                        block.max[axis] = std::min(low + block_width - 1, int(bbxMaxKey[axis]));
+                    }
+                    block.done = false;
+                    blocks.push_back(block);
+                }
+            }
+        }
+        return true;
+    }
+
+    int FrontierSearch::findMore(int frontier_amount, std::vector<frontiers_msgs::VoxelMsg> & frontiers)
+    {
+        if(octree == NULL || frontier_amount <= 0 || finished())
+        {
+            return 0;
+        }
+        // The blocks left unscanned by the last call, or stopped halfway, in scan order
+        std::vector<std::size_t> pending;
+        for (std::size_t b = merged_blocks; b < blocks.size(); ++b)
+        {
+            if(!blocks[b].done)
+            {
+                pending.push_back(b);
+            }
+        }
+        // Blocks are merged in scan order as soon as all the ones before them are done. Once frontier_amount
+        // frontiers are merged the blocks after them cannot contribute to this call and the workers stop.
+        int appended = 0;
+        std::atomic<std::size_t> next_pending (0);
+        std::atomic<bool> cancelled (false);
+        std::mutex merge_mutex;
+        auto merge = [&]()
+        {
+            while(merged_blocks < blocks.size() && blocks[merged_blocks].done && appended < frontier_amount)
+            {
+                KeyedFrontiers const& found = blocks[merged_blocks].found;
+                for (; merged_in_block < found.size() && appended < frontier_amount; ++merged_in_block)
+                {
+                    if(merged.insert(found[merged_in_block].first).second)
+                    {
+                        frontiers.push_back(found[merged_in_block].second);
+                        ++appended;
+                    }
+                }
+                if(merged_in_block < found.size())
+                {
+                    break;
+                }
+                KeyedFrontiers().swap(blocks[merged_blocks].found);
+                merged_in_block = 0;
+                ++merged_blocks;
+            }
+            if(appended == frontier_amount)
+            {
+                cancelled = true;
+            }
+        };
+        {
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            merge();
+        }
+        auto work = [&]()
+        {
+            while(!cancelled)
+            {
+                std::size_t p = next_pending++;
+                if(p >= pending.size())
+                {
+                    return;
+                }
+                Block & block = blocks[pending[p]];
+                if(!scanBlock(block, cancelled))
+                {
+                    // Scanned again by the next call
+                    block.found.clear();
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(merge_mutex);
+                block.done = true;
+                merge();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < thread_count; ++i)
+        {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread & worker : workers)
+        {
+            worker.join();
+        }
+        return appended;
+    }
+
+    bool FrontierSearch::finished() const
+    {
+        return merged_blocks == blocks.size();
+    }
+
+    bool FrontierSearch::scanBlock(Block & block, std::atomic<bool> const& cancelled) const
+    {
+        double resolution = octree->getResolution();
+        unsigned int tree_depth = octree->getTreeDepth();
+        LazyThetaStarOctree::unordered_set_pointers analyzed;
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        std::vector<LazyThetaStarOctree::LeafLocation> leafs;
+        if(summary != NULL)
+        {
+            summary->findBoundaryLeafs(*octree, block.min, block.max, leafs);
+        }
+        else
+        {
+            for (octomap::OcTree::leaf_bbx_iterator it = octree->begin_leafs_bbx(block.min, block.max); it != octree->end_leafs_bbx(); ++it)
+            {
+                if(!octree->isNodeOccupied(*it))
+                {
+                    LazyThetaStarOctree::LeafLocation location;
+                    location.node = &(*it);
+                    location.voxel_id = LazyThetaStarOctree::VoxelId(it.getKey(), it.getDepth());
+                    location.depth = it.getDepth();
+                    location.center = it.getCoordinate();
+                    location.side_length = it.getSize();
+                    leafs.push_back(location);
+                }
+            }
+        }
+        for (LazyThetaStarOctree::LeafLocation const& leaf : leafs)
+        {
+            if(cancelled)
+            {
+                return false;
+            }
+            int width = 1 << (tree_depth - leaf.depth);
+            octomap::OcTreeKey leaf_key = leaf.voxel_id.key();
+            bool owned = true;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                int lowest = std::max(leaf_key[axis] & ~(width - 1), int(box_min[axis]));
+                owned = owned && lowest >= block.min[axis] && lowest <= block.max[axis];
+            }
+            if(!owned)
+            {
+                continue;
+            }
+            LazyThetaStarOctree::unordered_set_pointers neighbors;
+            LazyThetaStarOctree::generateNeighbors_frontiers_pointers(neighbors, leaf.center, leaf.side_length, resolution);
+            for(auto const& neighbor : neighbors)
+            {
+                octomath::Vector3 const& n_coordinates = neighbor.second;
+                if(!analyzed.insert(neighbor).second || !isInsideGeofence(n_coordinates, request.min, request.max))
+                {
+                    continue;
+                }
+                if(getState(n_coordinates, *octree, leaf_cache) == unknown)
+                {
+                    frontiers_msgs::VoxelMsg voxel_msg;
+                    voxel_msg.size = leaf.side_length;
+                    voxel_msg.xyz_m.x = n_coordinates.x();
+                    voxel_msg.xyz_m.y = n_coordinates.y();
+                    voxel_msg.xyz_m.z = n_coordinates.z();
+                    block.found.emplace_back(octree->coordToKey(n_coordinates), voxel_msg);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool searchFrontierParallel(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request const& request,
+        int frontier_amount, int thread_count, std::vector<frontiers_msgs::VoxelMsg> & frontiers, SubtreeSummary const* summary/* = NULL*/)
+    {
+        frontiers.clear();
+        FrontierSearch search;
+        if(!search.start(octree, request, thread_count, summary))
+        {
+            return false;
+        }
+        search.findMore(frontier_amount, frontiers);
+        return true;
+    }
+
     octomap::OcTree::leaf_bbx_iterator processFrontiersRequest(octomap::OcTree const& octree, frontiers_msgs::FindFrontiers::Request  &request,
         frontiers_msgs::FindFrontiers::Response &reply, ros::Publisher const& marker_pub, bool publish )
     {
@@ -214,33 +475,44 @@ namespace Frontiers{
     {
         double resolution = octree.getResolution(); 
         int tree_depth = octree.getTreeDepth(); 
-        octomap::OcTreeKey key = octree.coordToKey(candidate); 
-        int depth = LazyThetaStarOctree::getNodeDepth_Octomap(key, octree); 
-        octomath::Vector3 cell_center = octree.keyToCoord(key, depth); 
-        double voxel_size = ((tree_depth + 1) - depth) * resolution; 
+        // One descent gives the cell and its state
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        LazyThetaStarOctree::LeafLocation location;
+        if(!leaf_cache.locate(octree.coordToKey(candidate), octree, location))
+        {
+            return false;
+        }
+        octomath::Vector3 cell_center = location.center; 
+        double voxel_size = ((tree_depth + 1) - (int)location.depth) * resolution; 
 
         bool is_frontier = false;
-        if( isExplored(cell_center, octree)
-            && !isOccupied(cell_center, octree) ) 
+        if( !octree.isNodeOccupied(location.node) ) 
         {
             // Generate neighbors
             LazyThetaStarOctree::unordered_set_pointers neighbors;
             LazyThetaStarOctree::generateNeighbors_frontiers_pointers(neighbors, cell_center, voxel_size, resolution);
-            for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)
+            for(auto const& neighbor : neighbors)
             {
-                if(!isOccupied(*n_coordinates, octree))
+                octomath::Vector3 const& n_coordinates = neighbor.second;
+                if(getState(n_coordinates, octree, leaf_cache) == unknown)
                 {
-                    if(!isExplored(*n_coordinates, octree))
-                    {
-                        ROS_ERROR_STREAM("[isFrontier] Unknown neighbor is " << *n_coordinates);
-                        is_frontier = true;
-                    }
-                    else
-                    {
-                    }
+                    ROS_ERROR_STREAM("[isFrontier] Unknown neighbor is " << n_coordinates);
+                    is_frontier = true;
                 }
             }
         }
         return is_frontier;
     }
+
+    bool isFrontier(octomap::OcTree& octree, octomath::Vector3 const&  candidate, SubtreeSummary const& summary)
+    {
+        LazyThetaStarOctree::LeafLocation location;
+        octomap::OcTreeKey key;
+        if(octree.coordToKeyChecked(candidate, key) && LazyThetaStarOctree::locateLeaf(key, octree, location)
+            && location.depth > 0 && !summary.mayHaveBoundary(key, location.depth - 1))
+        {
+            return false;
+        }
+        return isFrontier(octree, candidate);
+    }
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <ros/ros.h>
 #include <frontiers.h>
+#include <frontier_index.h>
 #include <octomap/OcTree.h>
 #include <octomap_msgs/Octomap.h>
 #include <octomap_msgs/conversions.h>
@@ -9,6 +10,9 @@
 #include <visualization_msgs/MarkerArray.h>
 
 #include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
 
 #include <geometry_msgs/Point.h>
 #include <frontiers_common.h>
@@ -23,6 +27,9 @@ namespace frontiers_async_node
 {
 	octomap::OcTree* octree;
 	octomap::OcTree* octree_inUse;
+	// Numbers of the maps above, counting the maps received
+	uint64_t octree_sequence = 0;
+	uint64_t octree_inUse_sequence = 0;
 	std::atomic<bool> is_octree_inUse;
 	std::atomic<bool> new_octree;
 
@@ -30,7 +37,24 @@ namespace frontiers_async_node
 	ros::Publisher marker_pub;
 	std::string folder_name;
 	int last_request_id;
-	octomap::OcTree::leaf_bbx_iterator iterator;
+	// Follows octree_inUse when enabled, otherwise the frontiers are searched in the map at each request
+	bool use_frontier_index = true;
+	Frontiers::FrontierIndex frontier_index;
+	// With the index, the frontiers closest to the position of the new request are sent first, otherwise in key order
+	bool nearest_first = true;
+	// Frontiers of frontier_index nearest to the position of the last new request, continued requests take the next
+	// ones from it. Dropped before the index follows a new map.
+	std::unique_ptr<Frontiers::NearestFrontierQuery> nearest_query;
+	int search_threads = 1;
+	// Of octree_inUse, lets the frontier checks and searches skip the explored subtrees and the volume log add them up.
+	// Follows the maps through the changes the index found when there is one, rebuilt otherwise
+	bool use_subtree_summary = true;
+	Frontiers::SubtreeSummary subtree_summary;
+	// Without the index, the search of the last new request, continued requests take the next frontiers from it
+	Frontiers::FrontierSearch frontier_search;
+	// Frontiers of the last new request, the ones before next_frontier were already sent
+	std::vector<frontiers_msgs::VoxelMsg> pending_frontiers;
+	std::size_t next_frontier = 0;
 	#ifdef SAVE_CSV
 	struct sysinfo memInfo;
 	std::ofstream log;
@@ -72,7 +96,7 @@ namespace frontiers_async_node
 		octomath::Vector3 candidate(req.candidate.x, req.candidate.y, req.candidate.z);
 		try
 		{
-			res.is_frontier = Frontiers::isFrontier(*octree, candidate);
+			res.is_frontier = subtree_summary.builtFor(octree_sequence) ? Frontiers::isFrontier(*octree, candidate, subtree_summary) : Frontiers::isFrontier(*octree, candidate);
 			return true;
 		}
 		catch(const std::out_of_range& oor)
@@ -97,6 +121,49 @@ namespace frontiers_async_node
 		}
 	}
 
+	// Without the index, the frontiers of a new request come from a new search and a continued request takes the
+	// next ones from it
+	void searchPendingFrontiers(frontiers_msgs::FindFrontiers::Request const& req)
+	{
+		if(req.new_request)
+		{
+			frontier_search.start(*octree_inUse, req, search_threads, subtree_summary.builtFor(octree_inUse_sequence) ? &subtree_summary : NULL);
+		}
+		std::size_t wanted = next_frontier + req.frontier_amount;
+		if(wanted > pending_frontiers.size())
+		{
+			frontier_search.findMore(wanted - pending_frontiers.size(), pending_frontiers);
+		}
+	}
+
+	// A new request starts a query from its position, continued requests keep the distances to that position and
+	// only take the frontiers of their page from the query
+	void nearestPendingFrontiers(frontiers_msgs::FindFrontiers::Request const& req)
+	{
+		if(req.new_request || !nearest_query)
+		{
+			nearest_query.reset( new Frontiers::NearestFrontierQuery(frontier_index, octomath::Vector3(req.current_position.x, req.current_position.y, req.current_position.z)) );
+		}
+		std::size_t wanted = next_frontier + req.frontier_amount;
+		if(wanted > pending_frontiers.size())
+		{
+			frontier_index.findNearestFrontiers(*octree_inUse, req, *nearest_query, wanted - pending_frontiers.size(), pending_frontiers);
+		}
+	}
+
+	void sendPendingFrontiers(frontiers_msgs::FindFrontiers::Request const& req, frontiers_msgs::FindFrontiers::Response &reply)
+	{
+		int frontiers_count = 0;
+		while(next_frontier < pending_frontiers.size() && frontiers_count < req.frontier_amount)
+		{
+			reply.frontiers.push_back(pending_frontiers[next_frontier]);
+			++next_frontier;
+			++frontiers_count;
+		}
+		reply.frontiers_found = frontiers_count;
+		reply.success = frontiers_count > 0;
+	}
+
 	bool find_frontiers(frontiers_msgs::FindFrontiers::Request  &req,
 		frontiers_msgs::FindFrontiers::Response &reply)
 	{
@@ -108,12 +175,43 @@ namespace frontiers_async_node
 			if (req.new_request)
 			{
 				if (new_octree){
+					if(use_frontier_index)
+					{
+						nearest_query.reset();
+						// Only the leafs that changed since the map in use are looked at
+						frontier_index.update(octree_inUse, *octree);
+					}
 					delete octree_inUse;
 					is_octree_inUse = true;
 					octree_inUse = octree;
+					uint64_t previous_sequence = octree_inUse_sequence;
+					octree_inUse_sequence = octree_sequence;
 					new_octree = false;
+					if(use_subtree_summary && use_frontier_index)
+					{
+						subtree_summary.update(*octree_inUse, octree_inUse_sequence, previous_sequence, frontier_index.changedLeafs());
+					}
+					else if(use_subtree_summary)
+					{
+						subtree_summary.build(*octree_inUse, octree_inUse_sequence);
+					}
+				}
+				pending_frontiers.clear();
+				next_frontier = 0;
+				if(use_frontier_index && nearest_first)
+				{
+					nearestPendingFrontiers(req);
+				}
+				else if(use_frontier_index)
+				{
+					// All of the geofence at once, continued requests take the next ones from pending_frontiers
+					frontier_index.findFrontiers(*octree_inUse, req, std::numeric_limits<int>::max(), pending_frontiers);
+				}
+				else
+				{
+					searchPendingFrontiers(req);
 				}
-				iterator = Frontiers::processFrontiersRequest(*octree_inUse, req, reply, marker_pub);
+				sendPendingFrontiers(req, reply);
 				last_request_id = req.request_number;
 			}
 			else
@@ -128,7 +226,15 @@ namespace frontiers_async_node
 				else
 				{
 					// ROS_INFO_STREAM("[Frontiers] Old map");
-					Frontiers::searchFrontier(*octree_inUse, iterator, req, reply, marker_pub, true);
+					if(!use_frontier_index)
+					{
+						searchPendingFrontiers(req);
+					}
+					else if(nearest_first)
+					{
+						nearestPendingFrontiers(req);
+					}
+					sendPendingFrontiers(req, reply);
 				}
 			}
 
@@ -148,7 +254,7 @@ namespace frontiers_async_node
 			double resolution = octree->getResolution();
 	        octomath::Vector3  max = octomath::Vector3(req.max.x-resolution, req.max.y-resolution, req.max.z-resolution);
 	        octomath::Vector3  min = octomath::Vector3(req.min.x+resolution, req.min.y+resolution, req.min.z+resolution);
-			double explored_volume_meters = volume::calculateVolume(*octree, min, max);
+			double explored_volume_meters = subtree_summary.builtFor(octree_sequence) ? subtree_summary.exploredVolume(*octree, min, max) : volume::calculateVolume(*octree, min, max);
 			volume_explored << ellapsed_time_millis.count() / 1000  << ", " << explored_volume_meters << std::endl;
 			volume_explored.close();
 			#endif
@@ -175,6 +281,7 @@ namespace frontiers_async_node
 		is_octree_inUse = false;
 		new_octree = true;
 		octree = (octomap::OcTree*)octomap_msgs::binaryMsgToMap(*octomapBinary);
+		++octree_sequence;
 		octomap_init = true;
 	}
 }
@@ -195,6 +302,11 @@ int main(int argc, char **argv)
 
 	ros::init(argc, argv, "frontier_node_async");
 	ros::NodeHandle nh;
+	nh.getParam("frontiers/incremental_index", frontiers_async_node::use_frontier_index);
+	nh.getParam("frontiers/nearest_first", frontiers_async_node::nearest_first);
+	nh.getParam("frontiers/subtree_summary", frontiers_async_node::use_subtree_summary);
+	frontiers_async_node::search_threads = std::thread::hardware_concurrency();
+	nh.getParam("frontiers/search_threads", frontiers_async_node::search_threads);
 
 	ros::ServiceServer frontier_status_service = nh.advertiseService("frontier_status", frontiers_async_node::check_status);
 	ros::ServiceServer is_frontier_service     = nh.advertiseService("is_frontier",     frontiers_async_node::check_frontier);
@@ -1,31 +1,29 @@
 #include <neighbors.h>
 
 namespace LazyThetaStarOctree{
-	bool addIfUnique(unordered_set_pointers & neighbors, float x, float y, float z )
+	bool addIfUnique(unordered_set_pointers & neighbors, float x, float y, float z, float resolution )
 	{
         octomath::Vector3 toInsert (x, y, z);
-        addIfUnique (neighbors, toInsert);
+        return addIfUnique (neighbors, toInsert, resolution);
 	}
 
-    bool addIfUnique(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert )
+    bool addIfUnique(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert, float resolution )
     {
         // This is the creation point for neighbors
-        // Raw pointers were chosen because they go out of scope since (for the Lazy Theta Star)
-        // objects are produce inside finding neighbors methods and later processed in another method
-        std::shared_ptr<octomath::Vector3> toInsert_ptr = std::make_shared<octomath::Vector3> (toInsert);
-        if(!neighbors.insert(toInsert_ptr).second)
+        // Coordinates are stored by value inside the set, which is reused between expansions
+        if(!neighbors.emplace(voxelIdFromCoordinates(toInsert, resolution), toInsert).second)
         {
             ROS_ERROR_STREAM("Could not insert coordinates of neighbor, this should not happen - contact maintainer. @AddIfUnique"); 
+            return false;
         }
+        return true;
     }
 
-    bool addIfUniqueValue(unordered_set_pointers & neighbors, octomath::Vector3 & toInsert )
+    bool addIfUniqueValue(unordered_set_pointers & neighbors, VoxelId const& voxel_id, octomath::Vector3 & toInsert )
     {
         // This is the creation point for neighbors
-        // Raw pointers were chosen because they go out of scope since (for the Lazy Theta Star)
-        // objects are produce inside finding neighbors methods and later processed in another method
-        std::shared_ptr<octomath::Vector3> toInsert_ptr = std::make_shared<octomath::Vector3> (toInsert);
-        neighbors.insert(toInsert_ptr);
+        // Coordinates are stored by value inside the set, which is reused between expansions
+        return neighbors.emplace(voxel_id, toInsert).second;
     }
 
     void generateNeighbors_pointers(unordered_set_pointers & neighbors, 
@@ -62,16 +60,16 @@ namespace LazyThetaStarOctree{
             for(int j = 0; j < neighbor_sequence_cell_count; j++)
             {
                 // Left Right
-                addIfUnique(neighbors, left_x,                      y_start + (i * resolution),  z_start + (j * resolution));
-                addIfUnique(neighbors, right_x,                     y_start + (i * resolution),  z_start + (j * resolution));
+                addIfUnique(neighbors, left_x,                      y_start + (i * resolution),  z_start + (j * resolution), resolution);
+                addIfUnique(neighbors, right_x,                     y_start + (i * resolution),  z_start + (j * resolution), resolution);
 
                 // Front Back
-                addIfUnique(neighbors, x_start + (i * resolution),  front_y,                     z_start + (j * resolution));
-                addIfUnique(neighbors, x_start + (i * resolution),  back_y,                      z_start + (j * resolution));
+                addIfUnique(neighbors, x_start + (i * resolution),  front_y,                     z_start + (j * resolution), resolution);
+                addIfUnique(neighbors, x_start + (i * resolution),  back_y,                      z_start + (j * resolution), resolution);
 
                 // Up Down
-                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  up_z);
-                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  down_z);
+                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  up_z, resolution);
+                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  down_z, resolution);
 
                 // neighbor_count++;
             }
@@ -128,19 +126,19 @@ namespace LazyThetaStarOctree{
             for(int j = 0; j < neighbor_sequence_cell_count; j++)
             {
                 // Left Right
-                addIfUnique(neighbors, left_x,                      y_start + (i * resolution),  z_start + (j * resolution));
-                addIfUnique(neighbors, right_x,                     y_start + (i * resolution),  z_start + (j * resolution));
+                addIfUnique(neighbors, left_x,                      y_start + (i * resolution),  z_start + (j * resolution), resolution);
+                addIfUnique(neighbors, right_x,                     y_start + (i * resolution),  z_start + (j * resolution), resolution);
 
                 // Front Back
-                addIfUnique(neighbors, x_start + (i * resolution),  front_y,                     z_start + (j * resolution));
-                addIfUnique(neighbors, x_start + (i * resolution),  back_y,                      z_start + (j * resolution));
+                addIfUnique(neighbors, x_start + (i * resolution),  front_y,                     z_start + (j * resolution), resolution);
+                addIfUnique(neighbors, x_start + (i * resolution),  back_y,                      z_start + (j * resolution), resolution);
 
                 // No neighbors in blind spot
                 double n_x = x_start + (i * resolution);
                 double n_y = y_start + (j * resolution);
 
-                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  up_z);
-                // addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  down_z);
+                addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  up_z, resolution);
+                // addIfUnique(neighbors, x_start + (i * resolution),  y_start + (j * resolution),  down_z, resolution);
             }
         }
     }
@@ -148,18 +146,12 @@ namespace LazyThetaStarOctree{
     bool addSparseNeighbor(unordered_set_pointers & neighbors, double x, double y, double z, octomap::OcTree const& octree)
     {
         octomath::Vector3 toAdd (x, y, z);
-        auto res_node = octree.search(x, y, z);
-        if(res_node) // Non zero is true
+        LeafLocation location;
+        if(locateLeaf(toAdd, octree, location))
         {
-            try
-            {
-                toAdd = getCellCenter(toAdd, octree);
-            }
-            catch (const std::out_of_range& oor) {
-                ROS_ERROR_STREAM("addSparseNeighbor out_of_range");
-            }
-            addIfUniqueValue(neighbors, toAdd);
+            return addIfUniqueValue(neighbors, location.voxel_id, location.center);
         }
+        return false;
     }
 
 
@@ -208,81 +200,177 @@ namespace LazyThetaStarOctree{
         }
     }
 
-    
-    // Other way to find the depth based on the search code of the octree
-    int getNodeDepth_Octomap (const octomap::OcTreeKey& key, 
-    	octomap::OcTree const& octree)  
+    // Calls emit with each leaf under node that intersects the key box [low, high]. node covers the keys from node_low on, at node_depth.
+    template <typename Emit>
+    void visitLeafsInKeyBox(octomap::OcTree const& octree, octomap::OcTreeNode* node, unsigned int node_depth, 
+        unsigned int const node_low [3], unsigned int const low [3], unsigned int const high [3], Emit & emit)
+    {
+        if(!octree.nodeHasChildren(node))
+        {
+            octomap::OcTreeKey key (node_low[0], node_low[1], node_low[2]);
+            emit(VoxelId(key, node_depth), node);
+            return;
+        }
+        unsigned int child_width = 1 << (octree.getTreeDepth() - node_depth - 1);
+        for (unsigned int i = 0; i < 8; ++i)
+        {
+            unsigned int child_low [3];
+            bool intersects = true;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                // Same bit order as computeChildIdx
+                child_low[axis] = node_low[axis] + ( ((i >> axis) & 1) ? child_width : 0 );
+                intersects = intersects && child_low[axis] <= high[axis] && low[axis] < child_low[axis] + child_width;
+            }
+            if(intersects && octree.nodeChildExists(node, i))
+            {
+                visitLeafsInKeyBox(octree, static_cast<octomap::OcTreeNode*>( octree.getNodeChild(node, i) ), node_depth + 1, child_low, low, high, emit);
+            }
+        }
+    }
+
+    // Calls emit with each known leaf across the six faces of voxel_id. The layers outside different faces do not overlap, so no leaf comes twice.
+    template <typename Emit>
+    void visitFaceNeighbors(VoxelId const& voxel_id, octomap::OcTree const& octree, Emit & emit)
     {
-        int tree_depth = octree.getTreeDepth();
         octomap::OcTreeNode* root = octree.getRoot();
+        if(root == NULL)
+        {
+            return;
+        }
+        unsigned int const tree_depth = octree.getTreeDepth();
+        unsigned int const key_count = 1 << tree_depth;
+        unsigned int const width = 1 << (tree_depth - voxel_id.depth());
+        octomap::OcTreeKey center = voxel_id.key();
+        unsigned int voxel_low [3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            voxel_low[axis] = center[axis] & ~(width - 1);
+        }
+        unsigned int const root_low [3] = {0, 0, 0};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int side = 0; side < 2; ++side)
+            {
+                // The layer one key thick just outside the face
+                unsigned int low [3];
+                unsigned int high [3];
+                for (int other = 0; other < 3; ++other)
+                {
+                    low[other] = voxel_low[other];
+                    high[other] = voxel_low[other] + width - 1;
+                }
+                if(side == 0)
+                {
+                    if(voxel_low[axis] == 0)
+                    {
+                        continue;
+                    }
+                    low[axis] = high[axis] = voxel_low[axis] - 1;
+                }
+                else
+                {
+                    if(voxel_low[axis] + width >= key_count)
+                    {
+                        continue;
+                    }
+                    low[axis] = high[axis] = voxel_low[axis] + width;
+                }
+                visitLeafsInKeyBox(octree, root, 0, root_low, low, high, emit);
+            }
+        }
+    }
 
+    void generateFaceNeighbors(std::vector<FaceNeighbor> & neighbors, VoxelId const& voxel_id, octomap::OcTree const& octree)
+    {
+        neighbors.clear();
+        auto emit = [&](VoxelId const& leaf_id, octomap::OcTreeNode const* node)
+        {
+            FaceNeighbor neighbor;
+            neighbor.voxel_id = leaf_id;
+            neighbor.key = leaf_id.key();
+            neighbor.depth = leaf_id.depth();
+            neighbor.size = octree.getNodeSize(neighbor.depth);
+            neighbor.node = node;
+            neighbors.push_back(neighbor);
+        };
+        visitFaceNeighbors(voxel_id, octree, emit);
+    }
 
-        if (root == NULL)
-            return -1;
-        int depth = tree_depth;
-        int depth_tracking = depth;
+    void generateNeighbors_keys(unordered_set_pointers & neighbors, VoxelId const& voxel_id, octomap::OcTree const& octree)
+    {
+        auto emit = [&](VoxelId const& leaf_id, octomap::OcTreeNode const* node)
+        {
+            neighbors.emplace(leaf_id, octree.keyToCoord(leaf_id.key(), leaf_id.depth()));
+        };
+        visitFaceNeighbors(voxel_id, octree, emit);
+    }
 
-        // generate appropriate key_at_depth for queried depth
-         octomap::OcTreeKey key_at_depth = key;
-        if (depth != tree_depth)
-            key_at_depth = octree.adjustKeyAtDepth(key, depth);
-        //ROS_WARN_STREAM("Depth "<<depth_tracking);
+    
+    bool locateLeaf(octomap::OcTreeKey const& key, octomap::OcTree const& octree, LeafLocation & location)
+    {
+        octomap::OcTreeNode* node = octree.getRoot();
+        if(node == NULL)
+        {
+            return false;
+        }
+        unsigned int tree_depth = octree.getTreeDepth();
+        unsigned int depth = 0;
+        while(octree.nodeHasChildren(node))
+        {
+            unsigned int pos = computeChildIdx(key, tree_depth - 1 - depth);
+            if(!octree.nodeChildExists(node, pos))
+            {
+                // Unknown space inside a node that has other children
+                return false;
+            }
+            node = static_cast<octomap::OcTreeNode*>( octree.getNodeChild(node, pos) );
+            ++depth;
+        }
+        location.node = node;
+        location.voxel_id = VoxelId(key, depth);
+        location.depth = depth;
+        location.center = octree.keyToCoord(key, depth);
+        location.side_length = octree.getNodeSize(depth);
+        return true;
+    }
 
-        octomap::OcTreeNode* curNode (root);
+    bool locateLeaf(octomath::Vector3 const& coordinates, octomap::OcTree const& octree, LeafLocation & location)
+    {
+        octomap::OcTreeKey key;
+        if(!octree.coordToKeyChecked(coordinates, key))
+        {
+            return false;
+        }
+        return locateLeaf(key, octree, location);
+    }
 
-        unsigned int diff = tree_depth - depth;
+    // locateLeaf for the callers that expect key to be known, throws out_of_range otherwise
+    LeafLocation locateKnownLeaf(octomap::OcTreeKey const& key, octomap::OcTree const& octree, char const* caller)
+    {
+        LeafLocation location;
+        if(!locateLeaf(key, octree, location))
+        {
+            std::ostringstream oss;
+            oss << "Failed to find depth, for key " << key[0] << " " << key[1] << " " << key[2] << " in unknown space, tree depth is " << octree.getTreeDepth() << ". @" << caller;  
+            throw std::out_of_range(oss.str());
+        }
+        return location;
+    }
 
-        // follow nodes down to requested level (for diff = 0 it's the last level)
-        for (unsigned i=(tree_depth-1); i>=diff; --i) {
-            unsigned int pos = computeChildIdx(key_at_depth, i);
-            if (octree.nodeChildExists(curNode, pos)) 
-            {
-                // cast needed: (nodes need to ensure it's the right pointer)
-                curNode = static_cast<octomap::OcTreeNode*>( octree.getNodeChild(curNode, pos) );
-                depth_tracking--;
-                //ROS_WARN_STREAM("Depth "<<depth_tracking);
-            } 
-            else 
-            {
-                // we expected a child but did not get it
-                // is the current node a leaf already?
-                if (! octree.nodeHasChildren(curNode) ) 
-                {
-                    //ROS_WARN_STREAM("Final depth "<<depth_tracking);
-                    return 16-depth_tracking;
-                } 
-                else 
-                {
-                    // it is not, search failed
-                    ROS_WARN_STREAM("Failed to find depth ");
-                    std::ostringstream oss_filename;
-
-                    std::stringstream aux_envvar_home (std::getenv("HOME"));
-                    std::string folder_name = aux_envvar_home.str() + "/Flying_Octomap_code/src/data";
-                    oss_filename << folder_name << "/current/failed_to_find_depth__getNodeDepth_Octomap__" 
-                        << key[0] << "_" << key[1] << "_" << key[2] << ".bt";
-                    octree.writeBinaryConst(oss_filename.str());
-		            std::ostringstream oss;
-                    oss << "Failed to find depth, for key " << key[0] << " " << key[1] << " " << key[2] << " stopped at " << depth << ", tree depth is " << octree.getTreeDepth() << ". @getNodeDepth_Octomap";  
-                    throw std::out_of_range(oss.str());
-                    return -2;
-                }
-            }
-        } // end for
-        		  //ROS_WARN_STREAM("Final depth 2 "<<depth_tracking);
-        return 16-depth_tracking;
+    // Other way to find the depth based on the search code of the octree
+    int getNodeDepth_Octomap (const octomap::OcTreeKey& key, 
+    	octomap::OcTree const& octree)  
+    {
+        if (octree.getRoot() == NULL)
+            return -1;
+        return locateKnownLeaf(key, octree, "getNodeDepth_Octomap").depth;
     }
 
 	octomath::Vector3 getCellCenter(octomath::Vector3 const& point_coordinates, octomap::OcTree const& octree)
 	{
-		// convert to key
-		octomap::OcTreeKey key = octree.coordToKey(point_coordinates);
-		// find depth of cell
-        // ROS_WARN_STREAM("Calling getNodeDepth from 141 for point coordinates " << point_coordinates);
-
-        double depth = getNodeDepth_Octomap(key, octree);  
 		// get center coord of cell center at depth
-		return octree.keyToCoord(key, depth);
+		return locateKnownLeaf(octree.coordToKey(point_coordinates), octree, "getCellCenter").center;
 	}
 
     double findSideLenght(int octreeLevelCount, const int depth, double const* lookup_table)
@@ -312,15 +400,10 @@ namespace LazyThetaStarOctree{
     {
         // convert to key
         octomap::OcTreeKey key = octree.coordToKey(*coordinates);
-        // find depth of cell
-        // ROS_WARN_STREAM("Calling getNodeDepth from 173");
-
-        int depth = getNodeDepth_Octomap(key, octree);
-        side_length = findSideLenght(octree.getTreeDepth(), depth, lookup_table);
-        // get center coord of cell center at depth
-        // std::cout << std::setprecision(10) << "Depth method: " << depth << std::endl;
-        octomath::Vector3 cell_center = octree.keyToCoord(key, depth);
-        coordinates = std::make_shared<octomath::Vector3> (octomath::Vector3 (cell_center.x(), cell_center.y(), cell_center.z()));
+        // find the cell in one descent
+        LeafLocation location = locateKnownLeaf(key, octree, "updatePointerToCellCenterAndFindSize");
+        side_length = findSideLenght(octree.getTreeDepth(), location.depth, lookup_table);
+        coordinates = std::make_shared<octomath::Vector3> (location.center);
         return key;
     }
 
@@ -332,19 +415,17 @@ namespace LazyThetaStarOctree{
      * @param      octree       The octree
      * @param      cell_size    Variable to store the cell size
      *
-     * @return     true if the coordinates correspond to the cell center, false otherise
+     * @return     the id of the cell
      */
-    void updateToCellCenterAndFindSize(octomath::Vector3 & coordinates, octomap::OcTree const& octree, double& side_length, double const* lookup_table)
+    VoxelId updateToCellCenterAndFindSize(octomath::Vector3 & coordinates, octomap::OcTree const& octree, double& side_length, double const* lookup_table)
     {
         // convert to key
         octomap::OcTreeKey key = octree.coordToKey(coordinates);
-        // ROS_WARN_STREAM("Calling getNodeDepth from 199 with key " << key[0] << " " << key[1] << " " << key[2]);
-        // find depth of cell
-        double depth = getNodeDepth_Octomap(key, octree);
-        side_length = findSideLenght(octree.getTreeDepth(), depth, lookup_table);
-        // get center coord of cell center at depth
-        octomath::Vector3 cell_center = octree.keyToCoord(key, depth);
-        coordinates = cell_center;
+        // find the cell in one descent
+        LeafLocation location = locateKnownLeaf(key, octree, "updateToCellCenterAndFindSize");
+        side_length = findSideLenght(octree.getTreeDepth(), location.depth, lookup_table);
+        coordinates = location.center;
+        return location.voxel_id;
     }
 
     void fillLookupTable(double resolution, int tree_depth, double lookup_table_ptr[])
@@ -0,0 +1,320 @@
+#include <subtree_summary.h>
+#include <algorithm>
+
+namespace Frontiers{
+
+    namespace
+    {
+        // Length of the overlap of [low, high] and [min, max]
+        double overlap(double low, double high, double min, double max)
+        {
+            return std::max(0.0, std::min(high, max) - std::max(low, min));
+        }
+    }
+
+    SubtreeSummary::SubtreeSummary()
+        : built(false), map_sequence(0)
+    {}
+
+    std::size_t SubtreeSummary::build(octomap::OcTree const& octree, uint64_t map_sequence)
+    {
+        clear();
+        built = true;
+        this->map_sequence = map_sequence;
+        if(octree.getRoot() == NULL)
+        {
+            return 0;
+        }
+        LazyThetaStarOctree::LeafCache leaf_cache;
+        summarize(octree, octree.getRoot(), octomap::OcTreeKey(0, 0, 0), 0, leaf_cache);
+        return summaries.size();
+    }
+
+    std::size_t SubtreeSummary::update(octomap::OcTree const& octree, uint64_t map_sequence, uint64_t previous_sequence,
+        std::vector<FrontierIndex::ChangedLeaf> const& changed)
+    {
+        if(!builtFor(previous_sequence))
+        {
+            return build(octree, map_sequence);
+        }
+        this->map_sequence = map_sequence;
+        if(octree.getRoot() == NULL)
+        {
+            summaries.clear();
+            return 0;
+        }
+        // A leaf sees the voxels across its faces, so the leafs one voxel away from a change can change too
+        std::vector<KeyBox> dirty;
+        for (FrontierIndex::ChangedLeaf const& leaf : changed)
+        {
+            KeyBox box;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                box.low[axis] = leaf.low[axis] - 1;
+                box.high[axis] = leaf.low[axis] + leaf.width;
+            }
+            dirty.push_back(box);
+        }
+        std::size_t resummarized = 0;
+        if(!dirty.empty())
+        {
+            LazyThetaStarOctree::LeafCache leaf_cache;
+            resummarize(octree, octree.getRoot(), octomap::OcTreeKey(0, 0, 0), 0, dirty, leaf_cache, resummarized);
+        }
+        return resummarized;
+    }
+
+    bool SubtreeSummary::builtFor(uint64_t map_sequence) const
+    {
+        return built && this->map_sequence == map_sequence;
+    }
+
+    SubtreeSummary::Summary SubtreeSummary::summarize(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low,
+        unsigned int depth, LazyThetaStarOctree::LeafCache & leaf_cache)
+    {
+        if(!octree.nodeHasChildren(node))
+        {
+            return leafSummary(octree, node, low, depth, leaf_cache);
+        }
+        Summary summary;
+        unsigned int tree_depth = octree.getTreeDepth();
+        summary.boundary = false;
+        summary.explored_volume = 0;
+        for (unsigned int child = 0; child < 8; ++child)
+        {
+            if(!octree.nodeChildExists(node, child))
+            {
+                continue;
+            }
+            Summary child_summary = summarize(octree, octree.getNodeChild(node, child), childLow(low, depth, tree_depth, child), depth + 1, leaf_cache);
+            summary.boundary = summary.boundary || child_summary.boundary;
+            summary.explored_volume += child_summary.explored_volume;
+        }
+        summaries[LazyThetaStarOctree::VoxelId(low, depth).packed] = summary;
+        return summary;
+    }
+
+    SubtreeSummary::Summary SubtreeSummary::resummarize(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low,
+        unsigned int depth, std::vector<KeyBox> const& dirty, LazyThetaStarOctree::LeafCache & leaf_cache, std::size_t & resummarized)
+    {
+        unsigned int tree_depth = octree.getTreeDepth();
+        int width = 1 << (tree_depth - depth);
+        std::vector<KeyBox> overlapping;
+        for (KeyBox const& box : dirty)
+        {
+            bool overlaps = true;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                overlaps = overlaps && box.low[axis] <= low[axis] + width - 1 && box.high[axis] >= low[axis];
+            }
+            if(overlaps)
+            {
+                overlapping.push_back(box);
+            }
+        }
+        uint64_t id = LazyThetaStarOctree::VoxelId(low, depth).packed;
+        if(!octree.nodeHasChildren(node))
+        {
+            // Was maybe an inner node of the previous map
+            summaries.erase(id);
+            return leafSummary(octree, node, low, depth, leaf_cache);
+        }
+        if(overlapping.empty())
+        {
+            std::unordered_map<uint64_t, Summary>::const_iterator kept = summaries.find(id);
+            if(kept != summaries.end())
+            {
+                return kept->second;
+            }
+            // A leaf of the previous map split without changing state
+            return summarize(octree, node, low, depth, leaf_cache);
+        }
+        Summary summary;
+        summary.boundary = false;
+        summary.explored_volume = 0;
+        for (unsigned int child = 0; child < 8; ++child)
+        {
+            if(!octree.nodeChildExists(node, child))
+            {
+                continue;
+            }
+            Summary child_summary = resummarize(octree, octree.getNodeChild(node, child), childLow(low, depth, tree_depth, child), depth + 1, overlapping, leaf_cache, resummarized);
+            summary.boundary = summary.boundary || child_summary.boundary;
+            summary.explored_volume += child_summary.explored_volume;
+        }
+        summaries[id] = summary;
+        ++resummarized;
+        return summary;
+    }
+
+    SubtreeSummary::Summary SubtreeSummary::leafSummary(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low,
+        unsigned int depth, LazyThetaStarOctree::LeafCache & leaf_cache) const
+    {
+        Summary summary;
+        double side = octree.getNodeSize(depth);
+        summary.explored_volume = side * side * side;
+        summary.boundary = !octree.isNodeOccupied(node) && touchesUnknown(octree, low, 1 << (octree.getTreeDepth() - depth), leaf_cache);
+        return summary;
+    }
+
+    bool SubtreeSummary::touchesUnknown(octomap::OcTree const& octree, octomap::OcTreeKey const& low, int width, LazyThetaStarOctree::LeafCache & leaf_cache) const
+    {
+        int max_key = (1 << octree.getTreeDepth()) - 1;
+        LazyThetaStarOctree::LeafLocation location;
+        // Sides and above, the face below is the blind spot
+        int const faces [5][2] = { {0, -1}, {0, width}, {1, -1}, {1, width}, {2, width} };
+        for (int f = 0; f < 5; ++f)
+        {
+            int axis = faces[f][0];
+            int layer = low[axis] + faces[f][1];
+            if(layer < 0 || layer > max_key)
+            {
+                return true;
+            }
+            int a = (axis + 1) % 3;
+            int b = (axis + 2) % 3;
+            octomap::OcTreeKey key;
+            key[axis] = layer;
+            for (int row = low[a]; row < low[a] + width; ++row)
+            {
+                key[a] = row;
+                for (int column = low[b]; column < low[b] + width; ++column)
+                {
+                    key[b] = column;
+                    if(!leaf_cache.locate(key, octree, location))
+                    {
+                        return true;
+                    }
+                    // The rest of the row inside this leaf is known too
+                    int leaf_width = 1 << (octree.getTreeDepth() - location.depth);
+                    column = column | (leaf_width - 1);
+                }
+            }
+        }
+        return false;
+    }
+
+    bool SubtreeSummary::mayHaveBoundary(octomap::OcTreeKey const& key, unsigned int depth) const
+    {
+        std::unordered_map<uint64_t, Summary>::const_iterator summary = summaries.find(LazyThetaStarOctree::VoxelId(key, depth).packed);
+        return summary == summaries.end() || summary->second.boundary;
+    }
+
+    void SubtreeSummary::findBoundaryLeafs(octomap::OcTree const& octree, octomap::OcTreeKey const& min, octomap::OcTreeKey const& max,
+        std::vector<LazyThetaStarOctree::LeafLocation> & leafs) const
+    {
+        if(octree.getRoot() != NULL)
+        {
+            collectBoundaryLeafs(octree, octree.getRoot(), octomap::OcTreeKey(0, 0, 0), 0, min, max, leafs);
+        }
+    }
+
+    void SubtreeSummary::collectBoundaryLeafs(octomap::OcTree const& octree, octomap::OcTreeNode* node, octomap::OcTreeKey const& low, unsigned int depth,
+        octomap::OcTreeKey const& min, octomap::OcTreeKey const& max, std::vector<LazyThetaStarOctree::LeafLocation> & leafs) const
+    {
+        unsigned int tree_depth = octree.getTreeDepth();
+        int width = 1 << (tree_depth - depth);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if(low[axis] + width - 1 < min[axis] || low[axis] > max[axis])
+            {
+                return;
+            }
+        }
+        if(!octree.nodeHasChildren(node))
+        {
+            if(!octree.isNodeOccupied(node))
+            {
+                LazyThetaStarOctree::LeafLocation location;
+                location.node = node;
+                location.voxel_id = LazyThetaStarOctree::VoxelId(low, depth);
+                location.depth = depth;
+                location.center = octree.keyToCoord(low, depth);
+                location.side_length = octree.getNodeSize(depth);
+                leafs.push_back(location);
+            }
+            return;
+        }
+        if(!mayHaveBoundary(low, depth))
+        {
+            return;
+        }
+        for (unsigned int child = 0; child < 8; ++child)
+        {
+            if(octree.nodeChildExists(node, child))
+            {
+                collectBoundaryLeafs(octree, octree.getNodeChild(node, child), childLow(low, depth, tree_depth, child), depth + 1, min, max, leafs);
+            }
+        }
+    }
+
+    double SubtreeSummary::exploredVolume(octomap::OcTree const& octree, octomath::Vector3 const& min, octomath::Vector3 const& max) const
+    {
+        if(octree.getRoot() == NULL)
+        {
+            return 0;
+        }
+        return exploredVolume(octree, octree.getRoot(), octomap::OcTreeKey(0, 0, 0), 0, min, max);
+    }
+
+    double SubtreeSummary::exploredVolume(octomap::OcTree const& octree, octomap::OcTreeNode const* node, octomap::OcTreeKey const& low, unsigned int depth,
+        octomath::Vector3 const& min, octomath::Vector3 const& max) const
+    {
+        double side = octree.getNodeSize(depth);
+        double tree_offset = (1 << (octree.getTreeDepth() - 1)) * octree.getResolution();
+        double volume = 1;
+        bool inside = true;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            double cube_low = low[axis] * octree.getResolution() - tree_offset;
+            double length = overlap(cube_low, cube_low + side, min(axis), max(axis));
+            if(length == 0)
+            {
+                return 0;
+            }
+            volume *= length;
+            inside = inside && cube_low >= min(axis) && cube_low + side <= max(axis);
+        }
+        if(!octree.nodeHasChildren(node))
+        {
+            return volume;
+        }
+        if(inside)
+        {
+            std::unordered_map<uint64_t, Summary>::const_iterator summary = summaries.find(LazyThetaStarOctree::VoxelId(low, depth).packed);
+            if(summary != summaries.end())
+            {
+                return summary->second.explored_volume;
+            }
+        }
+        volume = 0;
+        unsigned int tree_depth = octree.getTreeDepth();
+        for (unsigned int child = 0; child < 8; ++child)
+        {
+            if(octree.nodeChildExists(node, child))
+            {
+                volume += exploredVolume(octree, octree.getNodeChild(node, child), childLow(low, depth, tree_depth, child), depth + 1, min, max);
+            }
+        }
+        return volume;
+    }
+
+    octomap::OcTreeKey SubtreeSummary::childLow(octomap::OcTreeKey const& low, unsigned int depth, unsigned int tree_depth, unsigned int child)
+    {
+        int half = 1 << (tree_depth - depth - 1);
+        // Same child order as octomap::computeChildIdx
+        return octomap::OcTreeKey(low[0] + ((child & 1) ? half : 0), low[1] + ((child & 2) ? half : 0), low[2] + ((child & 4) ? half : 0));
+    }
+
+    std::size_t SubtreeSummary::size() const
+    {
+        return summaries.size();
+    }
+
+    void SubtreeSummary::clear()
+    {
+        summaries.clear();
+        built = false;
+        map_sequence = 0;
+    }
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <frontiers.h>
+#include <frontier_index.h>
 #include <neighbors.h>
+#include <limits>
 
 namespace Frontiers
 {
@@ -115,6 +117,303 @@ namespace Frontiers
 		ASSERT_TRUE(   isFrontier( octree, octomath::Vector3 (0, 1, 1.85) )   );
 		ASSERT_FALSE(   isFrontier( octree, octomath::Vector3 (1.50, 0.5, 0))   );
 	}
+
+	// Keys of every unknown neighbor of a free leaf, as searchFrontier finds them
+	void scanFrontierCells(octomap::OcTree const& octree, std::vector<octomap::OcTreeKey> & cells)
+	{
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			if(octree.isNodeOccupied(*it))
+			{
+				continue;
+			}
+			LazyThetaStarOctree::unordered_set_pointers neighbors;
+			LazyThetaStarOctree::generateNeighbors_frontiers_pointers(neighbors, it.getCoordinate(), it.getSize(), octree.getResolution());
+			for(auto const& neighbor : neighbors)
+			{
+				if(octree.search(neighbor.second) == NULL)
+				{
+					cells.push_back(octree.coordToKey(neighbor.second));
+				}
+			}
+		}
+	}
+
+	TEST(FrontiersTest, FrontierIndex_SameAsScan)
+	{
+		octomap::OcTree octree ("data/experimentalDataset.bt");
+		FrontierIndex index;
+		index.update(NULL, octree);
+		std::vector<octomap::OcTreeKey> scanned;
+		scanFrontierCells(octree, scanned);
+		ASSERT_GT(index.size(), 0);
+		// The same cells, neighboring leafs can report a cell more than once
+		std::unordered_set<octomap::OcTreeKey, octomap::OcTreeKey::KeyHash> scanned_cells (scanned.begin(), scanned.end());
+		ASSERT_EQ(scanned_cells.size(), index.size());
+		for (octomap::OcTreeKey const& key : scanned_cells)
+		{
+			ASSERT_TRUE(index.contains(key));
+		}
+
+		// Following a changed map gives the index of the new map
+		octomap::OcTree changed (octree);
+		changed.setNodeValue(octomath::Vector3(0, 1, 1.85), changed.getClampingThresMinLog());
+		changed.setNodeValue(octomath::Vector3(1.5, 0.5, 0), changed.getClampingThresMaxLog());
+		ASSERT_GT(index.update(&octree, changed), 0);
+		FrontierIndex rebuilt;
+		rebuilt.update(NULL, changed);
+		ASSERT_EQ(rebuilt.size(), index.size());
+		std::vector<octomap::OcTreeKey> rescanned;
+		scanFrontierCells(changed, rescanned);
+		std::unordered_set<octomap::OcTreeKey, octomap::OcTreeKey::KeyHash> rescanned_cells (rescanned.begin(), rescanned.end());
+		ASSERT_EQ(rescanned_cells.size(), index.size());
+		for (octomap::OcTreeKey const& key : rescanned_cells)
+		{
+			ASSERT_TRUE(index.contains(key));
+		}
+		ASSERT_FALSE(index.contains(changed.coordToKey(octomath::Vector3(0, 1, 1.85))));
+		// Nothing changes with the same map
+		ASSERT_EQ(0, index.update(&changed, changed));
+		// The buckets skipped around a small geofence hold none of its frontiers
+		frontiers_msgs::FindFrontiers::Request request;
+		request.min.x = -1;
+		request.min.y = -1;
+		request.min.z = -1;
+		request.max.x = 1;
+		request.max.y = 1;
+		request.max.z = 2;
+		std::vector<frontiers_msgs::VoxelMsg> inside;
+		index.findFrontiers(changed, request, std::numeric_limits<int>::max(), inside);
+		std::size_t expected = 0;
+		for (octomap::OcTreeKey const& key : rescanned_cells)
+		{
+			if(isInsideGeofence(changed.keyToCoord(key), request.min, request.max))
+			{
+				++expected;
+			}
+		}
+		ASSERT_GT(expected, 0);
+		ASSERT_EQ(expected, inside.size());
+		// In key order whatever the history of the index, and asking for fewer gives the first ones
+		std::vector<frontiers_msgs::VoxelMsg> from_rebuilt;
+		rebuilt.findFrontiers(changed, request, std::numeric_limits<int>::max(), from_rebuilt);
+		ASSERT_EQ(inside.size(), from_rebuilt.size());
+		for (std::size_t i = 0; i < inside.size(); ++i)
+		{
+			ASSERT_EQ(inside[i].xyz_m.x, from_rebuilt[i].xyz_m.x);
+			ASSERT_EQ(inside[i].xyz_m.y, from_rebuilt[i].xyz_m.y);
+			ASSERT_EQ(inside[i].xyz_m.z, from_rebuilt[i].xyz_m.z);
+		}
+		for (std::size_t i = 1; i < inside.size(); ++i)
+		{
+			octomap::OcTreeKey previous = changed.coordToKey(octomath::Vector3(inside[i-1].xyz_m.x, inside[i-1].xyz_m.y, inside[i-1].xyz_m.z));
+			octomap::OcTreeKey current = changed.coordToKey(octomath::Vector3(inside[i].xyz_m.x, inside[i].xyz_m.y, inside[i].xyz_m.z));
+			octomap::OcTreeKey previous_bucket (previous[0] >> 3, previous[1] >> 3, previous[2] >> 3);
+			octomap::OcTreeKey current_bucket (current[0] >> 3, current[1] >> 3, current[2] >> 3);
+			bool bucket_order = previous_bucket[2] != current_bucket[2] ? previous_bucket[2] < current_bucket[2] :
+				(previous_bucket[1] != current_bucket[1] ? previous_bucket[1] < current_bucket[1] : previous_bucket[0] <= current_bucket[0]);
+			ASSERT_TRUE(bucket_order);
+		}
+		ASSERT_GE(inside.size(), 3);
+		std::vector<frontiers_msgs::VoxelMsg> first;
+		index.findFrontiers(changed, request, 3, first);
+		ASSERT_EQ(3, first.size());
+		ASSERT_EQ(inside[2].xyz_m.x, first[2].xyz_m.x);
+		ASSERT_EQ(inside[2].xyz_m.y, first[2].xyz_m.y);
+		ASSERT_EQ(inside[2].xyz_m.z, first[2].xyz_m.z);
+	}
+
+	TEST(FrontiersTest, FrontierIndex_NearestFirst)
+	{
+		octomap::OcTree octree ("data/experimentalDataset.bt");
+		FrontierIndex index;
+		index.update(NULL, octree);
+		frontiers_msgs::FindFrontiers find_frontiers_msg;
+		find_frontiers_msg.request.min.x = -100;
+		find_frontiers_msg.request.min.y = -100;
+		find_frontiers_msg.request.min.z = -100;
+		find_frontiers_msg.request.max.x = 100;
+		find_frontiers_msg.request.max.y = 100;
+		find_frontiers_msg.request.max.z = 100;
+		find_frontiers_msg.request.current_position.x = 1;
+		find_frontiers_msg.request.current_position.y = 1;
+		find_frontiers_msg.request.current_position.z = 1;
+		octomath::Vector3 position (1, 1, 1);
+		std::vector<frontiers_msgs::VoxelMsg> all;
+		index.findFrontiers(octree, find_frontiers_msg.request, std::numeric_limits<int>::max(), all);
+		std::vector<double> distances;
+		for (frontiers_msgs::VoxelMsg const& frontier : all)
+		{
+			distances.push_back(position.distance(octomath::Vector3(frontier.xyz_m.x, frontier.xyz_m.y, frontier.xyz_m.z)));
+		}
+		std::sort(distances.begin(), distances.end());
+		ASSERT_GE(distances.size(), 20);
+
+		std::vector<frontiers_msgs::VoxelMsg> nearest;
+		index.findNearestFrontiers(octree, find_frontiers_msg.request, 20, nearest);
+		ASSERT_EQ(20, nearest.size());
+		for (std::size_t i = 0; i < nearest.size(); ++i)
+		{
+			double distance = position.distance(octomath::Vector3(nearest[i].xyz_m.x, nearest[i].xyz_m.y, nearest[i].xyz_m.z));
+			ASSERT_NEAR(distances[i], distance, 0.0001);
+		}
+		// Continuing one query page by page gives the same frontiers
+		NearestFrontierQuery query (index, position);
+		std::vector<frontiers_msgs::VoxelMsg> pages;
+		while(pages.size() < nearest.size())
+		{
+			index.findNearestFrontiers(octree, find_frontiers_msg.request, query, std::min<int>(7, nearest.size() - pages.size()), pages);
+		}
+		ASSERT_EQ(nearest.size(), pages.size());
+		for (std::size_t i = 0; i < nearest.size(); ++i)
+		{
+			ASSERT_EQ(nearest[i].xyz_m.x, pages[i].xyz_m.x);
+			ASSERT_EQ(nearest[i].xyz_m.y, pages[i].xyz_m.y);
+			ASSERT_EQ(nearest[i].xyz_m.z, pages[i].xyz_m.z);
+		}
+
+		// Radius query, closest first
+		std::vector<octomap::OcTreeKey> within;
+		index.findFrontiersWithin(position, 1.0, within);
+		std::size_t expected = std::upper_bound(distances.begin(), distances.end(), 1.0) - distances.begin();
+		ASSERT_EQ(expected, within.size());
+		for (std::size_t i = 1; i < within.size(); ++i)
+		{
+			ASSERT_LE(position.distance(octree.keyToCoord(within[i-1])), position.distance(octree.keyToCoord(within[i])) + 0.0001);
+		}
+	}
+
+	TEST(FrontiersTest, SearchFrontierParallel_SameForAnyThreads)
+	{
+		octomap::OcTree octree ("data/experimentalDataset.bt");
+		frontiers_msgs::FindFrontiers find_frontiers_msg;
+		find_frontiers_msg.request.min.x = 0;
+		find_frontiers_msg.request.min.y = 0;
+		find_frontiers_msg.request.min.z = 0;
+		find_frontiers_msg.request.max.x = 6;
+		find_frontiers_msg.request.max.y = 2;
+		find_frontiers_msg.request.max.z = 2;
+		find_frontiers_msg.request.frontier_amount = 20;
+		std::vector<frontiers_msgs::VoxelMsg> one_thread;
+		ASSERT_TRUE(searchFrontierParallel(octree, find_frontiers_msg.request, 20, 1, one_thread));
+		ASSERT_GT(one_thread.size(), 0);
+		ASSERT_LE(one_thread.size(), 20);
+		std::vector<frontiers_msgs::VoxelMsg> four_threads;
+		ASSERT_TRUE(searchFrontierParallel(octree, find_frontiers_msg.request, 20, 4, four_threads));
+		ASSERT_EQ(one_thread.size(), four_threads.size());
+		for (std::size_t i = 0; i < one_thread.size(); ++i)
+		{
+			ASSERT_EQ(one_thread[i].xyz_m.x, four_threads[i].xyz_m.x);
+			ASSERT_EQ(one_thread[i].xyz_m.y, four_threads[i].xyz_m.y);
+			ASSERT_EQ(one_thread[i].xyz_m.z, four_threads[i].xyz_m.z);
+			ASSERT_EQ(one_thread[i].size, four_threads[i].size);
+		}
+		find_frontiers_msg.response.frontiers = four_threads;
+		find_frontiers_msg.response.frontiers_found = four_threads.size();
+		checkFrontiers(octree, find_frontiers_msg.request, find_frontiers_msg.response);
+		// Asking for more keeps the first ones
+		std::vector<frontiers_msgs::VoxelMsg> more;
+		ASSERT_TRUE(searchFrontierParallel(octree, find_frontiers_msg.request, 40, 4, more));
+		ASSERT_GE(more.size(), one_thread.size());
+		for (std::size_t i = 0; i < one_thread.size(); ++i)
+		{
+			ASSERT_EQ(one_thread[i].xyz_m.x, more[i].xyz_m.x);
+			ASSERT_EQ(one_thread[i].xyz_m.y, more[i].xyz_m.y);
+			ASSERT_EQ(one_thread[i].xyz_m.z, more[i].xyz_m.z);
+		}
+		// Continuing a search page by page gives the same frontiers as asking for all of them at once
+		FrontierSearch search;
+		ASSERT_TRUE(search.start(octree, find_frontiers_msg.request, 4));
+		std::vector<frontiers_msgs::VoxelMsg> pages;
+		while(pages.size() < more.size())
+		{
+			ASSERT_GT(search.findMore(std::min<int>(7, more.size() - pages.size()), pages), 0);
+		}
+		ASSERT_EQ(more.size(), pages.size());
+		for (std::size_t i = 0; i < more.size(); ++i)
+		{
+			ASSERT_EQ(more[i].xyz_m.x, pages[i].xyz_m.x);
+			ASSERT_EQ(more[i].xyz_m.y, pages[i].xyz_m.y);
+			ASSERT_EQ(more[i].xyz_m.z, pages[i].xyz_m.z);
+		}
+	}
+
+	TEST(FrontiersTest, SubtreeSummary_SameFrontiersAndVolume)
+	{
+		octomap::OcTree octree ("data/experimentalDataset.bt");
+		SubtreeSummary summary;
+		ASSERT_GT(summary.build(octree, 1), 0);
+		ASSERT_TRUE(summary.builtFor(1));
+		ASSERT_FALSE(summary.builtFor(2));
+		frontiers_msgs::FindFrontiers find_frontiers_msg;
+		find_frontiers_msg.request.min.x = 0;
+		find_frontiers_msg.request.min.y = 0;
+		find_frontiers_msg.request.min.z = 0;
+		find_frontiers_msg.request.max.x = 6;
+		find_frontiers_msg.request.max.y = 2;
+		find_frontiers_msg.request.max.z = 2;
+		std::vector<frontiers_msgs::VoxelMsg> scanned;
+		ASSERT_TRUE(searchFrontierParallel(octree, find_frontiers_msg.request, 100000, 1, scanned));
+		std::vector<frontiers_msgs::VoxelMsg> pruned;
+		ASSERT_TRUE(searchFrontierParallel(octree, find_frontiers_msg.request, 100000, 4, pruned, &summary));
+		ASSERT_GT(scanned.size(), 0);
+		ASSERT_EQ(scanned.size(), pruned.size());
+		std::unordered_set<octomap::OcTreeKey, octomap::OcTreeKey::KeyHash> pruned_keys;
+		for (frontiers_msgs::VoxelMsg const& frontier : pruned)
+		{
+			pruned_keys.insert(octree.coordToKey(octomath::Vector3(frontier.xyz_m.x, frontier.xyz_m.y, frontier.xyz_m.z)));
+		}
+		for (frontiers_msgs::VoxelMsg const& frontier : scanned)
+		{
+			ASSERT_EQ(1, pruned_keys.count(octree.coordToKey(octomath::Vector3(frontier.xyz_m.x, frontier.xyz_m.y, frontier.xyz_m.z))));
+		}
+
+		// Explored volume, as the sum over the leafs inside the box
+		octomath::Vector3 min (0.5, 0.1, 0.2);
+		octomath::Vector3 max (4.3, 1.7, 1.9);
+		double volume = 0;
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			double inside = 1;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				double low = it.getCoordinate()(axis) - it.getSize() / 2;
+				inside *= std::max(0.0, std::min(low + it.getSize(), double(max(axis))) - std::max(low, double(min(axis))));
+			}
+			volume += inside;
+		}
+		ASSERT_GT(volume, 0);
+		ASSERT_NEAR(volume, summary.exploredVolume(octree, min, max), 0.0001);
+
+		// Following the changes found by the index gives the summary of a full build
+		FrontierIndex index;
+		index.update(NULL, octree);
+		octomap::OcTree changed (octree);
+		changed.setNodeValue(octomath::Vector3(0, 1, 1.85), changed.getClampingThresMinLog());
+		changed.setNodeValue(octomath::Vector3(1.5, 0.5, 0), changed.getClampingThresMaxLog());
+		ASSERT_GT(index.update(&octree, changed), 0);
+		ASSERT_GT(summary.update(changed, 2, 1, index.changedLeafs()), 0);
+		ASSERT_TRUE(summary.builtFor(2));
+		SubtreeSummary rebuilt;
+		rebuilt.build(changed, 2);
+		ASSERT_EQ(rebuilt.size(), summary.size());
+		std::vector<frontiers_msgs::VoxelMsg> from_updated;
+		ASSERT_TRUE(searchFrontierParallel(changed, find_frontiers_msg.request, 100000, 1, from_updated, &summary));
+		std::vector<frontiers_msgs::VoxelMsg> from_rebuilt;
+		ASSERT_TRUE(searchFrontierParallel(changed, find_frontiers_msg.request, 100000, 1, from_rebuilt, &rebuilt));
+		ASSERT_EQ(from_rebuilt.size(), from_updated.size());
+		for (std::size_t i = 0; i < from_rebuilt.size(); ++i)
+		{
+			ASSERT_EQ(from_rebuilt[i].xyz_m.x, from_updated[i].xyz_m.x);
+			ASSERT_EQ(from_rebuilt[i].xyz_m.y, from_updated[i].xyz_m.y);
+			ASSERT_EQ(from_rebuilt[i].xyz_m.z, from_updated[i].xyz_m.z);
+		}
+		ASSERT_NEAR(rebuilt.exploredVolume(changed, min, max), summary.exploredVolume(changed, min, max), 0.0001);
+		// Not the summary of the previous map, built from scratch
+		SubtreeSummary empty;
+		ASSERT_GT(empty.update(changed, 2, 1, index.changedLeafs()), 0);
+		ASSERT_EQ(rebuilt.size(), empty.size());
+	}
 }
 
 int main(int argc, char **argv){
@@ -28,12 +28,13 @@ namespace LazyThetaStarOctree{
 			all_neighbors_are_correct = false;
 			ROS_WARN_STREAM("There are " << neighbors.size() << " neighbors but there should be " << right_answers.size());
 		}
-		for (std::shared_ptr<octomath::Vector3> n : neighbors)
+		for (auto const& neighbor : neighbors)
 		{
+			octomath::Vector3 const& n = neighbor.second;
 			bool found  = false;
 			for(octomath::Vector3 answer : right_answers)
 			{
-				if( equal(answer, (*n)) )
+				if( equal(answer, n) )
  				{
  					found  = true;
  					break;
@@ -42,7 +43,7 @@ namespace LazyThetaStarOctree{
 				
 			if(!found)
 			{
-				wrong_answers.insert(n);
+				wrong_answers.insert(neighbor);
 				all_neighbors_are_correct = false;
 			}
 		}
@@ -56,8 +57,8 @@ namespace LazyThetaStarOctree{
 			octomath::Vector3 wrong;
 			for (auto w : wrong_answers)
 			{
-				std::cout << "Wrong answer: " << *w << "\n";
-				wrong = *w;
+				std::cout << "Wrong answer: " << w.second << "\n";
+				wrong = w.second;
 			}
 			std::cout << "Right answers: " <<  "\n";
 			for(octomath::Vector3 nv : right_answers)
@@ -75,20 +76,22 @@ namespace LazyThetaStarOctree{
 		std::cout << " x_values = [ ];\n";
 		std::cout << " y_values = [ ];\n";
 		std::cout << " z_values = [ ];\n";
-		for (std::shared_ptr<octomath::Vector3> n : neighbors)
+		for (auto const& neighbor : neighbors)
 		{
-			std::cout << " x_values = [x_values, " << n->x() << "];\n ";
-			std::cout << " y_values = [y_values, " << n->y() << "];\n ";
-			std::cout << " z_values = [z_values, " << n->z() << "];\n ";
+			octomath::Vector3 const& n = neighbor.second;
+			std::cout << " x_values = [x_values, " << n.x() << "];\n ";
+			std::cout << " y_values = [y_values, " << n.y() << "];\n ";
+			std::cout << " z_values = [z_values, " << n.z() << "];\n ";
 		}
 	}
 
 	void printForTesting(unordered_set_pointers neighbors)
 	{
 		std::cout << "unordered_set_pointers right_answers =\n{";
-		for(std::shared_ptr<octomath::Vector3> nv : neighbors)
+		for(auto const& neighbor : neighbors)
 		{
-			std::cout << " octomath::Vector3(" << nv->x() << ", " << nv->y() << ", " << nv->z() << "),\n";
+			octomath::Vector3 const& nv = neighbor.second;
+			std::cout << " octomath::Vector3(" << nv.x() << ", " << nv.y() << ", " << nv.z() << "),\n";
 		}
 		std::cout << "} ;\n";
 	}
@@ -820,6 +823,76 @@ namespace LazyThetaStarOctree{
 		}
 	}
 
+	TEST(OctreeNeighborTest, generateNeighbors_keys_SameAsFilter)
+	{
+		octomap::OcTree octree ("data/circle_1m.bt");
+		unordered_set_pointers from_keys;
+		unordered_set_pointers from_coordinates;
+		std::vector<FaceNeighbor> face_neighbors;
+		int leaf_count = 0;
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			VoxelId voxel_id (it.getKey(), it.getDepth());
+			from_keys.clear();
+			from_coordinates.clear();
+			generateNeighbors_keys(from_keys, voxel_id, octree);
+			generateNeighbors_filter_pointers(from_coordinates, it.getCoordinate(), it.getSize(), octree.getResolution(), octree);
+			ASSERT_EQ(from_coordinates.size(), from_keys.size());
+			for (auto const& neighbor : from_coordinates)
+			{
+				unordered_set_pointers::const_iterator found = from_keys.find(neighbor.first);
+				ASSERT_TRUE(found != from_keys.end());
+				ASSERT_TRUE( equal(neighbor.second, found->second, 0.0001) );
+			}
+			generateFaceNeighbors(face_neighbors, voxel_id, octree);
+			ASSERT_EQ(from_keys.size(), face_neighbors.size());
+			for (FaceNeighbor const& neighbor : face_neighbors)
+			{
+				ASSERT_EQ(neighbor.size, octree.getNodeSize(neighbor.depth));
+				ASSERT_EQ(neighbor.node, octree.search(neighbor.key, neighbor.depth));
+			}
+			++leaf_count;
+		}
+		ASSERT_GT(leaf_count, 0);
+	}
+
+	TEST(OctreeNeighborTest, locateLeaf_SameAsSearch)
+	{
+		octomap::OcTree octree ("data/circle_1m.bt");
+		LeafCache leaf_cache;
+		int leaf_count = 0;
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			// A corner of the leaf, not its center
+			octomath::Vector3 point = it.getCoordinate() + octomath::Vector3(1, 1, 1) * (it.getSize() / 2 - octree.getResolution() / 4);
+			octomap::OcTreeKey key = octree.coordToKey(point);
+			LeafLocation location;
+			ASSERT_TRUE(locateLeaf(key, octree, location));
+			ASSERT_EQ(octree.search(key), location.node);
+			ASSERT_EQ(getNodeDepth_Octomap(key, octree), (int)location.depth);
+			ASSERT_EQ(VoxelId(it.getKey(), it.getDepth()), location.voxel_id);
+			ASSERT_TRUE( equal(it.getCoordinate(), location.center, 0.0001) );
+			ASSERT_EQ(it.getSize(), location.side_length);
+			// Once from the octree, once from the cache
+			for (int i = 0; i < 2; ++i)
+			{
+				LeafLocation cached;
+				ASSERT_TRUE(leaf_cache.locate(key, octree, cached));
+				ASSERT_EQ(location.node, cached.node);
+				ASSERT_EQ(location.voxel_id, cached.voxel_id);
+			}
+			++leaf_count;
+		}
+		ASSERT_GT(leaf_count, 0);
+		// Far away from anything that was mapped
+		octomath::Vector3 unknown (1000, 1000, 1000);
+		LeafLocation location;
+		ASSERT_TRUE(octree.search(unknown) == NULL);
+		ASSERT_FALSE(locateLeaf(unknown, octree, location));
+		ASSERT_FALSE(leaf_cache.locate(unknown, octree, location));
+		ASSERT_THROW(getNodeDepth_Octomap(octree.coordToKey(unknown), octree), std::out_of_range);
+	}
+
 	TEST(OctreeNeighborTest, UpdateToCellCenterAndFindSize)
 	{
 		// ARRANGE
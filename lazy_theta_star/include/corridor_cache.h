@@ -0,0 +1,224 @@
+#ifndef CORRIDOR_CACHE_H
+#define CORRIDOR_CACHE_H
+
+#include <octomap/OcTree.h>
+#include <octomap/math/Vector3.h>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+
+	/**
+	 * @brief      Everything the result of a flight corridor check depends on.
+	 *             The corridor is directional (the shape around start can differ from the one around goal),
+	 *             so (A, B) and (B, A) are different keys. Coordinates are compared exactly: in the planner both
+	 *             ends are voxel centers, so the same voxel pair always produces the same key.
+	 */
+	struct CorridorKey
+	{
+		CorridorKey(octomath::Vector3 const& start, octomath::Vector3 const& goal, double margin, uint64_t shape_id, uint64_t map_version)
+			: start_x(start.x()), start_y(start.y()), start_z(start.z()),
+			goal_x(goal.x()), goal_y(goal.y()), goal_z(goal.z()),
+			margin(margin), shape_id(shape_id), map_version(map_version)
+		{}
+		bool operator==(CorridorKey const& other) const
+		{
+			return start_x == other.start_x && start_y == other.start_y && start_z == other.start_z
+				&& goal_x == other.goal_x && goal_y == other.goal_y && goal_z == other.goal_z
+				&& margin == other.margin && shape_id == other.shape_id && map_version == other.map_version;
+		}
+
+		float start_x, start_y, start_z;
+		float goal_x, goal_y, goal_z;
+		double margin;
+		uint64_t shape_id;		// which offsets are around start and goal, see generateOffsets
+		uint64_t map_version;
+	};
+
+	struct CorridorKeyHash
+	{
+		static uint64_t mix(uint64_t h)
+		{
+			// splitmix64 finalizer
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+			return h ^ (h >> 31);
+		}
+		static uint64_t bits(float value)
+		{
+			uint32_t b;
+			std::memcpy(&b, &value, sizeof(b));
+			return b;
+		}
+		std::size_t operator()(CorridorKey const& key) const
+		{
+			uint64_t margin_bits;
+			std::memcpy(&margin_bits, &key.margin, sizeof(margin_bits));
+			uint64_t h = mix( bits(key.start_x) | (bits(key.start_y) << 32) );
+			h = mix( h ^ bits(key.start_z) ^ (bits(key.goal_x) << 32) );
+			h = mix( h ^ bits(key.goal_y) ^ (bits(key.goal_z) << 32) );
+			h = mix( h ^ margin_bits );
+			h = mix( h ^ key.shape_id );
+			return mix( h ^ key.map_version );
+		}
+	};
+
+	/**
+	 * @brief      Least recently used cache of flight corridor results.
+	 *             Entries of an older map are never hit again, they just age out. The version is bumped by
+	 *             mapChanged() and whenever the map sequence number passed to mapVersion is not the one seen last.
+	 *             Whoever edits an octree in place without giving it a new sequence number must call mapChanged().
+	 *             Not thread safe, each node runs its callbacks one at a time.
+	 */
+	class CorridorCache
+	{
+	public:
+		static const std::size_t default_capacity = 1 << 16;
+
+		explicit CorridorCache(std::size_t capacity = default_capacity)
+			: hits(0), misses(0), max_entries(capacity), head(none), tail(none), map_version(0), last_map_sequence(0)
+		{
+			index.reserve(capacity);
+		}
+
+		/**
+		 * @brief      Look up a previous result and mark it as recently used.
+		 *
+		 * @param[in]  key   The corridor
+		 * @param[out] free  The result stored for the corridor, untouched when there is none
+		 *
+		 * @return     True if there was a result for this corridor
+		 */
+		bool find(CorridorKey const& key, bool & free)
+		{
+			std::unordered_map<CorridorKey, uint32_t, CorridorKeyHash>::const_iterator found = index.find(key);
+			if(found == index.end())
+			{
+				++misses;
+				return false;
+			}
+			++hits;
+			moveToFront(found->second);
+			free = entries[found->second].free;
+			return true;
+		}
+		void insert(CorridorKey const& key, bool free)
+		{
+			if(max_entries == 0)
+			{
+				return;
+			}
+			std::unordered_map<CorridorKey, uint32_t, CorridorKeyHash>::const_iterator found = index.find(key);
+			if(found != index.end())
+			{
+				entries[found->second].free = free;
+				moveToFront(found->second);
+				return;
+			}
+			uint32_t position;
+			if(entries.size() < max_entries)
+			{
+				position = entries.size();
+				entries.push_back( Entry(key, free) );
+			}
+			else
+			{
+				// Reuse the least recently used entry
+				position = tail;
+				unlink(position);
+				index.erase(entries[position].key);
+				entries[position] = Entry(key, free);
+			}
+			index.emplace(key, position);
+			linkFront(position);
+		}
+		/**
+		 * @brief      The octree changed, every result stored so far is stale.
+		 */
+		void mapChanged()
+		{
+			++map_version;
+		}
+		/**
+		 * @param[in]  map_sequence  Number of the map the corridors are checked in, see PlannerContext::map_sequence
+		 */
+		uint64_t mapVersion(uint64_t map_sequence)
+		{
+			if(map_sequence != last_map_sequence)
+			{
+				last_map_sequence = map_sequence;
+				++map_version;
+			}
+			return map_version;
+		}
+		void clear()
+		{
+			entries.clear();
+			index.clear();
+			head = tail = none;
+		}
+		std::size_t size() const
+		{
+			return entries.size();
+		}
+		std::size_t capacity() const
+		{
+			return max_entries;
+		}
+
+		uint64_t hits;
+		uint64_t misses;
+
+	private:
+		static const uint32_t none = ~uint32_t(0);
+		struct Entry
+		{
+			Entry(CorridorKey const& key, bool free)
+				: key(key), free(free), previous(none), next(none)
+			{}
+			CorridorKey key;
+			bool free;
+			uint32_t previous;	// more recently used
+			uint32_t next;		// less recently used
+		};
+
+		void unlink(uint32_t position)
+		{
+			Entry & entry = entries[position];
+			if(entry.previous != none) 	entries[entry.previous].next = entry.next;
+			else 						head = entry.next;
+			if(entry.next != none) 		entries[entry.next].previous = entry.previous;
+			else 						tail = entry.previous;
+			entry.previous = entry.next = none;
+		}
+		void linkFront(uint32_t position)
+		{
+			Entry & entry = entries[position];
+			entry.previous = none;
+			entry.next = head;
+			if(head != none) 	entries[head].previous = position;
+			head = position;
+			if(tail == none) 	tail = position;
+		}
+		void moveToFront(uint32_t position)
+		{
+			if(position != head)
+			{
+				unlink(position);
+				linkFront(position);
+			}
+		}
+
+		std::vector<Entry> entries;
+		std::unordered_map<CorridorKey, uint32_t, CorridorKeyHash> index;
+		std::size_t max_entries;
+		uint32_t head;
+		uint32_t tail;
+		uint64_t map_version;
+		uint64_t last_map_sequence;
+	};
+}
+
+#endif // CORRIDOR_CACHE_H
@@ -0,0 +1,303 @@
+#ifndef CORRIDOR_RAYS_H
+#define CORRIDOR_RAYS_H
+
+#include <neighbors.h>
+#include <octomap/OcTree.h>
+#include <octomap/math/Vector3.h>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+
+	typedef Eigen::Matrix<double, 4, Eigen::Dynamic> CorridorPoints;
+
+	/**
+	 * @brief
+	 Checks every line of a flight corridor at once. Column i of the start points is joined to column i of the
+	  goal points and the line must be visible both ways, as hasLineOfSight does it twice per column.
+	  Each ray walks the keys exactly like OcTree::castRay, so the answer is the one of hasLineOfSight, but:
+	  - a ray only descends the octree when it leaves the leaf it is in, instead of once per key,
+	  - the leafs are found through a LeafCache shared by all rays, so a leaf a neighboring ray already
+	    reached is not looked up again,
+	  - the rays advance one key at a time in turns, so an obstacle close to either end of the corridor stops
+	    the whole check early whichever ray runs into it,
+	  - before any ray is cast, a corridor that lies in a few free leafs is accepted at once. In pruned open
+	    space the leafs are large and two or three lookups cover a corridor between neighboring cells,
+	  - the line that found the last obstacle starts first, then the others in column order. Offsets generated
+	    by generateOffsets are sorted from the center out, so the lines closest to the last obstacle and to the
+	    axis of the corridor are cast before the ones on the rim.
+	  Reusing the same object between checks avoids allocations and keeps the last blocked line. Not thread safe.
+	 */
+	class CorridorRays
+	{
+	public:
+		CorridorRays()
+			: last_blocked(0)
+		{}
+
+		/**
+		 * @return     The column of the first line found without line of sight, -1 if the whole corridor is free
+		 */
+		int findBlocked(octomap::OcTree const& octree, CorridorPoints const& starts, CorridorPoints const& goals, LeafCache & leaf_cache)
+		{
+			if(inFreeLeafs(octree, starts, goals, leaf_cache))
+			{
+				return -1;
+			}
+			rays.clear();
+			int columns = starts.cols();
+			if(last_blocked >= columns)
+			{
+				last_blocked = 0;
+			}
+			for (int k = 0; k < columns; ++k)
+			{
+				int i = k == 0 ? last_blocked : (k <= last_blocked ? k - 1 : k);
+				octomath::Vector3 start (starts(0, i), starts(1, i), starts(2, i));
+				octomath::Vector3 goal (goals(0, i), goals(1, i), goals(2, i));
+				for (int direction = 0; direction < 2; ++direction)
+				{
+					Ray ray;
+					ray.column = i;
+					Progress progress = direction == 0 ? begin(ray, octree, start, goal, leaf_cache) : begin(ray, octree, goal, start, leaf_cache);
+					if(progress == kRayBlocked)
+					{
+						last_blocked = i;
+						return i;
+					}
+					if(progress == kRayRunning)
+					{
+						rays.push_back(ray);
+					}
+				}
+			}
+			while(!rays.empty())
+			{
+				for (std::size_t r = 0; r < rays.size(); )
+				{
+					Progress progress = advance(rays[r], octree, leaf_cache);
+					if(progress == kRayBlocked)
+					{
+						last_blocked = rays[r].column;
+						blocking_key = rays[r].key;
+						return last_blocked;
+					}
+					if(progress == kRayFree)
+					{
+						rays[r] = rays.back();
+						rays.pop_back();
+					}
+					else
+					{
+						++r;
+					}
+				}
+			}
+			return -1;
+		}
+
+		/**
+		 * @brief      Key of the voxel that blocked the line returned by the last findBlocked: the occupied voxel the
+		 *             line ran into, or the end of the line when that end is unknown or occupied.
+		 */
+		octomap::OcTreeKey const& blockingKey() const
+		{
+			return blocking_key;
+		}
+
+		/**
+		 * @brief      Whether every key a line of the corridor can visit is in a free leaf. castRay may step one key
+		 *             past the end of a line, so the box of the corridor is grown by one voxel.
+		 *             The box is covered from its lowest key: the leaf found there is taken out and what is left
+		 *             of the box is split in at most three boxes, covered the same way.
+		 *
+		 * @return     False when a lookup finds unknown or occupied space or too many leafs are needed. The rays
+		 *             then decide, the leafs looked up meanwhile are in leaf_cache for them.
+		 */
+		bool inFreeLeafs(octomap::OcTree const& octree, CorridorPoints const& starts, CorridorPoints const& goals, LeafCache & leaf_cache)
+		{
+			if(starts.cols() == 0)
+			{
+				return false;
+			}
+			double resolution = octree.getResolution();
+			octomath::Vector3 lowest, highest;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				lowest(axis) = std::min( starts.row(axis).minCoeff(), goals.row(axis).minCoeff() ) - resolution;
+				highest(axis) = std::max( starts.row(axis).maxCoeff(), goals.row(axis).maxCoeff() ) + resolution;
+			}
+			octomap::OcTreeKey low_key, high_key;
+			if(!octree.coordToKeyChecked(lowest, low_key) || !octree.coordToKeyChecked(highest, high_key))
+			{
+				return false;
+			}
+			unsigned int tree_depth = octree.getTreeDepth();
+			cover.clear();
+			cover.push_back( KeyBox{ {low_key[0], low_key[1], low_key[2]}, {high_key[0], high_key[1], high_key[2]} } );
+			int lookups = 0;
+			while(!cover.empty())
+			{
+				KeyBox box = cover.back();
+				cover.pop_back();
+				++lookups;
+				LeafLocation leaf;
+				if(lookups > max_cover_lookups
+					|| !leaf_cache.locate(octomap::OcTreeKey(box.low[0], box.low[1], box.low[2]), octree, leaf)
+					|| octree.isNodeOccupied(leaf.node))
+				{
+					return false;
+				}
+				int width = 1 << (tree_depth - leaf.depth);
+				int leaf_high [3];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					leaf_high[axis] = (box.low[axis] & ~(width - 1)) + width - 1;
+				}
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if(leaf_high[axis] >= box.high[axis])
+					{
+						continue;
+					}
+					KeyBox rest = box;
+					rest.low[axis] = leaf_high[axis] + 1;
+					for (int done = 0; done < axis; ++done)
+					{
+						rest.high[done] = std::min(box.high[done], leaf_high[done]);
+					}
+					cover.push_back(rest);
+				}
+			}
+			return true;
+		}
+
+	private:
+		enum Progress { kRayFree, kRayBlocked, kRayRunning };
+
+		struct KeyBox
+		{
+			int low [3];
+			int high [3];
+		};
+
+		// Lookups after which the rays are cast anyway
+		static const int max_cover_lookups = 16;
+
+		struct Ray
+		{
+			int column;
+			octomath::Vector3 origin;
+			octomap::OcTreeKey key;
+			int step [3];
+			double t_max [3];
+			double t_delta [3];
+			bool max_range_set;
+			double max_range_sq;
+			// Leaf that contains key
+			LeafLocation leaf;
+		};
+
+		// hasLineOfSight(from, to) up to the first step of castRay
+		Progress begin(Ray & ray, octomap::OcTree const& octree, octomath::Vector3 const& from, octomath::Vector3 const& to, LeafCache & leaf_cache)
+		{
+			// The end must be known and free
+			LeafLocation end;
+			if(!leaf_cache.locate(to, octree, end) || octree.isNodeOccupied(end.node))
+			{
+				octree.coordToKeyChecked(to, blocking_key);
+				return kRayBlocked;
+			}
+			// castRay gives up at the bounds and in unknown space, which leaves the line free
+			if(!octree.coordToKeyChecked(from, ray.key) || !leaf_cache.locate(ray.key, octree, ray.leaf))
+			{
+				return kRayFree;
+			}
+			if(octree.isNodeOccupied(ray.leaf.node))
+			{
+				blocking_key = ray.key;
+				return kRayBlocked;
+			}
+			octomath::Vector3 line = to - from;
+			double max_range = line.norm();
+			octomath::Vector3 direction = line.normalized();
+			double resolution = octree.getResolution();
+			ray.origin = from;
+			for (int i = 0; i < 3; ++i)
+			{
+				if (direction(i) > 0.0) ray.step[i] = 1;
+				else if (direction(i) < 0.0) ray.step[i] = -1;
+				else ray.step[i] = 0;
+
+				if (ray.step[i] != 0)
+				{
+					double voxel_border = octree.keyToCoord(ray.key[i]) + double(ray.step[i] * resolution * 0.5);
+					ray.t_max[i] = ( voxel_border - from(i) ) / direction(i);
+					ray.t_delta[i] = resolution / std::fabs( direction(i) );
+				}
+				else
+				{
+					ray.t_max[i] = std::numeric_limits<double>::max();
+					ray.t_delta[i] = std::numeric_limits<double>::max();
+				}
+			}
+			if (ray.step[0] == 0 && ray.step[1] == 0 && ray.step[2] == 0)
+			{
+				return kRayFree;
+			}
+			ray.max_range_set = max_range > 0.0;
+			ray.max_range_sq = max_range * max_range;
+			return kRayRunning;
+		}
+
+		// One step of castRay
+		Progress advance(Ray & ray, octomap::OcTree const& octree, LeafCache & leaf_cache)
+		{
+			unsigned int dim;
+			if (ray.t_max[0] < ray.t_max[1])
+			{
+				dim = ray.t_max[0] < ray.t_max[2] ? 0 : 2;
+			}
+			else
+			{
+				dim = ray.t_max[1] < ray.t_max[2] ? 1 : 2;
+			}
+			unsigned int last_key = (1 << octree.getTreeDepth()) - 1;
+			if ((ray.step[dim] < 0 && ray.key[dim] == 0) || (ray.step[dim] > 0 && ray.key[dim] == last_key))
+			{
+				return kRayFree;
+			}
+			ray.key[dim] += ray.step[dim];
+			ray.t_max[dim] += ray.t_delta[dim];
+			if (ray.max_range_set)
+			{
+				octomath::Vector3 end = octree.keyToCoord(ray.key);
+				double dist_from_origin_sq = 0;
+				for (int j = 0; j < 3; ++j)
+				{
+					dist_from_origin_sq += ((end(j) - ray.origin(j)) * (end(j) - ray.origin(j)));
+				}
+				if (dist_from_origin_sq > ray.max_range_sq)
+				{
+					return kRayFree;
+				}
+			}
+			if (VoxelId(ray.key, ray.leaf.depth) != ray.leaf.voxel_id && !leaf_cache.locate(ray.key, octree, ray.leaf))
+			{
+				return kRayFree;
+			}
+			return octree.isNodeOccupied(ray.leaf.node) ? kRayBlocked : kRayRunning;
+		}
+
+		std::vector<Ray> rays;
+		std::vector<KeyBox> cover;
+		// Column of the line that found the last obstacle
+		int last_blocked;
+		octomap::OcTreeKey blocking_key;
+	};
+
+}
+
+#endif // CORRIDOR_RAYS_H
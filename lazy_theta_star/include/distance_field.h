@@ -0,0 +1,696 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <octomap/OcTree.h>
+#include <octomap/math/Vector3.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+/**
+ * @brief
+ Distance from every voxel of a dense grid over an octree to the nearest occupied voxel and to the nearest
+  unknown voxel, capped at max_distance. Grid cells are the smallest voxels of the octree and distances are
+  between voxel centers, computed exactly with the separable transform of Felzenszwalb and Huttenlocher.
+  With it a flight corridor is checked by sampling the clearance along its center line instead of casting
+  every ray of the offsets, see corridorFree.
+  update() follows a new map by recomputing only the cells within max_distance of the blocks of voxels that
+  changed state, and grows the grid in place when the map outgrows it. It modifies the field, so a field that
+  searches are reading must be copied before being updated.
+ */
+class DistanceField
+{
+public:
+	// A cell takes 9 bytes, its state and two squared distances, so this is about 300 MB per field. update()
+	// needs another byte per cell while it runs, and twice the memory when it grows the grid.
+	static const std::size_t default_max_cells = std::size_t(1) << 25;
+
+	/**
+	 * @param[in]  max_distance  Distances are capped there, corridors need a clearance below it
+	 * @param[in]  max_cells     No field is built for a map whose grid needs more cells
+	 */
+	explicit DistanceField(double max_distance, std::size_t max_cells = default_max_cells)
+		: max_distance(max_distance), max_cells(max_cells), resolution(0), map_sequence(0)
+	{
+		size[0] = size[1] = size[2] = 0;
+		low_key[0] = low_key[1] = low_key[2] = 0;
+	}
+
+	/**
+	 * @brief      Replaces the field with the one of octree.
+	 *
+	 * @param[in]  map_sequence  Number of the map octree is, see PlannerContext::map_sequence
+	 */
+	void build(octomap::OcTree const& octree, uint64_t map_sequence)
+	{
+		clear();
+		if(!fitBounds(octree))
+		{
+			return;
+		}
+		rasterize(octree, states);
+		occupied_sq.assign(cellCount(), 0);
+		unknown_sq.assign(cellCount(), 0);
+		int all_low [3] = {0, 0, 0};
+		int all_high [3] = {size[0] - 1, size[1] - 1, size[2] - 1};
+		computeRegion(all_low, all_high);
+		this->map_sequence = map_sequence;
+	}
+
+	/**
+	 * @brief      Moves the field from the map it was built for to octree.
+	 *             Only the cells within max_distance of a block with a voxel that changed state are recomputed.
+	 *             When the octree reaches out of the grid, the grid grows with some slack and keeps the distances
+	 *             it had, the blocks added are recomputed like changed ones.
+	 *
+	 * @return     Number of cells recomputed
+	 */
+	std::size_t update(octomap::OcTree const& octree, uint64_t map_sequence)
+	{
+		if(states.empty() || octree.getResolution() != resolution || int(1 << (octree.getTreeDepth() - 1)) != tree_max_val)
+		{
+			build(octree, map_sequence);
+			return cellCount();
+		}
+		std::vector<char> dirty_blocks;
+		if(!growToCover(octree, dirty_blocks))
+		{
+			build(octree, map_sequence);
+			return cellCount();
+		}
+		std::vector<uint8_t> new_states;
+		rasterize(octree, new_states);
+		markChangedBlocks(new_states, dirty_blocks);
+		states.swap(new_states);
+		this->map_sequence = map_sequence;
+		std::vector<Region> regions;
+		dirtyRegions(dirty_blocks, regions);
+		std::size_t recomputed = 0;
+		for (Region const& region : regions)
+		{
+			computeRegion(region.low, region.high);
+			recomputed += region.cellCount();
+		}
+		return recomputed;
+	}
+
+	/**
+	 * @brief      Whether the field was last built or updated for the map with this sequence number
+	 */
+	bool builtFor(uint64_t map_sequence) const
+	{
+		return !states.empty() && this->map_sequence == map_sequence;
+	}
+
+	/**
+	 * @brief      Distance in meters from the center of the voxel that contains point to the nearest obstacle
+	 *             voxel center, at most max_distance. Unknown voxels are obstacles when unknown_as_occupied is set.
+	 *
+	 * @return     -1 outside of the grid
+	 */
+	double distance(octomath::Vector3 const& point, bool unknown_as_occupied) const
+	{
+		int cell [3];
+		if(!cellOf(point, cell))
+		{
+			return -1;
+		}
+		std::size_t i = index(cell[0], cell[1], cell[2]);
+		float squared = occupied_sq[i];
+		if(unknown_as_occupied)
+		{
+			squared = std::min(squared, unknown_sq[i]);
+		}
+		return std::min( std::sqrt(double(squared)) * resolution, max_distance );
+	}
+
+	/**
+	 * @brief      Lower bound of the distance from point to the nearest obstacle voxel: distance() less the half
+	 *             diagonals of both voxels.
+	 */
+	double clearance(octomath::Vector3 const& point, bool unknown_as_occupied) const
+	{
+		double center_distance = distance(point, unknown_as_occupied);
+		if(center_distance < 0)
+		{
+			return -1;
+		}
+		return center_distance - resolution * std::sqrt(3.0);
+	}
+
+	/**
+	 * @brief      Whether corridorFree can be trusted for this margin: the clearance it needs is below max_distance.
+	 */
+	bool covers(double margin) const
+	{
+		return !states.empty() && requiredDistance(margin) < max_distance;
+	}
+
+	/**
+	 * @brief      Whether the capsule of radius margin/2 around the segment from start to goal is clear.
+	 *             Samples the clearance every half voxel along the segment. Conservative: the bound of clearance
+	 *             and the gap between samples are taken off, so a corridor found free is free, while a corridor
+	 *             that only just fits can be found blocked. Points outside of the grid are blocked.
+	 *             Without unknown_as_occupied the voxels of start and goal must still be known and free.
+	 */
+	bool corridorFree(octomath::Vector3 const& start, octomath::Vector3 const& goal, double margin, bool unknown_as_occupied) const
+	{
+		if(!unknown_as_occupied && (!isFree(start) || !isFree(goal)))
+		{
+			return false;
+		}
+		double required = requiredDistance(margin);
+		octomath::Vector3 line = goal - start;
+		int samples = std::max(1, int( std::ceil(line.norm() / sampleStep()) ));
+		for (int i = 0; i <= samples; ++i)
+		{
+			octomath::Vector3 point = start + line * float(double(i) / samples);
+			double center_distance = distance(point, unknown_as_occupied);
+			if(center_distance < required)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	double maxDistance() const
+	{
+		return max_distance;
+	}
+	std::size_t cellCount() const
+	{
+		return std::size_t(size[0]) * size[1] * size[2];
+	}
+	void clear()
+	{
+		states.clear();
+		occupied_sq.clear();
+		unknown_sq.clear();
+		size[0] = size[1] = size[2] = 0;
+		map_sequence = 0;
+	}
+
+private:
+	enum CellState { kUnknown = 0, kFree = 1, kOccupied = 2 };
+	// Grid bounds are rounded to blocks of this many keys, so the grid holds whole blocks. update() finds the
+	// changes block by block.
+	static const int block_keys = 32;
+	// Above this many regions dirtyRegions does not try to merge them
+	static const std::size_t max_merged_regions = 64;
+
+	// Box of cells, bounds included
+	struct Region
+	{
+		int low [3];
+		int high [3];
+
+		std::size_t cellCount() const
+		{
+			return std::size_t(high[0] - low[0] + 1) * (high[1] - low[1] + 1) * (high[2] - low[2] + 1);
+		}
+		Region joined(Region const& other) const
+		{
+			Region both;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				both.low[axis] = std::min(low[axis], other.low[axis]);
+				both.high[axis] = std::max(high[axis], other.high[axis]);
+			}
+			return both;
+		}
+	};
+
+	double sampleStep() const
+	{
+		return resolution / 2;
+	}
+	double requiredDistance(double margin) const
+	{
+		return margin / 2 + resolution * std::sqrt(3.0) + sampleStep() / 2;
+	}
+	int reachInCells() const
+	{
+		return int( std::ceil(max_distance / resolution) ) + 1;
+	}
+	std::size_t index(int x, int y, int z) const
+	{
+		return std::size_t(x) + std::size_t(size[0]) * (std::size_t(y) + std::size_t(size[1]) * std::size_t(z));
+	}
+	int blocksAlong(int axis) const
+	{
+		return size[axis] / block_keys;
+	}
+	std::size_t blockIndex(int x, int y, int z) const
+	{
+		return std::size_t(x) + std::size_t(blocksAlong(0)) * (std::size_t(y) + std::size_t(blocksAlong(1)) * std::size_t(z));
+	}
+	bool isFree(octomath::Vector3 const& point) const
+	{
+		int cell [3];
+		return cellOf(point, cell) && states[ index(cell[0], cell[1], cell[2]) ] == kFree;
+	}
+	bool cellOf(octomath::Vector3 const& point, int cell [3]) const
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			// Same discretization as OcTree::coordToKey
+			int key = int( std::floor(point(axis) * (1.0 / resolution)) ) + tree_max_val;
+			cell[axis] = key - low_key[axis];
+			if(cell[axis] < 0 || cell[axis] >= size[axis])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Key range of every leaf of octree, with one unknown voxel around it
+	bool leafKeyBounds(octomap::OcTree const& octree, int low [3], int high [3]) const
+	{
+		unsigned int tree_depth = octree.getTreeDepth();
+		low[0] = low[1] = low[2] = 1 << tree_depth;
+		high[0] = high[1] = high[2] = -1;
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			int width = 1 << (tree_depth - it.getDepth());
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				int leaf_low = it.getKey()[axis] & ~(width - 1);
+				low[axis] = std::min(low[axis], leaf_low - 1);
+				high[axis] = std::max(high[axis], leaf_low + width);
+			}
+		}
+		if(high[0] < 0)
+		{
+			return false;
+		}
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			low[axis] = std::max(low[axis], 0);
+			high[axis] = std::min(high[axis], (1 << tree_depth) - 1);
+		}
+		return true;
+	}
+
+	// Grows the grid until it covers octree, keeping the cells it had. A side that grows takes half of the grid more
+	// than needed, so a map that keeps growing does not copy the grid every time. dirty_blocks gets one entry per
+	// block of the grid, set for the blocks added. False when octree is empty or the grid with slack would need too
+	// many cells, build() then decides on the exact bounds.
+	bool growToCover(octomap::OcTree const& octree, std::vector<char> & dirty_blocks)
+	{
+		int low [3];
+		int high [3];
+		if(!leafKeyBounds(octree, low, high))
+		{
+			return false;
+		}
+		int key_count = 2 * tree_max_val;
+		int new_low [3];
+		int new_size [3];
+		bool grows = false;
+		std::size_t cells = 1;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int slack = std::max(block_keys, size[axis] / 2);
+			int grid_high = low_key[axis] + size[axis] - 1;
+			new_low[axis] = low_key[axis];
+			if(low[axis] < low_key[axis])
+			{
+				new_low[axis] = std::max(low[axis] - slack, 0) & ~(block_keys - 1);
+				grows = true;
+			}
+			if(high[axis] > grid_high)
+			{
+				grid_high = std::min((high[axis] + slack) | (block_keys - 1), key_count - 1);
+				grows = true;
+			}
+			new_size[axis] = grid_high - new_low[axis] + 1;
+			cells *= new_size[axis];
+		}
+		if(!grows)
+		{
+			dirty_blocks.assign(std::size_t(blocksAlong(0)) * blocksAlong(1) * blocksAlong(2), 0);
+			return true;
+		}
+		if(cells > max_cells)
+		{
+			return false;
+		}
+		int old_low [3] = {low_key[0], low_key[1], low_key[2]};
+		int old_size [3] = {size[0], size[1], size[2]};
+		std::vector<uint8_t> old_states;
+		std::vector<float> old_occupied_sq;
+		std::vector<float> old_unknown_sq;
+		old_states.swap(states);
+		old_occupied_sq.swap(occupied_sq);
+		old_unknown_sq.swap(unknown_sq);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			low_key[axis] = new_low[axis];
+			size[axis] = new_size[axis];
+		}
+		states.assign(cellCount(), kUnknown);
+		occupied_sq.assign(cellCount(), 0);
+		unknown_sq.assign(cellCount(), 0);
+		dirty_blocks.assign(std::size_t(blocksAlong(0)) * blocksAlong(1) * blocksAlong(2), 1);
+		int offset [3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			offset[axis] = old_low[axis] - low_key[axis];
+		}
+		for (int z = 0; z < old_size[2]; ++z)
+		{
+			for (int y = 0; y < old_size[1]; ++y)
+			{
+				std::size_t from = std::size_t(old_size[0]) * (std::size_t(y) + std::size_t(old_size[1]) * z);
+				std::size_t to = index(offset[0], offset[1] + y, offset[2] + z);
+				std::copy(old_states.begin() + from, old_states.begin() + from + old_size[0], states.begin() + to);
+				std::copy(old_occupied_sq.begin() + from, old_occupied_sq.begin() + from + old_size[0], occupied_sq.begin() + to);
+				std::copy(old_unknown_sq.begin() + from, old_unknown_sq.begin() + from + old_size[0], unknown_sq.begin() + to);
+			}
+		}
+		// Both grids are made of whole blocks on the same block boundaries
+		for (int z = 0; z < old_size[2] / block_keys; ++z)
+		{
+			for (int y = 0; y < old_size[1] / block_keys; ++y)
+			{
+				for (int x = 0; x < old_size[0] / block_keys; ++x)
+				{
+					dirty_blocks[ blockIndex(offset[0] / block_keys + x, offset[1] / block_keys + y, offset[2] / block_keys + z) ] = 0;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Sets the blocks where new_states differs from states
+	void markChangedBlocks(std::vector<uint8_t> const& new_states, std::vector<char> & dirty_blocks) const
+	{
+		for (int z = 0; z < size[2]; ++z)
+		{
+			for (int y = 0; y < size[1]; ++y)
+			{
+				std::size_t row = index(0, y, z);
+				for (int block_x = 0; block_x < blocksAlong(0); ++block_x)
+				{
+					char & dirty = dirty_blocks[ blockIndex(block_x, y / block_keys, z / block_keys) ];
+					std::size_t first = row + std::size_t(block_x) * block_keys;
+					if(!dirty && !std::equal(states.begin() + first, states.begin() + first + block_keys, new_states.begin() + first))
+					{
+						dirty = 1;
+					}
+				}
+			}
+		}
+	}
+
+	// Cells to recompute around the dirty blocks: the blocks are gathered in boxes, greedily along x, then y, then z,
+	// which grow by the reach of the changes. Boxes that overlap enough are merged, the ones left may still overlap.
+	void dirtyRegions(std::vector<char> const& dirty_blocks, std::vector<Region> & regions) const
+	{
+		regions.clear();
+		int blocks [3] = {blocksAlong(0), blocksAlong(1), blocksAlong(2)};
+		std::vector<char> taken (dirty_blocks.size(), 0);
+		auto available = [&](int x, int y, int z)
+		{
+			std::size_t i = blockIndex(x, y, z);
+			return dirty_blocks[i] && !taken[i];
+		};
+		int reach = reachInCells();
+		for (int z = 0; z < blocks[2]; ++z)
+		{
+			for (int y = 0; y < blocks[1]; ++y)
+			{
+				for (int x = 0; x < blocks[0]; ++x)
+				{
+					if(!available(x, y, z))
+					{
+						continue;
+					}
+					int end [3] = {x + 1, y + 1, z + 1};
+					while(end[0] < blocks[0] && available(end[0], y, z))
+					{
+						++end[0];
+					}
+					bool grows = true;
+					while(grows && end[1] < blocks[1])
+					{
+						for (int i = x; i < end[0] && grows; ++i)
+						{
+							grows = available(i, end[1], z);
+						}
+						end[1] += grows ? 1 : 0;
+					}
+					grows = true;
+					while(grows && end[2] < blocks[2])
+					{
+						for (int j = y; j < end[1] && grows; ++j)
+						{
+							for (int i = x; i < end[0] && grows; ++i)
+							{
+								grows = available(i, j, end[2]);
+							}
+						}
+						end[2] += grows ? 1 : 0;
+					}
+					int start [3] = {x, y, z};
+					Region region;
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						// Beyond max_distance of every change the capped distances cannot change
+						region.low[axis] = std::max(start[axis] * block_keys - reach, 0);
+						region.high[axis] = std::min(end[axis] * block_keys - 1 + reach, size[axis] - 1);
+					}
+					regions.push_back(region);
+					for (int k = z; k < end[2]; ++k)
+					{
+						for (int j = y; j < end[1]; ++j)
+						{
+							for (int i = x; i < end[0]; ++i)
+							{
+								taken[ blockIndex(i, j, k) ] = 1;
+							}
+						}
+					}
+				}
+			}
+		}
+		if(regions.size() > max_merged_regions)
+		{
+			return;
+		}
+		bool merged = true;
+		while(merged)
+		{
+			merged = false;
+			for (std::size_t i = 0; i < regions.size(); ++i)
+			{
+				for (std::size_t j = i + 1; j < regions.size(); ++j)
+				{
+					Region both = regions[i].joined(regions[j]);
+					if(both.cellCount() <= regions[i].cellCount() + regions[j].cellCount())
+					{
+						regions[i] = both;
+						regions[j] = regions.back();
+						regions.pop_back();
+						merged = true;
+						--j;
+					}
+				}
+			}
+		}
+	}
+
+	bool fitBounds(octomap::OcTree const& octree)
+	{
+		resolution = octree.getResolution();
+		tree_max_val = 1 << (octree.getTreeDepth() - 1);
+		int low [3];
+		int high [3];
+		if(!leafKeyBounds(octree, low, high))
+		{
+			return false;
+		}
+		std::size_t cells = 1;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			low_key[axis] = low[axis] & ~(block_keys - 1);
+			int high_key = std::min(high[axis] | (block_keys - 1), (1 << octree.getTreeDepth()) - 1);
+			size[axis] = high_key - low_key[axis] + 1;
+			cells *= size[axis];
+		}
+		if(cells > max_cells)
+		{
+			ROS_ERROR_STREAM("[DistanceField] The map needs " << cells << " cells, more than the " << max_cells << " allowed. No field built.");
+			size[0] = size[1] = size[2] = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void rasterize(octomap::OcTree const& octree, std::vector<uint8_t> & cell_states) const
+	{
+		cell_states.assign(cellCount(), kUnknown);
+		unsigned int tree_depth = octree.getTreeDepth();
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			int width = 1 << (tree_depth - it.getDepth());
+			int cell_low [3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				cell_low[axis] = (it.getKey()[axis] & ~(width - 1)) - low_key[axis];
+			}
+			uint8_t state = octree.isNodeOccupied(*it) ? kOccupied : kFree;
+			for (int z = cell_low[2]; z < cell_low[2] + width; ++z)
+			{
+				for (int y = cell_low[1]; y < cell_low[1] + width; ++y)
+				{
+					std::size_t row = index(cell_low[0], y, z);
+					std::fill(cell_states.begin() + row, cell_states.begin() + row + width, state);
+				}
+			}
+		}
+	}
+
+	// Recomputes both fields in the cells from low to high, from the sites up to reachInCells around them
+	void computeRegion(int const low [3], int const high [3])
+	{
+		int reach = reachInCells();
+		int sites_low [3];
+		int sites_size [3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			sites_low[axis] = std::max(low[axis] - reach, 0);
+			sites_size[axis] = std::min(high[axis] + reach, size[axis] - 1) - sites_low[axis] + 1;
+		}
+		float cap = float(reach) * float(reach);
+		computeField(kOccupied, sites_low, sites_size, low, high, cap, occupied_sq);
+		computeField(kUnknown, sites_low, sites_size, low, high, cap, unknown_sq);
+	}
+
+	void computeField(uint8_t site_state, int const box_low [3], int const box_size [3], int const low [3], int const high [3], float cap, std::vector<float> & field)
+	{
+		std::vector<float> squared (std::size_t(box_size[0]) * box_size[1] * box_size[2]);
+		for (int z = 0; z < box_size[2]; ++z)
+		{
+			for (int y = 0; y < box_size[1]; ++y)
+			{
+				for (int x = 0; x < box_size[0]; ++x)
+				{
+					bool site = states[ index(box_low[0] + x, box_low[1] + y, box_low[2] + z) ] == site_state;
+					squared[ x + std::size_t(box_size[0]) * (y + std::size_t(box_size[1]) * z) ] = site ? 0 : infinity();
+				}
+			}
+		}
+		int longest = std::max(box_size[0], std::max(box_size[1], box_size[2]));
+		std::vector<float> line (longest);
+		std::vector<float> transformed (longest);
+		std::vector<int> parabolas (longest);
+		std::vector<double> boundaries (longest + 1);
+		std::size_t strides [3] = {1, std::size_t(box_size[0]), std::size_t(box_size[0]) * box_size[1]};
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int a = (axis + 1) % 3;
+			int b = (axis + 2) % 3;
+			for (int j = 0; j < box_size[b]; ++j)
+			{
+				for (int i = 0; i < box_size[a]; ++i)
+				{
+					std::size_t first = i * strides[a] + j * strides[b];
+					for (int k = 0; k < box_size[axis]; ++k)
+					{
+						line[k] = squared[first + k * strides[axis]];
+					}
+					transform1D(line.data(), box_size[axis], transformed.data(), parabolas.data(), boundaries.data());
+					for (int k = 0; k < box_size[axis]; ++k)
+					{
+						squared[first + k * strides[axis]] = transformed[k];
+					}
+				}
+			}
+		}
+		for (int z = low[2]; z <= high[2]; ++z)
+		{
+			for (int y = low[1]; y <= high[1]; ++y)
+			{
+				for (int x = low[0]; x <= high[0]; ++x)
+				{
+					float value = squared[ (x - box_low[0]) + std::size_t(box_size[0]) * ((y - box_low[1]) + std::size_t(box_size[1]) * (z - box_low[2])) ];
+					field[ index(x, y, z) ] = std::min(value, cap);
+				}
+			}
+		}
+	}
+
+	// Squared distance of the cells no site reaches
+	static float infinity()
+	{
+		return 1e20f;
+	}
+
+	// Lower envelope of the parabolas rooted at every sample of f (Felzenszwalb and Huttenlocher)
+	static void transform1D(float const* f, int n, float* d, int* v, double* z)
+	{
+		int k = 0;
+		v[0] = 0;
+		z[0] = -infinity();
+		z[1] = infinity();
+		for (int q = 1; q < n; ++q)
+		{
+			if(f[q] >= infinity())
+			{
+				continue;
+			}
+			if(f[v[k]] >= infinity())
+			{
+				// Only empty samples so far
+				v[k] = q;
+				continue;
+			}
+			double s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k])) / (2.0 * (q - v[k]));
+			while (s <= z[k])
+			{
+				--k;
+				s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k])) / (2.0 * (q - v[k]));
+			}
+			++k;
+			v[k] = q;
+			z[k] = s;
+			z[k + 1] = infinity();
+		}
+		if(f[v[0]] >= infinity())
+		{
+			std::fill(d, d + n, infinity());
+			return;
+		}
+		k = 0;
+		for (int q = 0; q < n; ++q)
+		{
+			while (z[k + 1] < q)
+			{
+				++k;
+			}
+			d[q] = float( double(q - v[k]) * (q - v[k]) + f[v[k]] );
+		}
+	}
+
+	double max_distance;
+	std::size_t max_cells;
+	double resolution;
+	int tree_max_val;
+	int low_key [3];
+	int size [3];
+	std::vector<uint8_t> states;
+	// Squared distances in voxels, capped
+	std::vector<float> occupied_sq;
+	std::vector<float> unknown_sq;
+	uint64_t map_sequence;
+};
+
+}
+
+#endif // DISTANCE_FIELD_H
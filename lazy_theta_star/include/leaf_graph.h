@@ -0,0 +1,123 @@
+#ifndef LEAF_GRAPH_H
+#define LEAF_GRAPH_H
+
+#include <neighbors.h>
+#include <voxel_id.h>
+#include <octomap/OcTree.h>
+#include <cstdint>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+/**
+ * @brief
+ Adjacency of the free leafs of one octree, stored as compressed rows: the neighbors of leaf i are
+  neighbor_rows[row_starts[i]] to neighbor_rows[row_starts[i+1]-1].
+  Each leaf has the free leafs generateNeighbors_keys finds around it, in the same order.
+  Occupied leafs are left out, no flight corridor can end inside one anyway.
+  Built once per map and only read afterwards, so several searches can share it.
+ */
+class LeafGraph
+{
+public:
+	LeafGraph()
+		: built(false), map_sequence(0)
+	{}
+
+	/**
+	 * @brief      Replaces the graph with the one of octree. Generates the neighbors of every free leaf once.
+	 *
+	 * @param[in]  map_sequence  Number of the map octree is, see PlannerContext::map_sequence
+	 */
+	void build(octomap::OcTree const& octree, uint64_t map_sequence)
+	{
+		clear();
+		built = true;
+		this->map_sequence = map_sequence;
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			if(octree.isNodeOccupied(*it))
+			{
+				continue;
+			}
+			rows.insert( VoxelId(it.getKey(), it.getDepth()), ids.size() );
+			ids.push_back( VoxelId(it.getKey(), it.getDepth()) );
+			centers.push_back( it.getCoordinate() );
+		}
+		NeighborSet around;
+		row_starts.reserve(ids.size() + 1);
+		row_starts.push_back(0);
+		for (std::size_t i = 0; i < ids.size(); ++i)
+		{
+			around.clear();
+			generateNeighbors_keys(around, ids[i], octree);
+			for (NeighborSet::value_type const& neighbor : around)
+			{
+				uint32_t const* row = rows.find(neighbor.first);
+				if(row != NULL)
+				{
+					neighbor_rows.push_back(*row);
+				}
+			}
+			row_starts.push_back(neighbor_rows.size());
+		}
+	}
+
+	/**
+	 * @brief      Whether the graph was built from the map with this sequence number
+	 */
+	bool builtFor(uint64_t map_sequence) const
+	{
+		return built && this->map_sequence == map_sequence;
+	}
+
+	/**
+	 * @brief      Adds the neighbors of a free leaf to neighbors.
+	 *
+	 * @return     False if the voxel is not a free leaf of the graph, neighbors is untouched then
+	 */
+	bool neighborsOf(VoxelId const& voxel_id, NeighborSet & neighbors) const
+	{
+		uint32_t const* row = rows.find(voxel_id);
+		if(row == NULL)
+		{
+			return false;
+		}
+		for (uint32_t i = row_starts[*row]; i < row_starts[*row + 1]; ++i)
+		{
+			neighbors.emplace(ids[neighbor_rows[i]], centers[neighbor_rows[i]]);
+		}
+		return true;
+	}
+
+	std::size_t leafCount() const
+	{
+		return ids.size();
+	}
+	std::size_t edgeCount() const
+	{
+		return neighbor_rows.size();
+	}
+	void clear()
+	{
+		built = false;
+		map_sequence = 0;
+		rows.clear();
+		ids.clear();
+		centers.clear();
+		row_starts.clear();
+		neighbor_rows.clear();
+	}
+
+private:
+	bool built;
+	uint64_t map_sequence;
+	VoxelIdMap<uint32_t> rows;
+	std::vector<VoxelId> ids;
+	std::vector<octomath::Vector3> centers;
+	std::vector<uint32_t> row_starts;
+	std::vector<uint32_t> neighbor_rows;
+};
+
+}
+
+#endif // LEAF_GRAPH_H
@@ -13,14 +13,15 @@
 #include <visualization_msgs/Marker.h>
 #include <marker_publishing_utils.h>
 
+#include <atomic>
 #include <cmath>
 #include <limits>
 
 #include <resultSet.h>
+#include <voxel_id.h>
 
 
 namespace LazyThetaStarOctree{
-	int obstacle_hit_count;
 
 	// path to log folder
 	// Keep in mind that a folder is created for each run. And a symbolic link to it that is used everywhere
@@ -109,57 +110,38 @@ namespace LazyThetaStarOctree{
 		// ROS_WARN_STREAM("distanceFromInitialPoint + lineDistanceToFinalPoint <=> " << distanceFromInitialPoint << " + " << lineDistanceToFinalPoint);
 		return distanceFromInitialPoint + lineDistanceToFinalPoint;
 	}
+	class SearchWorkspace;
+
+	/**
+	 * @brief      Node of the search. Nodes are handed out by a SearchWorkspace, which owns the node, its
+	 *             coordinates and the node pointed by parentNode. They stay valid until the workspace is reset.
+	 */
 	class ThetaStarNode
 	{
 	public:
 		ThetaStarNode()
-			: cell_size(0),
+			: coordinates(NULL), cell_size(0),
 				distanceFromInitialPoint(std::numeric_limits<float>::max()), 
-				lineDistanceToFinalPoint(0)
+				lineDistanceToFinalPoint(0),
+				parentNode(NULL)
 		 {
-		 	// std::cout << total_ << " ThetaStarNode. Creating 1. " << *coordinates << std::endl; 
-		 	parentNode = NULL;
-		 	++total_;
-		 	//std::cout << total_ << " ThetaStarNode " << std::endl; 
 		 }
-		ThetaStarNode(std::shared_ptr<octomath::Vector3> coordinates, double cell_size)
-			: coordinates(coordinates), cell_size(cell_size),
+		ThetaStarNode(VoxelId voxel_id, octomath::Vector3 const* coordinates, double cell_size)
+			: voxel_id(voxel_id), coordinates(coordinates), cell_size(cell_size),
 				distanceFromInitialPoint(std::numeric_limits<float>::max()), 
-				lineDistanceToFinalPoint(std::numeric_limits<float>::max())
+				lineDistanceToFinalPoint(std::numeric_limits<float>::max()),
+				parentNode(NULL)
 		 {
-		 	// std::cout << total_ << " ThetaStarNode. Creating 2. " << *coordinates << std::endl; 
-		 	parentNode = NULL;
-		 	++total_;
-		 	//std::cout << total_ << " ThetaStarNode " << std::endl; 
 		 }
-		ThetaStarNode(std::shared_ptr<octomath::Vector3> coordinates, double cell_size,
+		ThetaStarNode(VoxelId voxel_id, octomath::Vector3 const* coordinates, double cell_size,
 			float distanceFromInitialPoint, float lineDistanceToFinalPoint)
-			: coordinates(coordinates), cell_size(cell_size),
+			: voxel_id(voxel_id), coordinates(coordinates), cell_size(cell_size),
 				distanceFromInitialPoint(distanceFromInitialPoint), 
-				lineDistanceToFinalPoint(lineDistanceToFinalPoint)
-		 {
-		 	// std::cout << total_ << " ThetaStarNode. Creating 3. " << *coordinates << std::endl; 
-		 	parentNode = NULL;
-		 	++total_;
-		 	//std::cout << total_ << " ThetaStarNode " << std::endl; 
-		 }
-		 // ThetaStarNode(ThetaStarNode const& original)
-			// : cell_size(original.cell_size),
-			// 	distanceFromInitialPoint(original.distanceFromInitialPoint), 
-			// 	lineDistanceToFinalPoint(original.lineDistanceToFinalPoint),
-			// 	parentNode(original.parentNode),
-			// 	coordinates(original.coordinates)
-		 // {
-		 // 	++total_;
-		 // 	//std::cout << total_ << " ThetaStarNode " << std::endl; 
-		 // }
-		 ~ThetaStarNode()
+				lineDistanceToFinalPoint(lineDistanceToFinalPoint),
+				parentNode(NULL)
 		 {
-		 	if(total_>0) --total_;
-		 	// std::cout << total_ << " ThetaStarNode. Another one bites the dust. " << *coordinates << std::endl; 
 		 }
 
-
         ///  Display  and  <<
         std::string displayString() const
         {
@@ -179,26 +161,28 @@ namespace LazyThetaStarOctree{
           stream_out.precision(7);
           return stream_out;
         }
-        bool hasSameCoordinates (std::shared_ptr<ThetaStarNode> other_node, double tolerance_marging) const
+        bool hasSameCoordinates (ThetaStarNode const* other_node, double tolerance_marging) const
         {
         	double distance = coordinates->distance( *(other_node->coordinates));
         	return distance < tolerance_marging;
         }
+		// Nodes handed out by all workspaces and not yet released by a reset
 		static size_t OustandingObjects() {return total_;}
 		float calculateH_ () const;
 
 
-		// TODO this should never change!!!
-		std::shared_ptr<octomath::Vector3> const coordinates;	// always coordinates of center of cell
+		VoxelId voxel_id;	// identity of the cell, used as key in open and closed
+		octomath::Vector3 const* coordinates;	// always coordinates of center of cell, owned by the workspace
 		double cell_size;
 		float distanceFromInitialPoint;  // g
 		float lineDistanceToFinalPoint; 
-		std::shared_ptr<ThetaStarNode> parentNode;
+		ThetaStarNode* parentNode;
 	private:
-		static size_t total_;
+		friend class SearchWorkspace;
+		static std::atomic<size_t> total_;
 	};
 
-	size_t ThetaStarNode::total_ = 0;
+	std::atomic<size_t> ThetaStarNode::total_ (0);
 
 	std::ostream& operator<<(std::ostream& s, const ThetaStarNode& c){
 		return c.displayString(s);
@@ -2,10 +2,13 @@
 #include <neighbors.h>
 #include <voxel.h>
 #include <open.h>
+#include <planner_context.h>
+#include <work_stealing_pool.h>
 #include <list>
 #include <unordered_map>
 #include <lazy_theta_star_msgs/LTStarRequest.h>
 #include <lazy_theta_star_msgs/LTStarReply.h>
+#include <lazy_theta_star_msgs/LTStarBatch.h>
 #include <lazy_theta_star_msgs/LTStarNodeStatus.h>
 #include <orthogonal_planes.h>
 
@@ -40,32 +43,74 @@ namespace LazyThetaStarOctree{
 
 	};
 
+	class TargetResult
+	{
+	public:
+		// Length of the path from the start through the voxel centers, -1 if the target was not reached
+		double cost;
+		// Only filled when paths are extracted, from start to target
+		std::list<octomath::Vector3> path;
+		TargetResult()
+			: cost(-1)
+		{}
+	};
+
 	enum CellStatus { kFree = 0, kOccupied = 1, kUnknown = 2 };
+
+	// Used by every function below that is not given a context
+	extern PlannerContext default_planner_context;
 	
 	bool 		hasLineOfSight_UnknownAsFree(InputData const& input, rviz_interface::PublishingInput const& publish_input);
+	bool 		hasLineOfSight_UnknownAsFree(PlannerContext & context, InputData const& input, rviz_interface::PublishingInput const& publish_input);
+	// The goal must be known and free and castRay from the start must not hit an obstacle. One line of CorridorRays.
+	bool 		hasLineOfSight				(InputData const& input);
 	double scale_float						(float value);
 	CellStatus 	getLineStatus 				(InputData const& input);
+	// Status of the first voxel that is not free in the box of side margin swept from start to goal
 	CellStatus 	getLineStatusBoundingBox	(InputData const& input);
 	bool 		is_flight_corridor_free		(InputData const& input, rviz_interface::PublishingInput const& publish_input);
+	bool 		is_flight_corridor_free		(PlannerContext & context, InputData const& input, rviz_interface::PublishingInput const& publish_input);
 	float 		weightedDistance			(octomath::Vector3 const& start, octomath::Vector3 const& end);
 	void generateOffsets(double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) );
+	void generateOffsets(PlannerContext & context, double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) );
+	/**
+	 * @brief      Same check as is_flight_corridor_free but only reads the octree and the context settings and layers:
+	 *             no counters, no cache, no markers. Safe to call from several threads at once.
+	 *
+	 * @return     True if the corridor is free
+	 */
+	bool 		corridorHasLineOfSight		(PlannerContext const& context, InputData const& input);
+	/**
+	 * @brief      Number of threads used to check the flight corridors to the neighbors of each node the searches
+	 *             of context expand. One or less checks them one by one in the search thread, which is the default.
+	 *             The search thread takes part, so the pool of the context adds thread_count - 1 threads.
+	 */
+	void setCorridorThreads(PlannerContext & context, int thread_count);
+	void setCorridorThreads(int thread_count);
 	/**
 	 * @brief      Set vertex portion of pseudo code, ln 34.
 	 *
+	 * @param      context    The context of the search
 	 * @param      octree     The octree
 	 * @param      s          TThe node in analyzis
 	 * @param      closed     The closed
 	 * @param      open       The open
 	 * @param[in]  neighbors  The neighbors
+	 * @param[in]  backward   s belongs to the tree grown from the goal
+	 *
+	 * @return     False if, with lazy_edge_evaluation, s is not visible from its parent nor from any expanded neighbor
 	 */
 	bool setVertex(
+		PlannerContext 											& 		context,
 		octomap::OcTree 										const& 	octree, 
-		std::shared_ptr<ThetaStarNode> 							& 		s, 
-		std::unordered_map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, Vector3Hash, VectorComparatorEqual> &  closed,
+		ThetaStarNode 											* 		s, 
+		VoxelIdMap<ThetaStarNode*> 								&  		closed,
 		Open 													& 		open, 
 		unordered_set_pointers									const& 	neighbors,
+		double 															safety_margin,
 		rviz_interface::PublishingInput							const& publish_input, 
-		const double sidelength_lookup_table[]);
+		const double sidelength_lookup_table[],
+		bool backward = false);
 
 	/**
 	 * @brief      Extracts a sequence of coordinates from the links between nodes starting at the goal node and expanding the connections to the prevuous point through parentNode.
@@ -76,7 +121,7 @@ namespace LazyThetaStarOctree{
 	 *
 	 * @return     true is a path from goal node until start node was found (under 500 jumps). False otherwise.
 	 */
-	bool extractPath(std::list<octomath::Vector3> & path, ThetaStarNode const& start, ThetaStarNode & end, bool writeToFile = false);
+	bool extractPath(PlannerContext & context, std::list<octomath::Vector3> & path, ThetaStarNode const& start, ThetaStarNode & end, bool writeToFile = false);
 
 	/**
 	 * @brief      Calcute the cost if a link between these to nodes is created. This is not the ComputeCost method of the pseudo code.
@@ -86,20 +131,63 @@ namespace LazyThetaStarOctree{
 	 *
 	 * @return     the new cost
 	 */
-	float CalculateCost(ThetaStarNode const& s, ThetaStarNode const& s_neighbour);
+	float CalculateCost(PlannerContext & context, ThetaStarNode const& s, ThetaStarNode const& s_neighbour);
 
-	void UpdateVertex(ThetaStarNode const& s, std::shared_ptr<ThetaStarNode> s_neighbour,
+	void UpdateVertex(PlannerContext & context, ThetaStarNode const& s, ThetaStarNode* s_neighbour,
 		Open & open);
 
 	/**
-	 * @brief      Lazy Theta Star. Decimal precision in 0.001 both in closed and in open (buildKey)
+	 * @brief      Lazy Theta Star. Both closed and open are keyed by the VoxelId of each cell
 	 *
+	 * @param      context       Offsets, caches, statistics and log of this search. Its workspace is reset at the beginning and at the end
 	 * @param      octree        The octree
 	 * @param      disc_initial  The disc initial
 	 * @param      disc_final    The disc final
+	 * @param      heuristic_weight  Multiplies h, above 1 the path found can be that many times longer than with 1
 	 *
 	 * @return     A list of the ordered waypoints to get from initial to final
 	 */
+	std::list<octomath::Vector3> lazyThetaStarWeighted_(
+		PlannerContext & context,
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		double max_time_secs,
+		double heuristic_weight,
+		bool print_resulting_path = false);
+	/**
+	 * @brief      Same interface as lazyThetaStarWeighted_, grows one tree from the start and one from the goal.
+	 *             The smaller open is expanded each iteration. Whenever an expanded node sees a node expanded by the
+	 *             other tree the trees are joined, and the search stops when neither open can offer a cheaper join.
+	 *             The goal tree checks its corridors from child to parent, so every corridor keeps the shape it
+	 *             has in the direction it is flown. Uses context.backward_workspace for the goal tree.
+	 */
+	std::list<octomath::Vector3> lazyThetaStarBidirectional_(
+		PlannerContext & context,
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		double max_time_secs,
+		double heuristic_weight,
+		bool print_resulting_path = false);
+	/**
+	 * @brief      lazyThetaStarWeighted_, or lazyThetaStarBidirectional_ with context.bidirectional, with weight 1. With context.anytime_initial_weight above 1 it is anytime instead:
+	 *             it searches again with the weight lowered by anytime_weight_step while max_time_secs lasts and returns
+	 *             the shortest path found. context.suboptimality_bound tells the lowest weight that found a path.
+	 *
+	 * @return     A list of the ordered waypoints to get from initial to final
+	 */
+	std::list<octomath::Vector3> lazyThetaStar_(
+		PlannerContext & context,
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		int const& max_time_secs = 55,
+		bool print_resulting_path = false);
+	// Uses default_planner_context
 	std::list<octomath::Vector3> lazyThetaStar_(
 		InputData const& input,
 		ResultSet & resultSet,
@@ -108,14 +196,56 @@ namespace LazyThetaStarOctree{
 		int const& max_time_secs = 55,
 		bool print_resulting_path = false);
 
+	/**
+	 * @brief      Single source Lazy Theta*: expands from start without a heuristic until every target is reached
+	 *             or max_time_secs runs out.
+	 *             It expands more than a lazyThetaStar_ call to the farthest target, but once for all of them.
+	 *
+	 * @param      context        Offsets, caches, statistics and log of this search. Its workspace is reset at the beginning and at the end
+	 * @param      results        One per target, same order
+	 * @param      extract_paths  Fill TargetResult::path as lazyThetaStar_ would, otherwise only the costs
+	 *
+	 * @return     The number of targets reached
+	 */
+	int lazyThetaStarToTargets(
+		PlannerContext & context,
+		octomap::OcTree const& octree,
+		octomath::Vector3 const& start,
+		double safety_margin,
+		std::vector<octomath::Vector3> const& targets,
+		std::vector<TargetResult> & results,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		int const& max_time_secs = 55,
+		bool extract_paths = false);
+
 
+	// Returns false, with an unsuccessful reply, if context.cancelled was set during the search
+	bool processLTStarRequest(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input);
+	// Uses default_planner_context
 	bool processLTStarRequest(octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input);
+	/**
+	 * @brief      Replies with just start and goal when the flight corridor between them is free, otherwise runs processLTStarRequest.
+	 *             Generates in context the offsets each of the two needs.
+	 *
+	 * @return     Same as processLTStarRequest
+	 */
+	bool processLTStarQuery(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input);
+	// Length of the path in the reply, -1 if there is none
+	double pathCost(lazy_theta_star_msgs::LTStarReply const& reply);
+	/**
+	 * @brief      Plans every query of the batch with processLTStarQuery against the same octree.
+	 *             One after the other the queries share the offsets and the corridor cache of context.
+	 *             With request.parallel they are spread over the calling thread, which uses context, and one thread
+	 *             per helper context. The helpers are meant to be kept from batch to batch, so their offsets and
+	 *             caches are reused: each batch only gives them the settings, the map and the layers of context, and
+	 *             takes the layers back when it is done. The request_id of each reply is the index of its query.
+	 */
+	void processLTStarBatch(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarBatch::Request const& request, lazy_theta_star_msgs::LTStarBatch::Response & response, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input, std::vector<std::unique_ptr<PlannerContext>> const& helper_contexts);
 
 
 
 	// == Algorithm constantes ==
-	Eigen::MatrixXd  startOffsets;
-	Eigen::MatrixXd  goalOffsets;
 	 // double* sidelength_lookup_table;
 	// ==========================
     
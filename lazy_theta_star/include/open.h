@@ -3,18 +3,24 @@
 
 #include <ltStarOctree_common.h>
 #include <exception>
+#include <cstdint>
+#include <voxel_id.h>
 
 namespace LazyThetaStarOctree{
 /**
- * @brief      
+ * @brief
  This class expects responsable use of element access. In getFromMap and pop
-  when range logic is violated an std::out_of_range exception is thrown. Supports only precision to 2 decimal cases
+  when range logic is violated an std::out_of_range exception is thrown.
+  Internally it is an indexed 4-ary min-heap: each node is located by its VoxelId,
+  so erase and changeDistanceFromInitialPoint are O(log n).
+  Nodes with the same heuristic value are popped in insertion order.
+  Open does not own the nodes, they belong to the SearchWorkspace that created them.
  */
 class Open
 {
 public:
 	Open(octomath::Vector3 goal_voxel_center)
-		:goal_voxel_center(goal_voxel_center)
+		:goal_voxel_center(goal_voxel_center), insertion_count(0)
 	{
 
 	}
@@ -23,76 +29,82 @@ public:
 		clear();
 	}
 	/**
-	 * @brief      Determines if a node with specified coordinates exists in map.
+	 * @brief      Empties open and sets the goal of the next search. Keeps the memory already reserved.
 	 *
-	 * @param      key   The coordinates
+	 * @param[in]  goal_voxel_center  The center of the goal voxel of the next search
+	 */
+	void reset(octomath::Vector3 goal_voxel_center)
+	{
+		clear();
+		this->goal_voxel_center = goal_voxel_center;
+	}
+	/**
+	 * @brief      Determines if a node of the specified voxel exists in map.
+	 *
+	 * @param      key   The voxel id
 	 *
 	 * @return     True if exists in map, False otherwise.
 	 */
-	bool existsInMap(octomath::Vector3 const& key) const
+	bool existsInMap(VoxelId const& key) const
 	{
-		try {
-			nodes.at(key);      // vector::at throws an out-of-range
-			return true;
-		}
-		catch (const std::out_of_range& oor) {
-			return false;
-		}
+		return positions.contains(key);
 	}
 
 	/**
 	 * @brief      Get a copy of a node on open
-	 * 	An std::out_of_range exception is thrown if no element with 
-	 * 	those coordinates exists.
+	 * 	An std::out_of_range exception is thrown if no element with
+	 * 	that voxel id exists.
 	 *
-	 * @param      key   The coordinates
+	 * @param      key   The voxel id
 	 *
-	 * @return     A copy of the node in the map.
+	 * @return     The node in the map.
 	 */
-	std::shared_ptr<ThetaStarNode> getFromMap(octomath::Vector3 const& key) const
+	ThetaStarNode* getFromMap(VoxelId const& key) const
 	{
-		return nodes.at(key);      // vector::at throws an out-of-range
+		std::size_t const* position = positions.find(key);
+		if(position == NULL)
+		{
+			throw std::out_of_range("Open has no node with that voxel id!");
+		}
+		return heap[*position].node;
 	}
 	/**
-	 * @brief      Insert a node into open. Replaces node if a node 
-	 * with the same coordinates already exists.
+	 * @brief      Insert a node into open. Replaces node if a node
+	 * with the same voxel id already exists.
 	 *
 	 * @param      node  The node to add
 	 */
-	void insert(std::shared_ptr<ThetaStarNode> node)
+	void insert(ThetaStarNode* node)
 	{
 		if(node->parentNode == NULL)
 		{
 			std::ostringstream oss;
-			oss << "Trying to insert into open a node [" << node->coordinates << "] whose parent is NULL!";
+			oss << "Trying to insert into open a node [" << *(node->coordinates) << "] whose parent is NULL!";
 			throw std::logic_error(oss.str());
 		}
-		// ROS_WARN_STREAM(*(node->coordinates));
-		// printNodes("Starting insert ");
-		erase(*node);
-		// std::cout << "After erase " << std::endl;
-		// printNodes("After erase");
-		nodes[*(node->coordinates)] = node;
-
-		double h = buildKey(*node);
-		// heuristics[h] = *(node->coordinates);
-		octomath::Vector3 coordinates = *(node->coordinates);
-		if (heuristics.find(h) == heuristics.end())
+		if(!node->voxel_id.isValid())
+		{
+			std::ostringstream oss;
+			oss << "Trying to insert into open a node [" << *(node->coordinates) << "] without voxel id!";
+			throw std::logic_error(oss.str());
+		}
+		VoxelId const& id = node->voxel_id;
+		std::size_t const* found = positions.find(id);
+		if(found == NULL)
 		{
-			// ROS_WARN_STREAM("No coordinates with heuristic " << h);
-			std::list<octomath::Vector3> allAlone ;
-			allAlone.push_back(coordinates);
-			heuristics[h] = allAlone ;
-			// printNodes("Righ after insert");
+			heap.push_back( HeapEntry(buildKey(*node), insertion_count++, node, id) );
+			positions.insert(id, heap.size()-1);
+			siftUp(heap.size()-1);
 		}
 		else
 		{
-			// ROS_WARN_STREAM("Already coordinates with heuristic " << h);
-			heuristics[h].push_front( coordinates );
+			// Replacing counts as a new insertion, as if it had been erased first
+			std::size_t position = *found;
+			heap[position].node = node;
+			heap[position].key = buildKey(*node);
+			heap[position].insertion_order = insertion_count++;
+			restoreOrder(position);
 		}
-		// std::cout << "After insertion " << std::endl;
-		// printNodes();
-		// std::cout << " --- end ---" << std::endl;
 	}
 	/**
 	 * @brief      Test if there are nodes inside open.
@@ -101,184 +113,220 @@ public:
 	 */
 	bool empty() const
 	{
-		return heuristics.empty();
+		return heap.empty();
 	}
 	/**
 	 * @brief      Removes a node with the smallest heuristics from open and returns it.
-	 *  The heuristics is the sum of the shorstest distance from the starting node found 
+	 *  The heuristics is the sum of the shorstest distance from the starting node found
 	 *  so far and the straight line distance to the final positions.
 	 *
-	 * @return     Returns a copy of the node with the smallest heuristics
+	 * @return     Returns the node with the smallest heuristics
 	 * @exception  std::out_of_range { When open has no elements }
 	 */
-	std::shared_ptr<ThetaStarNode> pop()
+	ThetaStarNode* pop()
 	{
-		if(heuristics.empty())
+		if(heap.empty())
 		{
 			throw std::out_of_range("Open has no elements!");
 		}
-		// std::shared_ptr<ThetaStarNode> toReturn = nodes[heuristics.begin()->second];
-		std::list <octomath::Vector3> & listOfCoordSameHeuristics = heuristics.begin()->second;
-		octomath::Vector3 & coordinatesToReturn = listOfCoordSameHeuristics.back();
-		std::shared_ptr<ThetaStarNode> toReturn = nodes[ coordinatesToReturn ];
+		ThetaStarNode* toReturn = heap.front().node;
 
-		double key = heuristics.begin()->first;
+		double key = heap.front().key;
 		if(key != buildKey(*toReturn) )
 		{
 			std::ostringstream oss;
-			oss << std::setprecision(10) << "Node has inconsistent heuristics. Original heuristic was " << heuristics.begin()->first << ", build it now it is " << buildKey(*toReturn) << " Please report this error to maintainer.";
+			oss << std::setprecision(10) << "Node has inconsistent heuristics. Original heuristic was " << key << ", build it now it is " << buildKey(*toReturn) << " Please report this error to maintainer.";
 			throw std::logic_error(oss.str());
 		}
-		// heuristics.erase(heuristics.begin());
-		if (listOfCoordSameHeuristics.size() == 1)
-		{
-			heuristics.erase(heuristics.begin());
-		}
-		else
+		removeAt(0);
+		return toReturn;
+	}
+
+	/**
+	 * @brief      The key of the node pop would return, a lower bound of g + h for every node in open.
+	 * @exception  std::out_of_range { When open has no elements }
+	 */
+	double topKey() const
+	{
+		if(heap.empty())
 		{
-			listOfCoordSameHeuristics.pop_back();
+			throw std::out_of_range("Open has no elements!");
 		}
-		nodes.erase( coordinatesToReturn );
-		return toReturn;
+		return heap.front().key;
 	}
 
 	void printNodes(std::string title = "") const
 	{
 		std::cout << title << "\n == Open ==" << std::endl;
-		// for(auto n : nodes)
-		// {
-		// 	std::cout << *(n.second->coordinates) << std::endl;
-		// }
-
-		for(auto list_pair : heuristics)
+		for(HeapEntry const& entry : sortedEntries())
 		{
-			// std::cout << *(nodes.at(n.second));
-			// std::cout << " ==> " << n.first << std::endl;
-			std::cout << list_pair.first << " ==> ";
-			for(auto coordinates : list_pair.second)
-			{
-				std::cout << coordinates << std::endl;
-			}
+			std::cout << entry.key << " ==> " << *(entry.node->coordinates) << std::endl;
 		}
 	}
 
 	void printNodes(std::string title, std::ofstream & oss) const
 	{
 		oss << title << "\n == Open ==" << std::endl;
-		for(auto list_pair : heuristics)
+		for(HeapEntry const& entry : sortedEntries())
 		{
-			oss << list_pair.first << " ==> ";
-			for(auto coordinates : list_pair.second)
-			{
-				oss << coordinates << std::endl;
-			}
+			oss << entry.key << " ==> " << *(entry.node->coordinates) << std::endl;
 		}
 	}
 	/**
-	 * @brief      Remove and destroy the node.
+	 * @brief      Remove the node. The node itself still belongs to its workspace.
 	 *
-	 * @param      node  The node to be destroyed, identified by coordinates.
+	 * @param      node  The node to be removed, identified by voxel id.
 	 *
-	 * @return     True if the node was found, False otherwise. 
-	 * 
-	 * @exception  std::out_of_range { When open has no element with those coordinates }
+	 * @return     True if the node was found, False otherwise.
 	 */
 	bool erase(ThetaStarNode const& node)
 	{
-		double scale = 0.0001;
-		bool neededToDelete = false;
-		// printNodes("Starting erase");
-
-		if(   existsInMap( *(node.coordinates) )   )
+		std::size_t const* found = positions.find(node.voxel_id);
+		if(found == NULL)
 		{
-			double old_node_key = buildKey(   *(nodes[ *(node.coordinates) ])   );
-			// ROS_WARN_STREAM("Key: " << old_node_key);
-			// heuristics.erase(old_node_key);
-			if( heuristics.find(old_node_key) != heuristics.end() )
-			{
-				// printNodes("Key exists");
-				// for (auto it = heuristics[old_node_key].begin();
-				// 	it != heuristics[old_node_key].end();
-				// 	++it)
-				// {
-				// 	ROS_WARN_STREAM("it " << *it);
-				// }
-
-				if( heuristics[old_node_key].size() ==1 ){
-					heuristics.erase(old_node_key);
-					neededToDelete = true;
-					// printNodes("Deleting the whole list.");
-				}
-				else
-				{
-					std::list <octomath::Vector3> & toDeleteContainer = heuristics[old_node_key];
-					for (std::list<octomath::Vector3>::iterator it = toDeleteContainer.begin();
-						it != toDeleteContainer.end() && !neededToDelete;
-						++it)
-					{
-						double distance = it->distance( *(node.coordinates) );
-						if( distance <= scale)
-						{
-							toDeleteContainer.erase(it);
-							// printNodes("Deleting only one element of the list");
-							neededToDelete = true;
-						}
-					}
-				}
-			}
+			return false;
 		}
-
-		// std::cout << "After erase " << std::endl;
-		// printNodes();
-		// std::cout << " --- end ---" << std::endl;
-
-		return neededToDelete;
+		removeAt(*found);
+		return true;
 	}
 	int size()
 	{
-		// return nodes.size();
-		int count = 0;
-		for(auto list_pair : heuristics)
-		{
-			count += list_pair.second.size();
-			// // std::cout << *(nodes.at(n.second));
-			// // std::cout << " ==> " << n.first << std::endl;
-			// std::cout << list_pair.first << " ==> ";
-			// for(auto coordinates : list_pair.second)
-			// {
-			// 	std::cout << coordinates ;
-			// }
-		} 	
-		return count;
+		return heap.size();
 	}
 	void clear()
 	{
-		nodes.clear();
-		heuristics.clear();
+		heap.clear();
+		positions.clear();
+		insertion_count = 0;
 	}
 
 
 	/**
-	 * @brief      Update the distance from initial point while maintining internal ordering of nodes. 
+	 * @brief      Update the distance from initial point while maintining internal ordering of nodes.
 	 * 			   This will update: the node and the node position inside open.
 	 *
 	 * @param[in]  new_distance  The new distance from initial position
 	 *
 	 * @return     true if all went well, false if the node could not be found
 	 */
-	bool changeDistanceFromInitialPoint(float new_distance, std::shared_ptr<ThetaStarNode> node)
+	bool changeDistanceFromInitialPoint(float new_distance, ThetaStarNode* node)
 	{
-		if ( erase(*node) )
+		std::size_t const* found = positions.find(node->voxel_id);
+		if(found == NULL)
 		{
-			node->distanceFromInitialPoint = new_distance;
-			insert(node);
-			return true;
+			return false;
 		}
-		return false;
-
+		std::size_t position = *found;
+		node->distanceFromInitialPoint = new_distance;
+		heap[position].node = node;
+		heap[position].key = buildKey(*node);
+		heap[position].insertion_order = insertion_count++;
+		restoreOrder(position);
+		return true;
 	}
 
 private:
+	struct HeapEntry
+	{
+		HeapEntry(double key, uint64_t insertion_order, ThetaStarNode* node, VoxelId id)
+			: key(key), insertion_order(insertion_order), node(node), id(id)
+		{}
+		double key;
+		uint64_t insertion_order;		// tie breaker, first in first out
+		ThetaStarNode* node;
+		VoxelId id;
+	};
+	static const std::size_t arity = 4;
+
+	static bool goesBefore(HeapEntry const& lhs, HeapEntry const& rhs)
+	{
+		if(lhs.key != rhs.key)
+		{
+			return lhs.key < rhs.key;
+		}
+		return lhs.insertion_order < rhs.insertion_order;
+	}
+	void siftUp(std::size_t position)
+	{
+		HeapEntry moving = heap[position];
+		while(position > 0)
+		{
+			std::size_t parent = (position - 1) / arity;
+			if( !goesBefore(moving, heap[parent]) )
+			{
+				break;
+			}
+			heap[position] = heap[parent];
+			positions[heap[position].id] = position;
+			position = parent;
+		}
+		heap[position] = moving;
+		positions[moving.id] = position;
+	}
+	void siftDown(std::size_t position)
+	{
+		HeapEntry moving = heap[position];
+		std::size_t heap_size = heap.size();
+		while(true)
+		{
+			std::size_t first_child = position * arity + 1;
+			if(first_child >= heap_size)
+			{
+				break;
+			}
+			std::size_t best = first_child;
+			std::size_t last_child = std::min(first_child + arity, heap_size);
+			for (std::size_t child = first_child + 1; child < last_child; ++child)
+			{
+				if( goesBefore(heap[child], heap[best]) )
+				{
+					best = child;
+				}
+			}
+			if( !goesBefore(heap[best], moving) )
+			{
+				break;
+			}
+			heap[position] = heap[best];
+			positions[heap[position].id] = position;
+			position = best;
+		}
+		heap[position] = moving;
+		positions[moving.id] = position;
+	}
+	void restoreOrder(std::size_t position)
+	{
+		if(position > 0 && goesBefore(heap[position], heap[(position - 1) / arity]))
+		{
+			siftUp(position);
+		}
+		else
+		{
+			siftDown(position);
+		}
+	}
+	void removeAt(std::size_t position)
+	{
+		positions.erase(heap[position].id);
+		std::size_t last = heap.size() - 1;
+		if(position != last)
+		{
+			heap[position] = heap[last];
+			positions[heap[position].id] = position;
+			heap.pop_back();
+			restoreOrder(position);
+		}
+		else
+		{
+			heap.pop_back();
+		}
+	}
+	std::vector<HeapEntry> sortedEntries() const
+	{
+		std::vector<HeapEntry> sorted (heap);
+		std::sort(sorted.begin(), sorted.end(), goesBefore);
+		return sorted;
+	}
 	double buildKey(ThetaStarNode const& node)
 	{
 		double scale = 0.0001;
@@ -292,14 +340,14 @@ private:
 			return node.calculateH_();
 		}
 	}
-	// this is not an unordered_map because Vector3 does not have a hash function
-	std::map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, VectorComparatorOrder> nodes;
-	// key is a string to be able to distiguish among nodes with same heuristic value
-	std::map< double, std::list<octomath::Vector3> > heuristics;
+	std::vector<HeapEntry> heap;
+	// position of each node inside heap, indexed by voxel id
+	VoxelIdMap<std::size_t> positions;
 	octomath::Vector3 goal_voxel_center;
+	uint64_t insertion_count;
 };
 
 }
 
 
-#endif // OPEN_H
\ No newline at end of file
+#endif // OPEN_H
@@ -0,0 +1,138 @@
+#ifndef PLANNER_CONTEXT_H
+#define PLANNER_CONTEXT_H
+
+#include <corridor_cache.h>
+#include <corridor_rays.h>
+#include <distance_field.h>
+#include <leaf_graph.h>
+#include <search_workspace.h>
+#include <swept_volume.h>
+#include <work_stealing_pool.h>
+#include <Eigen/Dense>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace LazyThetaStarOctree{
+// How getCorridorOccupancy checks a corridor when no distance field applies
+enum CorridorCheck {
+	// Lines between the start and goal offsets, see CorridorRays
+	kCorridorByPlanes,
+	// Every voxel the capsule of diameter margin covers along the line, see SweptVolume
+	kCorridorBySweep
+};
+
+/**
+ * @brief
+ Everything a planning request reads and writes besides the octree: the corridor offsets, the corridor cache,
+  the search workspace, the statistics of the last search and the log sink.
+  Contexts share nothing, so requests on different contexts can run at the same time in different threads as long as nobody modifies the octree meanwhile. A single context must only be used by one thread at a time.
+  The functions of ltStar_lib_ortho that have no context parameter use default_planner_context.
+ */
+class PlannerContext
+{
+public:
+	// Without log_name, the log of the context gets a name no other context of the process has
+	explicit PlannerContext(std::string const& log_name = std::string())
+		: offsets_shape_id(0), map_sequence(0), lazy_edge_evaluation(false), bidirectional(false), anytime_initial_weight(1), anytime_weight_step(0.5), corridor_check(kCorridorByPlanes), corridor_unknown_as_occupied(true), cancelled(false), suboptimality_bound(0), id_visibility(0),
+		log_name(log_name.empty() ? "lazyThetaStar_" + std::to_string(nextId()) : log_name)
+	{
+		resetStatistics();
+	}
+
+	// Copies how searches are run, none of the state
+	void copySettings(PlannerContext const& other)
+	{
+		lazy_edge_evaluation = other.lazy_edge_evaluation;
+		bidirectional = other.bidirectional;
+		anytime_initial_weight = other.anytime_initial_weight;
+		anytime_weight_step = other.anytime_weight_step;
+		corridor_check = other.corridor_check;
+		corridor_unknown_as_occupied = other.corridor_unknown_as_occupied;
+	}
+
+	void resetStatistics()
+	{
+		obstacle_hit_count = 0;
+		obstacle_avoidance_calls = 0;
+		obstacle_avoidance_time = 0;
+		setVertex_time = 0;
+		updateVertex_time = 0;
+		id_unreachable = 0;
+	}
+
+	// == Algorithm constantes ==
+	Eigen::MatrixXd startOffsets;
+	Eigen::MatrixXd goalOffsets;
+	// Identifies the parameters startOffsets and goalOffsets were generated with, 0 if never generated
+	uint64_t offsets_shape_id;
+	// Number of the map searched, given by whoever hands the octree to the context. The caches and layers of
+	// the context are only used for the map with the same number, a new map or a map edited in place needs a new one.
+	uint64_t map_sequence;
+	// When true, neighbors go into open without checking the corridor from s, as in the original Lazy Theta*.
+	// The corridor from the assumed parent is only checked by setVertex once the node is expanded.
+	bool lazy_edge_evaluation;
+	// lazyThetaStar_ grows a tree from the goal too, see lazyThetaStarBidirectional_
+	bool bidirectional;
+	// Above 1, lazyThetaStar_ starts with this heuristic weight and lowers it by anytime_weight_step while there is time
+	double anytime_initial_weight;
+	double anytime_weight_step;
+	CorridorCheck corridor_check;
+	// Whether corridors checked on distance_field or by sweep must keep clear of unknown space too
+	bool corridor_unknown_as_occupied;
+	// Set from any thread to make the running search give up at its next iteration. Searches never clear it.
+	std::atomic<bool> cancelled;
+
+	// == Caches ==
+	// Results of is_flight_corridor_free for this context
+	CorridorCache corridor_cache;
+	// Rays, sweep and leafs of the corridors checked by getCorridorOccupancy
+	CorridorRays corridor_rays;
+	// Start and goal offsets moved to the corridor last checked by getCorridorOccupancy_byPlanes
+	CorridorPoints corridor_starts;
+	CorridorPoints corridor_goals;
+	LeafCache leaf_cache;
+	SweptVolume swept_volume;
+	SearchWorkspace workspace;
+	// Tree grown from the goal by lazyThetaStarBidirectional_
+	SearchWorkspace backward_workspace;
+	// Neighbors of the free leafs, used instead of generating them when it was built for map_sequence
+	std::shared_ptr<LeafGraph const> leaf_graph;
+	// Corridors are checked on it instead of casting rays when it was built for map_sequence and covers the margin
+	std::shared_ptr<DistanceField const> distance_field;
+	// Checks the corridors to the neighbors of each expanded node, NULL when they are checked in the search thread.
+	// Each context has its own so searches on different contexts do not wait for each other, see setCorridorThreads.
+	std::unique_ptr<WorkStealingPool> corridor_pool;
+
+	// == Statistics of the last search ==
+	int obstacle_hit_count;
+	// Corridors actually checked (not served by corridor_cache)
+	int obstacle_avoidance_calls;
+	int obstacle_avoidance_time;
+	int setVertex_time;
+	int updateVertex_time;
+	int id_unreachable;
+	// The path of the last lazyThetaStar_ is at most this many times longer than the one of weight 1, 0 without path
+	double suboptimality_bound;
+	// Marker ids for hasLineOfSight_UnknownAsFree, never reset so markers are not overwritten
+	int id_visibility;
+
+	// == Log sink ==
+	// Opened and closed by lazyThetaStar_ on folder_name + "/current/" + log_name + ".log", one file per context
+	// so contexts searching at the same time do not interleave their lines
+	std::string log_name;
+	std::ofstream log_file;
+
+private:
+	static unsigned int nextId()
+	{
+		static std::atomic<unsigned int> next_id(0);
+		return next_id++;
+	}
+};
+
+}
+
+#endif // PLANNER_CONTEXT_H
@@ -0,0 +1,148 @@
+#ifndef REQUEST_QUEUE_H
+#define REQUEST_QUEUE_H
+
+#include <lazy_theta_star_msgs/LTStarRequest.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+/**
+ * @brief
+ Bounded queue of path requests shared by the planning threads of ltStar_async_node.
+  The requester only waits for the reply to the last request_id it sent, so a request supersedes every request
+  with a different request_id received before it. Superseded requests that are still queued are dropped and the
+  ones being searched are told to stop through the cancel flag their thread registered in pop.
+  When the queue is full the oldest queued request is dropped to make room.
+ */
+class RequestQueue
+{
+public:
+	typedef lazy_theta_star_msgs::LTStarRequest::ConstPtr Request;
+
+	explicit RequestQueue(std::size_t capacity)
+		: capacity(std::max<std::size_t>(capacity, 1)), closed(false)
+	{}
+
+	/**
+	 * @brief      Queues the request and cancels the ones it supersedes.
+	 *
+	 * @return     The queued requests that were dropped, oldest first
+	 */
+	std::vector<Request> push(Request const& request)
+	{
+		std::vector<Request> dropped;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (std::deque<Request>::iterator it = queue.begin(); it != queue.end(); )
+			{
+				if((*it)->request_id != request->request_id)
+				{
+					dropped.push_back(*it);
+					it = queue.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			for (InFlight const& search : in_flight)
+			{
+				if(search.request_id != request->request_id)
+				{
+					*(search.cancel) = true;
+				}
+			}
+			if(queue.size() == capacity)
+			{
+				dropped.push_back(queue.front());
+				queue.pop_front();
+			}
+			queue.push_back(request);
+		}
+		available.notify_one();
+		return dropped;
+	}
+
+	/**
+	 * @brief      Waits for the next request. Until done is called with the same flag, the request counts
+	 *             as being searched and cancel is set if it gets superseded.
+	 *
+	 * @param[out] request  The oldest queued request
+	 * @param      cancel   Cleared here, set when the request should be abandoned
+	 *
+	 * @return     False if the queue was closed
+	 */
+	bool pop(Request & request, std::atomic<bool> & cancel)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		available.wait(lock, [this]{ return closed || !queue.empty(); });
+		if(closed)
+		{
+			return false;
+		}
+		request = queue.front();
+		queue.pop_front();
+		cancel = false;
+		in_flight.push_back( InFlight(request->request_id, &cancel) );
+		return true;
+	}
+	void done(std::atomic<bool> const& cancel)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::vector<InFlight>::iterator it = in_flight.begin(); it != in_flight.end(); ++it)
+		{
+			if(it->cancel == &cancel)
+			{
+				in_flight.erase(it);
+				return;
+			}
+		}
+	}
+	/**
+	 * @brief      Cancels every search and wakes up every thread waiting in pop.
+	 */
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			queue.clear();
+			for (InFlight const& search : in_flight)
+			{
+				*(search.cancel) = true;
+			}
+		}
+		available.notify_all();
+	}
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size();
+	}
+
+private:
+	typedef lazy_theta_star_msgs::LTStarRequest::_request_id_type RequestId;
+	struct InFlight
+	{
+		InFlight(RequestId request_id, std::atomic<bool>* cancel)
+			: request_id(request_id), cancel(cancel)
+		{}
+		RequestId request_id;
+		std::atomic<bool>* cancel;
+	};
+
+	std::size_t capacity;
+	bool closed;
+	std::deque<Request> queue;
+	std::vector<InFlight> in_flight;
+	mutable std::mutex mutex;
+	std::condition_variable available;
+};
+
+}
+
+#endif // REQUEST_QUEUE_H
@@ -0,0 +1,118 @@
+#ifndef SEARCH_WORKSPACE_H
+#define SEARCH_WORKSPACE_H
+
+#include <ltStarOctree_common.h>
+#include <neighbors.h>
+#include <open.h>
+#include <voxel_id.h>
+#include <memory>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+/**
+ * @brief
+ This class owns everything a Lazy Theta Star search creates: the nodes, their coordinates,
+  open, closed and the neighbor set of the current expansion.
+  Nodes are taken from blocks that are never returned to the system, parent links are plain pointers
+  into those blocks. reset() releases every node at once in O(1) and keeps the blocks and the tables,
+  so a workspace reused between searches stops allocating once it has seen its largest search.
+  Every pointer handed out by newNode is invalidated by reset().
+ */
+class SearchWorkspace
+{
+public:
+	SearchWorkspace()
+		: open(octomath::Vector3()), nodes_in_use(0)
+	{
+
+	}
+	~SearchWorkspace()
+	{
+		reset();
+	}
+
+	/**
+	 * @brief      Creates a node whose coordinates are a copy of the ones given, both owned by the workspace.
+	 *
+	 * @param[in]  voxel_id     The voxel of the node
+	 * @param[in]  coordinates  The center of the voxel
+	 * @param[in]  cell_size    The side of the voxel
+	 *
+	 * @return     The node, valid until the next reset
+	 */
+	ThetaStarNode* newNode(VoxelId const& voxel_id, octomath::Vector3 const& coordinates, double cell_size)
+	{
+		std::size_t slot = takeSlot();
+		Block & block = *(blocks[slot / block_size]);
+		block.coordinates[slot % block_size] = coordinates;
+		ThetaStarNode* node = &(block.nodes[slot % block_size]);
+		*node = ThetaStarNode(voxel_id, &(block.coordinates[slot % block_size]), cell_size);
+		return node;
+	}
+	ThetaStarNode* newNode(VoxelId const& voxel_id, octomath::Vector3 const& coordinates, double cell_size,
+		float distanceFromInitialPoint, float lineDistanceToFinalPoint)
+	{
+		ThetaStarNode* node = newNode(voxel_id, coordinates, cell_size);
+		node->distanceFromInitialPoint = distanceFromInitialPoint;
+		node->lineDistanceToFinalPoint = lineDistanceToFinalPoint;
+		return node;
+	}
+
+	/**
+	 * @brief      Releases all nodes and empties open, closed and neighbors. No memory is freed.
+	 */
+	void reset()
+	{
+		ThetaStarNode::total_ -= nodes_in_use;
+		nodes_in_use = 0;
+		open.clear();
+		closed.clear();
+		neighbors.clear();
+		neighbor_corridors.clear();
+		pending_corridors.clear();
+	}
+
+	std::size_t nodesInUse() const
+	{
+		return nodes_in_use;
+	}
+	// Number of nodes that can be handed out before a new block is needed
+	std::size_t capacity() const
+	{
+		return blocks.size() * block_size;
+	}
+
+	Open open;
+	VoxelIdMap<ThetaStarNode*> closed;
+	NeighborSet neighbors;
+	// Corridor from the expanded node to each entry of neighbors, in the same order (see checkNeighborCorridors)
+	std::vector<char> neighbor_corridors;
+	// Positions in neighbors whose corridor was not in the cache
+	std::vector<std::size_t> pending_corridors;
+
+private:
+	static const std::size_t block_size = 1024;
+	struct Block
+	{
+		ThetaStarNode nodes[block_size];
+		octomath::Vector3 coordinates[block_size];
+	};
+
+	std::size_t takeSlot()
+	{
+		if(nodes_in_use == capacity())
+		{
+			blocks.push_back( std::unique_ptr<Block>(new Block()) );
+		}
+		++ThetaStarNode::total_;
+		return nodes_in_use++;
+	}
+
+	// Blocks never move, so pointers to nodes and coordinates stay valid while the vector grows
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::size_t nodes_in_use;
+};
+
+}
+
+#endif // SEARCH_WORKSPACE_H
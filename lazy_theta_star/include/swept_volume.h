@@ -0,0 +1,235 @@
+#ifndef SWEPT_VOLUME_H
+#define SWEPT_VOLUME_H
+
+#include <neighbors.h>
+#include <voxel_id.h>
+#include <octomap/OcTree.h>
+#include <octomap/math/Vector3.h>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+namespace LazyThetaStarOctree{
+
+	/**
+	 * @brief
+	 Checks the volume a shape covers when it is moved along a line, the way the TODO of getLineStatusBoundingBox
+	  asked for: every key of the sweep is visited once and the octree is queried once per leaf, instead of casting a
+	  line per offset that crosses the same voxels as its neighbors.
+	  The keys are visited in layers across the main axis of the line, from the start to the goal, so the obstacle
+	  reported is one of the closest to the start. In each layer only the bounding box of the part of the sweep
+	  crossing the layer is scanned, so a long diagonal line costs in proportion to its length.
+	  Along a row of keys a free leaf is skipped as a whole once found.
+	  Keys outside the bounds of the octree are left out. Not thread safe because of the LeafCache.
+	 */
+	class SweptVolume
+	{
+	public:
+		enum Shape {
+			// Axis aligned cube of side 2 * half_extent, as getLineStatusBoundingBox used to check with its grid of lines
+			kBox,
+			// Ball of radius half_extent. A key is taken when its voxel might touch the capsule, so the check is conservative
+			kCapsule
+		};
+		enum Status { kSweepFree, kSweepOccupied, kSweepUnknown };
+
+		/**
+		 * @param      unknown_as_occupied  Whether the sweep is blocked by unknown space, otherwise unknown keys are ignored
+		 *                                  except the voxels of start and goal, which must be known
+		 * @param      blocking_key         Key of the obstacle found, untouched when the sweep is free
+		 *
+		 * @return     kSweepOccupied or kSweepUnknown according to the first obstacle found, kSweepFree otherwise
+		 */
+		Status findBlocked(octomap::OcTree const& octree, octomath::Vector3 const& start, octomath::Vector3 const& goal,
+			Shape shape, double half_extent, bool unknown_as_occupied, LeafCache & leaf_cache, octomap::OcTreeKey & blocking_key)
+		{
+			resolution = octree.getResolution();
+			tree_max_val = 1 << (octree.getTreeDepth() - 1);
+			max_key = (1 << octree.getTreeDepth()) - 1;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				from[axis] = start(axis);
+				direction[axis] = goal(axis) - start(axis);
+			}
+			length_sq = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+			if(!unknown_as_occupied && isUnknown(octree, start, leaf_cache, blocking_key))
+			{
+				return kSweepUnknown;
+			}
+			int a = 0;
+			for (int axis = 1; axis < 3; ++axis)
+			{
+				if(std::fabs(direction[axis]) > std::fabs(direction[a]))
+				{
+					a = axis;
+				}
+			}
+			int b = (a + 1) % 3;
+			int c = (a + 2) % 3;
+			// Keys whose voxel can reach the shape
+			double reach = shape == kBox ? half_extent : half_extent + resolution * std::sqrt(3.0) / 2;
+			int first_layer = keyOf( direction[a] >= 0 ? std::min(from[a], from[a] + direction[a]) - half_extent : std::max(from[a], from[a] + direction[a]) + half_extent );
+			int last_layer = keyOf( direction[a] >= 0 ? std::max(from[a], from[a] + direction[a]) + half_extent : std::min(from[a], from[a] + direction[a]) - half_extent );
+			int layer_step = direction[a] >= 0 ? 1 : -1;
+			bool have_leaf = false;
+			LeafLocation leaf;
+			octomap::OcTreeKey key;
+			for (int layer = first_layer; layer != last_layer + layer_step; layer += layer_step)
+			{
+				if(layer < 0 || layer > max_key)
+				{
+					continue;
+				}
+				// The part of the line that a voxel of this layer can reach
+				double t_low, t_high;
+				if(!clipToSlab(a, octree.keyToCoord(layer) - resolution / 2 - half_extent, octree.keyToCoord(layer) + resolution / 2 + half_extent, t_low, t_high))
+				{
+					continue;
+				}
+				int low [3];
+				int high [3];
+				for (int axis : {b, c})
+				{
+					double end_low = from[axis] + direction[axis] * t_low;
+					double end_high = from[axis] + direction[axis] * t_high;
+					low[axis] = std::max( keyOf(std::min(end_low, end_high) - half_extent), 0 );
+					high[axis] = std::min( keyOf(std::max(end_low, end_high) + half_extent), max_key );
+				}
+				key[a] = layer;
+				for (int row = low[b]; row <= high[b]; ++row)
+				{
+					key[b] = row;
+					for (int column = low[c]; column <= high[c]; ++column)
+					{
+						key[c] = column;
+						if(!touches(octree, key, shape, reach))
+						{
+							continue;
+						}
+						if(!have_leaf || VoxelId(key, leaf.depth) != leaf.voxel_id)
+						{
+							have_leaf = leaf_cache.locate(key, octree, leaf);
+							if(!have_leaf)
+							{
+								if(unknown_as_occupied)
+								{
+									blocking_key = key;
+									return kSweepUnknown;
+								}
+								continue;
+							}
+							if(octree.isNodeOccupied(leaf.node))
+							{
+								blocking_key = key;
+								return kSweepOccupied;
+							}
+						}
+						// The rest of the row inside this free leaf is free too
+						int width = 1 << (octree.getTreeDepth() - leaf.depth);
+						column = column | (width - 1);
+					}
+				}
+			}
+			// Checked last so the obstacles closer to the start come first
+			if(!unknown_as_occupied && isUnknown(octree, goal, leaf_cache, blocking_key))
+			{
+				return kSweepUnknown;
+			}
+			return kSweepFree;
+		}
+
+	private:
+		// Whether the voxel of point is unknown, then key is its key clamped to the bounds of the octree
+		bool isUnknown(octomap::OcTree const& octree, octomath::Vector3 const& point, LeafCache & leaf_cache, octomap::OcTreeKey & key) const
+		{
+			octomap::OcTreeKey point_key;
+			bool inside = true;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				int axis_key = keyOf(point(axis));
+				inside = inside && axis_key >= 0 && axis_key <= max_key;
+				point_key[axis] = std::min(std::max(axis_key, 0), max_key);
+			}
+			LeafLocation location;
+			if(inside && leaf_cache.locate(point_key, octree, location))
+			{
+				return false;
+			}
+			key = point_key;
+			return true;
+		}
+
+		// Same discretization as OcTree::coordToKey, without the bounds check
+		int keyOf(double coordinate) const
+		{
+			return int( std::floor(coordinate * (1.0 / resolution)) ) + tree_max_val;
+		}
+
+		// Parameters of the line, in [0, 1], where the coordinate on axis is between low and high
+		bool clipToSlab(int axis, double low, double high, double & t_low, double & t_high) const
+		{
+			if(direction[axis] == 0)
+			{
+				t_low = 0;
+				t_high = 1;
+				return from[axis] >= low && from[axis] <= high;
+			}
+			double t_a = (low - from[axis]) / direction[axis];
+			double t_b = (high - from[axis]) / direction[axis];
+			t_low = std::max(std::min(t_a, t_b), 0.0);
+			t_high = std::min(std::max(t_a, t_b), 1.0);
+			return t_low <= t_high;
+		}
+
+		bool touches(octomap::OcTree const& octree, octomap::OcTreeKey const& key, Shape shape, double reach) const
+		{
+			double center [3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				center[axis] = octree.keyToCoord(key[axis]);
+			}
+			if(shape == kBox)
+			{
+				// The line crosses the voxel grown by the box
+				double t_low = 0;
+				double t_high = 1;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					double axis_low, axis_high;
+					if(!clipToSlab(axis, center[axis] - resolution / 2 - reach, center[axis] + resolution / 2 + reach, axis_low, axis_high))
+					{
+						return false;
+					}
+					t_low = std::max(t_low, axis_low);
+					t_high = std::min(t_high, axis_high);
+				}
+				return t_low <= t_high;
+			}
+			// Distance from the voxel center to the closest point of the line
+			double t = 0;
+			if(length_sq > 0)
+			{
+				t = ( (center[0] - from[0]) * direction[0] + (center[1] - from[1]) * direction[1] + (center[2] - from[2]) * direction[2] ) / length_sq;
+				t = std::min(std::max(t, 0.0), 1.0);
+			}
+			double distance_sq = 0;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				double difference = center[axis] - (from[axis] + direction[axis] * t);
+				distance_sq += difference * difference;
+			}
+			return distance_sq <= reach * reach;
+		}
+
+		double resolution;
+		int tree_max_val;
+		int max_key;
+		double from [3];
+		// Goal minus start
+		double direction [3];
+		double length_sq;
+	};
+
+}
+
+#endif // SWEPT_VOLUME_H
@@ -0,0 +1,205 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LazyThetaStarOctree{
+/**
+ * @brief
+ Fixed set of worker threads that run batches of independent tasks.
+  parallelFor splits the indices of a batch over one queue per participant (the workers and the calling thread).
+  Each participant takes work from the front of its own queue and, when it runs dry, steals from the back of
+  the others, so a few expensive tasks do not leave the other threads idle.
+  Only one batch runs at a time and parallelFor returns when every task of the batch has finished.
+  Tasks must not throw.
+ */
+class WorkStealingPool
+{
+public:
+	/**
+	 * @param[in]  worker_count  Threads created besides the one calling parallelFor
+	 */
+	explicit WorkStealingPool(unsigned int worker_count)
+		: queues(worker_count + 1), current_task(NULL), batch(0), remaining(0), busy_workers(0), stopping(false)
+	{
+		for (std::unique_ptr<TaskQueue> & queue : queues)
+		{
+			queue.reset(new TaskQueue());
+		}
+		for (unsigned int i = 0; i < worker_count; ++i)
+		{
+			workers.push_back( std::thread(&WorkStealingPool::workerLoop, this, i + 1) );
+		}
+	}
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(batch_mutex);
+			stopping = true;
+		}
+		batch_started.notify_all();
+		for (std::thread & worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	/**
+	 * @brief      Runs task(i) for every i in [0, count) and waits for all of them.
+	 */
+	void parallelFor(std::size_t count, std::function<void(std::size_t)> const& task)
+	{
+		if(count == 0)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> one_batch_at_a_time(parallel_for_mutex);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			queues[i % queues.size()]->push(i);
+		}
+		{
+			std::lock_guard<std::mutex> lock(batch_mutex);
+			current_task = &task;
+			remaining = count;
+			++batch;
+		}
+		batch_started.notify_all();
+		runTasks(0, task);
+		std::unique_lock<std::mutex> lock(batch_mutex);
+		// Workers that joined must leave before the task goes out of scope or the queues are refilled
+		batch_finished.wait(lock, [this]{ return remaining == 0 && busy_workers == 0; });
+		current_task = NULL;
+	}
+
+	unsigned int threadCount() const
+	{
+		return queues.size();
+	}
+
+private:
+	class TaskQueue
+	{
+	public:
+		TaskQueue()
+			: head(0)
+		{}
+		void push(std::size_t index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(head == indices.size())
+			{
+				// Drained, start over instead of growing
+				indices.clear();
+				head = 0;
+			}
+			indices.push_back(index);
+		}
+		bool popFront(std::size_t & index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(head == indices.size())
+			{
+				return false;
+			}
+			index = indices[head++];
+			return true;
+		}
+		bool stealBack(std::size_t & index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(head == indices.size())
+			{
+				return false;
+			}
+			index = indices.back();
+			indices.pop_back();
+			return true;
+		}
+	private:
+		std::mutex mutex;
+		std::vector<std::size_t> indices;
+		std::size_t head;
+	};
+
+	bool takeTask(std::size_t own_queue, std::size_t & index)
+	{
+		if(queues[own_queue]->popFront(index))
+		{
+			return true;
+		}
+		for (std::size_t offset = 1; offset < queues.size(); ++offset)
+		{
+			if(queues[(own_queue + offset) % queues.size()]->stealBack(index))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	void runTasks(std::size_t own_queue, std::function<void(std::size_t)> const& task)
+	{
+		std::size_t index;
+		while(takeTask(own_queue, index))
+		{
+			task(index);
+			std::lock_guard<std::mutex> lock(batch_mutex);
+			if(--remaining == 0)
+			{
+				batch_finished.notify_all();
+			}
+		}
+	}
+	void workerLoop(std::size_t own_queue)
+	{
+		uint64_t seen_batch = 0;
+		while(true)
+		{
+			std::function<void(std::size_t)> const* task;
+			{
+				std::unique_lock<std::mutex> lock(batch_mutex);
+				batch_started.wait(lock, [&]{ return stopping || batch != seen_batch; });
+				if(stopping)
+				{
+					return;
+				}
+				seen_batch = batch;
+				if(current_task == NULL)
+				{
+					// Woke up after the batch was over
+					continue;
+				}
+				task = current_task;
+				++busy_workers;
+			}
+			runTasks(own_queue, *task);
+			std::lock_guard<std::mutex> lock(batch_mutex);
+			if(--busy_workers == 0)
+			{
+				batch_finished.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex parallel_for_mutex;
+	std::mutex batch_mutex;
+	std::condition_variable batch_started;
+	std::condition_variable batch_finished;
+	std::function<void(std::size_t)> const* current_task;
+	uint64_t batch;
+	std::size_t remaining;
+	unsigned int busy_workers;
+	bool stopping;
+};
+
+}
+
+#endif // WORK_STEALING_POOL_H
@@ -7,7 +7,10 @@
 #include <std_srvs/Empty.h>
 #include <lazy_theta_star_msgs/CheckFlightCorridor.h>
 #include <lazy_theta_star_msgs/CheckVisibility.h>
+#include <lazy_theta_star_msgs/LTStarBatch.h>
 #include <tf/transform_datatypes.h>
+#include <ros/callback_queue.h>
+#include <request_queue.h>
 
 
 
@@ -16,6 +19,11 @@
 #include <string>
 #include <chrono>
 #include <boost/filesystem.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #define SAVE_CSV 1
 // #define STANDALONE 1
@@ -24,13 +32,115 @@ namespace LazyThetaStarOctree
 {
 
 
-    octomap::OcTree* octree;
+	// Replaced as a whole when a new map arrives, searches keep the map they started with alive
+	std::shared_ptr<octomap::OcTree> octree;
+	// Number of the map in octree, counts the maps received
+	uint64_t octree_sequence = 0;
+	// Graph of the current octree once layersThread built it, NULL meanwhile
+	std::shared_ptr<LeafGraph const> leaf_graph;
+	// Distance field of the current octree once layersThread updated it, NULL meanwhile
+	std::shared_ptr<DistanceField const> distance_field;
+	std::mutex octree_mutex;
+	bool build_leaf_graph = false;
+	bool build_distance_field = false;
+	double distance_field_max_distance = 2;
+	int distance_field_max_cells = DistanceField::default_max_cells;
+	// Latest map the layers thread has not started on yet
+	std::shared_ptr<octomap::OcTree> map_for_layers;
+	uint64_t map_for_layers_sequence = 0;
+	std::condition_variable map_received;
+	bool shutting_down = false;
 	double sidelength_lookup_table  [16]; 
 	ros::Publisher ltstar_reply_pub;
 	ros::Publisher marker_pub;
 		
-	bool octomap_init;
+	std::atomic<bool> octomap_init (false);
 	bool publish_free_corridor_arrows;
+	std::unique_ptr<RequestQueue> request_queue;
+	// Batches are served one at a time on their own queue
+	PlannerContext batch_context;
+	int batch_threads = 1;
+	// Plan the queries of parallel batches besides batch_context, kept so their caches outlive a batch
+	std::vector<std::unique_ptr<PlannerContext>> batch_helpers;
+	// Of the pool of each planning context and of batch_context, see setCorridorThreads
+	int corridor_threads = 1;
+
+	std::shared_ptr<octomap::OcTree> currentOctree()
+	{
+		std::lock_guard<std::mutex> lock(octree_mutex);
+		return octree;
+	}
+
+	// The layers come with the map so a search never mixes the layers of one map with another map
+	std::shared_ptr<octomap::OcTree> currentOctree(PlannerContext & context)
+	{
+		std::lock_guard<std::mutex> lock(octree_mutex);
+		context.map_sequence = octree_sequence;
+		context.leaf_graph = leaf_graph;
+		context.distance_field = distance_field;
+		return octree;
+	}
+
+	// Once a context is done with its map, so layersThread can update the field it held in place
+	void releaseLayers(PlannerContext & context)
+	{
+		context.leaf_graph.reset();
+		context.distance_field.reset();
+	}
+
+	// Builds the leaf graph and updates the distance field of the latest map, maps that arrive meanwhile are skipped but the last one
+	void layersThread()
+	{
+		// Two fields take turns: the last one computed, which searches may be reading, and the one before, updated
+		// in place for the next map once no context holds it anymore. Copied from the last one while held.
+		std::shared_ptr<DistanceField> fields [2];
+		int last_field = 0;
+		std::unique_lock<std::mutex> lock(octree_mutex);
+		while(true)
+		{
+			map_received.wait(lock, []{ return shutting_down || map_for_layers; });
+			if(shutting_down)
+			{
+				return;
+			}
+			std::shared_ptr<octomap::OcTree> map = map_for_layers;
+			uint64_t sequence = map_for_layers_sequence;
+			map_for_layers.reset();
+			lock.unlock();
+			std::shared_ptr<LeafGraph> graph;
+			if(build_leaf_graph)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				graph.reset(new LeafGraph());
+				graph->build(*map, sequence);
+				std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+				ROS_INFO_STREAM("[LTStar] Leaf graph of " << graph->leafCount() << " free leafs and " << graph->edgeCount() << " edges built in " << elapsed.count() << " seconds.");
+			}
+			std::shared_ptr<DistanceField> field;
+			if(build_distance_field)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				std::shared_ptr<DistanceField> & next_field = fields[1 - last_field];
+				if(!next_field || next_field.use_count() > 1)
+				{
+					next_field.reset( fields[last_field] ? new DistanceField(*fields[last_field]) : new DistanceField(distance_field_max_distance, distance_field_max_cells) );
+				}
+				// The contexts that held it are done with it
+				std::atomic_thread_fence(std::memory_order_acquire);
+				std::size_t recomputed = next_field->update(*map, sequence);
+				last_field = 1 - last_field;
+				field = next_field;
+				std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+				ROS_INFO_STREAM("[LTStar] Distance field updated, " << recomputed << " of " << field->cellCount() << " cells recomputed in " << elapsed.count() << " seconds.");
+			}
+			lock.lock();
+			if(octree_sequence == sequence)
+			{
+				leaf_graph = graph;
+				distance_field = field;
+			}
+		}
+	}
 
 	bool check_status(lazy_theta_star_msgs::LTStarNodeStatus::Request  &req,
         lazy_theta_star_msgs::LTStarNodeStatus::Response &res)
@@ -44,16 +154,17 @@ namespace LazyThetaStarOctree
 	{
 		octomath::Vector3 start(request.start.x, request.start.y, request.start.z);
 		octomath::Vector3 end  (request.end.x, request.end.y, request.end.z);
-		InputData input (*octree, start, end, 0);
+		std::shared_ptr<octomap::OcTree> map = currentOctree();
+		InputData input (*map, start, end, 0);
 		response.has_visibility = hasLineOfSight_UnknownAsFree(input, rviz_interface::PublishingInput( marker_pub, false));
 		return true;
 	}
 
-	bool checkFligthCorridor_(double flight_corridor_width, octomath::Vector3 start, octomath::Vector3 end)
+	bool checkFligthCorridor_(PlannerContext & context, octomap::OcTree const& map, double flight_corridor_width, octomath::Vector3 start, octomath::Vector3 end)
 	{
-		LazyThetaStarOctree::generateOffsets(octree->getResolution(), flight_corridor_width, semiSphereIn, semiSphereOut );
-		InputData input (*octree, start, end, flight_corridor_width);
-		return is_flight_corridor_free(input, rviz_interface::PublishingInput( marker_pub, false));
+		LazyThetaStarOctree::generateOffsets(context, map.getResolution(), flight_corridor_width, semiSphereIn, semiSphereOut );
+		InputData input (map, start, end, flight_corridor_width);
+		return is_flight_corridor_free(context, input, rviz_interface::PublishingInput( marker_pub, false));
 	}
 
 	bool checkFligthCorridor(lazy_theta_star_msgs::CheckFlightCorridor::Request &request,
@@ -61,11 +172,13 @@ namespace LazyThetaStarOctree
 	{
 		octomath::Vector3 start(request.start.x, request.start.y, request.start.z);
 		octomath::Vector3 end  (request.end.x, request.end.y, request.end.z);
-		response.free = checkFligthCorridor_(request.flight_corridor_width, start, end);
+		// Services run one at a time on their own queue, so they can share the default context
+		response.free = checkFligthCorridor_(default_planner_context, *currentOctree(default_planner_context), request.flight_corridor_width, start, end);
+		releaseLayers(default_planner_context);
 		return true;
 	}
 	
-	void publishResultingPath(lazy_theta_star_msgs::LTStarReply reply, int series )
+	void publishResultingPath(octomap::OcTree const& map, lazy_theta_star_msgs::LTStarReply reply, int series )
 	{
 		visualization_msgs::MarkerArray waypoint_array;
 		visualization_msgs::MarkerArray arrow_array;
@@ -77,18 +190,17 @@ namespace LazyThetaStarOctree
 			std::unordered_set<std::shared_ptr<octomath::Vector3>> neighbors;
 	        octomath::Vector3 cell_center;
 			double side_length;
-			try
+			LeafLocation location;
+			if(locateLeaf(candidate, map, location))
 			{
-		        octomap::OcTreeKey key = octree->coordToKey(candidate);
-		        double depth = getNodeDepth_Octomap(key, *octree);
-		        side_length = findSideLenght(octree->getTreeDepth(), depth, sidelength_lookup_table);
-		        cell_center = octree->keyToCoord(key, depth);
+		        side_length = findSideLenght(map.getTreeDepth(), location.depth, sidelength_lookup_table);
+		        cell_center = location.center;
 		    }
-		    catch(const std::out_of_range& oor)
+		    else
 		    {
 		    	// This occurs when the start and end coordinates are the actual waypoints
 		    	cell_center = candidate;
-		    	side_length = octree->getResolution();
+		    	side_length = map.getResolution();
 		    }
 
 	        if( cell_center.distance(candidate) < 0.001 )
@@ -109,13 +221,13 @@ namespace LazyThetaStarOctree
 		marker_pub.publish(waypoint_array);
 	}
 
-	void ltstar_callback(const lazy_theta_star_msgs::LTStarRequest::ConstPtr& path_request)
+	void processRequest(PlannerContext & context, std::shared_ptr<octomap::OcTree> const& map, const lazy_theta_star_msgs::LTStarRequest::ConstPtr& path_request)
 	{
 		rviz_interface::publish_deleteAll(marker_pub);
 		lazy_theta_star_msgs::LTStarReply reply;
 		reply.waypoint_amount = 0;
 		reply.success = false;
-		if(octomap_init)
+		if(map)
 		{
 			// std::stringstream ss;
 			// ss << folder_name << "/(" << path_request->start.x << "; " << path_request->start.y << "; " << path_request->start.z << ")_(" 
@@ -123,39 +235,18 @@ namespace LazyThetaStarOctree
 			// octree->writeBinary(ss.str());
 			ROS_INFO_STREAM("[LTStar] Request message " << *path_request);
 
-			octomath::Vector3 start(path_request->start.x, path_request->start.y, path_request->start.z);
-			octomath::Vector3 goal  (path_request->goal.x, path_request->goal.y, path_request->goal.z);
-			bool free_straight_line = checkFligthCorridor_(path_request->safety_margin, start, goal);
-			if(free_straight_line)
+			if( !LazyThetaStarOctree::processLTStarQuery(context, *map, *path_request, reply, sidelength_lookup_table, rviz_interface::PublishingInput( marker_pub, true) ) )
 			{
-				reply.success = true;
-				reply.request_id = path_request->request_id;
-				reply.waypoint_amount = 2;
-
-				geometry_msgs::Pose waypoint;
-	            waypoint.position.x = path_request->start.x;
-	            waypoint.position.y = path_request->start.y;
-	            waypoint.position.z = path_request->start.z;
-	            waypoint.orientation = tf::createQuaternionMsgFromYaw(0);
-	            reply.waypoints.push_back(waypoint);
-	            waypoint.position.x = path_request->goal.x;
-	            waypoint.position.y = path_request->goal.y;
-	            waypoint.position.z = path_request->goal.z;
-	            waypoint.orientation = tf::createQuaternionMsgFromYaw(0);
-	            reply.waypoints.push_back(waypoint);
+				ROS_WARN_STREAM("[LTStar] Request " << path_request->request_id << " was superseded, no reply sent.");
+				return;
 			}
-			else
+			if(reply.waypoint_amount == 1)
 			{
-				LazyThetaStarOctree::generateOffsets(octree->getResolution(), path_request->safety_margin, dephtZero, semiSphereOut );
-				LazyThetaStarOctree::processLTStarRequest(*octree, *path_request, reply, sidelength_lookup_table, rviz_interface::PublishingInput( marker_pub, true) );
-				if(reply.waypoint_amount == 1)
-				{
-					ROS_ERROR_STREAM("[LTStar] The resulting path has only one waypoint. Request: " << *path_request);
-				}
-				// ROS_INFO_STREAM("[LTStar] Reply " << reply);
-
-				// octree->writeBinary(folder_name + "/octree_after_processing_request.bt");
+				ROS_ERROR_STREAM("[LTStar] The resulting path has only one waypoint. Request: " << *path_request);
 			}
+			// ROS_INFO_STREAM("[LTStar] Reply " << reply);
+
+			// octree->writeBinary(folder_name + "/octree_after_processing_request.bt");
 		}
 		else
 		{
@@ -166,16 +257,71 @@ namespace LazyThetaStarOctree
 		}
 		ltstar_reply_pub.publish(reply);
 
-		publishResultingPath(reply, 9);
+		if(map)
+		{
+			publishResultingPath(*map, reply, 9);
+		}
+	}
+
+	bool planBatch(lazy_theta_star_msgs::LTStarBatch::Request &request,
+		lazy_theta_star_msgs::LTStarBatch::Response &response)
+	{
+		// Every query is planned against the map there is now, even if a new one arrives meanwhile
+		std::shared_ptr<octomap::OcTree> map = currentOctree(batch_context);
+		if(!map)
+		{
+			ROS_ERROR_STREAM("[LTStar] Cannot plan batch because no octomap has been received.");
+			return false;
+		}
+		LazyThetaStarOctree::processLTStarBatch(batch_context, *map, request, response, sidelength_lookup_table, rviz_interface::PublishingInput( marker_pub, false), batch_helpers);
+		releaseLayers(batch_context);
+		return true;
+	}
+
+	// Each planning thread has its own context and takes requests until the queue is closed
+	void planningThread()
+	{
+		PlannerContext context;
+		context.copySettings(default_planner_context);
+		setCorridorThreads(context, corridor_threads);
+		lazy_theta_star_msgs::LTStarRequest::ConstPtr path_request;
+		while(request_queue->pop(path_request, context.cancelled))
+		{
+			std::shared_ptr<octomap::OcTree> map = currentOctree(context);
+			processRequest(context, map, path_request);
+			releaseLayers(context);
+			request_queue->done(context.cancelled);
+		}
+	}
+
+	void ltstar_callback(const lazy_theta_star_msgs::LTStarRequest::ConstPtr& path_request)
+	{
+		std::vector<RequestQueue::Request> dropped = request_queue->push(path_request);
+		for (RequestQueue::Request const& request : dropped)
+		{
+			ROS_WARN_STREAM("[LTStar] Dropped queued request " << request->request_id << ", superseded by " << path_request->request_id << " or queue full.");
+		}
 	}
 
 	void octomap_callback(const octomap_msgs::Octomap::ConstPtr& octomapBinary){
-		delete octree;
-		octree = (octomap::OcTree*)octomap_msgs::binaryMsgToMap(*octomapBinary);
+		std::shared_ptr<octomap::OcTree> new_octree ( (octomap::OcTree*)octomap_msgs::binaryMsgToMap(*octomapBinary) );
 		if(!octomap_init)
 		{
-	    	LazyThetaStarOctree::fillLookupTable(octree->getResolution(), octree->getTreeDepth(), sidelength_lookup_table); 
+	    	LazyThetaStarOctree::fillLookupTable(new_octree->getResolution(), new_octree->getTreeDepth(), sidelength_lookup_table); 
+		}
+		{
+			std::lock_guard<std::mutex> lock(octree_mutex);
+			octree = new_octree;
+			++octree_sequence;
+			leaf_graph.reset();
+			distance_field.reset();
+			if(build_leaf_graph || build_distance_field)
+			{
+				map_for_layers = new_octree;
+				map_for_layers_sequence = octree_sequence;
+			}
 		}
+		map_received.notify_one();
 		octomap_init = true;
 	}
 }
@@ -208,13 +354,78 @@ int main(int argc, char **argv)
 	LazyThetaStarOctree::publish_free_corridor_arrows = true;
 	ros::init(argc, argv, "ltstar_async_node");
 	ros::NodeHandle nh;
-	ros::ServiceServer ltstar_status_service= nh.advertiseService("ltstar_status", LazyThetaStarOctree::check_status);
-	ros::ServiceServer lineOfSight_sub 		= nh.advertiseService("is_fligh_corridor_free", LazyThetaStarOctree::checkFligthCorridor);
-	ros::ServiceServer visibility_sub 		= nh.advertiseService("has_visibility", LazyThetaStarOctree::checkVisibility);
-	ros::Subscriber octomap_sub 			= nh.subscribe<octomap_msgs::Octomap>("/octomap_binary", 10, LazyThetaStarOctree::octomap_callback);
+	nh.getParam("path/corridor_threads", LazyThetaStarOctree::corridor_threads);
+	// Every context copies its settings from the default one
+	nh.getParam("path/lazy_edge_evaluation", LazyThetaStarOctree::default_planner_context.lazy_edge_evaluation);
+	nh.getParam("path/bidirectional", LazyThetaStarOctree::default_planner_context.bidirectional);
+	nh.getParam("path/anytime_initial_weight", LazyThetaStarOctree::default_planner_context.anytime_initial_weight);
+	nh.getParam("path/anytime_weight_step", LazyThetaStarOctree::default_planner_context.anytime_weight_step);
+	// Precomputes the neighbors of every free leaf in the background each time a map arrives
+	nh.getParam("path/leaf_graph", LazyThetaStarOctree::build_leaf_graph);
+	// Keeps a distance field up to date with the maps and checks corridors on it, see DistanceField
+	nh.getParam("path/distance_field", LazyThetaStarOctree::build_distance_field);
+	nh.getParam("path/distance_field_max_distance", LazyThetaStarOctree::distance_field_max_distance);
+	nh.getParam("path/distance_field_max_cells", LazyThetaStarOctree::distance_field_max_cells);
+	// Checks corridors by sweeping a capsule instead of casting lines between offsets when no distance field applies
+	bool sweep_corridors = false;
+	nh.getParam("path/sweep_corridors", sweep_corridors);
+	LazyThetaStarOctree::default_planner_context.corridor_check = sweep_corridors ? LazyThetaStarOctree::kCorridorBySweep : LazyThetaStarOctree::kCorridorByPlanes;
+	nh.getParam("path/corridor_unknown_as_occupied", LazyThetaStarOctree::default_planner_context.corridor_unknown_as_occupied);
+	LazyThetaStarOctree::batch_context.copySettings(LazyThetaStarOctree::default_planner_context);
+	LazyThetaStarOctree::setCorridorThreads(LazyThetaStarOctree::batch_context, LazyThetaStarOctree::corridor_threads);
+	// hardware_concurrency is 0 when it cannot tell
+	LazyThetaStarOctree::batch_threads = std::thread::hardware_concurrency();
+	nh.getParam("path/batch_threads", LazyThetaStarOctree::batch_threads);
+	LazyThetaStarOctree::batch_threads = std::max(LazyThetaStarOctree::batch_threads, 1);
+	for (int i = 1; i < LazyThetaStarOctree::batch_threads; ++i)
+	{
+		LazyThetaStarOctree::batch_helpers.push_back( std::unique_ptr<LazyThetaStarOctree::PlannerContext>(new LazyThetaStarOctree::PlannerContext()) );
+	}
+	int planning_threads = 1;
+	nh.getParam("path/planning_threads", planning_threads);
+	int request_queue_size = 10;
+	nh.getParam("path/request_queue_size", request_queue_size);
+	LazyThetaStarOctree::request_queue.reset( new LazyThetaStarOctree::RequestQueue( std::max(request_queue_size, 1) ) );
+
+	// Services and maps are served on their own thread, they are never stuck behind a search
+	ros::CallbackQueue services_queue;
+	ros::NodeHandle nh_services;
+	nh_services.setCallbackQueue(&services_queue);
+	ros::ServiceServer ltstar_status_service= nh_services.advertiseService("ltstar_status", LazyThetaStarOctree::check_status);
+	ros::ServiceServer lineOfSight_sub 		= nh_services.advertiseService("is_fligh_corridor_free", LazyThetaStarOctree::checkFligthCorridor);
+	ros::ServiceServer visibility_sub 		= nh_services.advertiseService("has_visibility", LazyThetaStarOctree::checkVisibility);
+	ros::Subscriber octomap_sub 			= nh_services.subscribe<octomap_msgs::Octomap>("/octomap_binary", 10, LazyThetaStarOctree::octomap_callback);
+	ros::CallbackQueue batch_queue;
+	ros::NodeHandle nh_batch;
+	nh_batch.setCallbackQueue(&batch_queue);
+	ros::ServiceServer batch_service 		= nh_batch.advertiseService("ltstar_batch", LazyThetaStarOctree::planBatch);
+	// Requests only get queued here, the searches run on the planning threads
 	ros::Subscriber ltstar_sub 				= nh.subscribe<lazy_theta_star_msgs::LTStarRequest>("ltstar_request", 10, LazyThetaStarOctree::ltstar_callback);
 	LazyThetaStarOctree::ltstar_reply_pub 	= nh.advertise<lazy_theta_star_msgs::LTStarReply>("ltstar_reply", 10);
 	LazyThetaStarOctree::marker_pub 		= nh.advertise<visualization_msgs::MarkerArray>("ltstar_path", 1);
 
+	std::vector<std::thread> planning;
+	for (int i = 0; i < std::max(planning_threads, 1); ++i)
+	{
+		planning.push_back( std::thread(LazyThetaStarOctree::planningThread) );
+	}
+	std::thread layers_thread (LazyThetaStarOctree::layersThread);
+	ros::AsyncSpinner services_spinner (1, &services_queue);
+	services_spinner.start();
+	ros::AsyncSpinner batch_spinner (1, &batch_queue);
+	batch_spinner.start();
 	ros::spin();
+	batch_spinner.stop();
+	services_spinner.stop();
+	LazyThetaStarOctree::request_queue->close();
+	for (std::thread & thread : planning)
+	{
+		thread.join();
+	}
+	{
+		std::lock_guard<std::mutex> lock(LazyThetaStarOctree::octree_mutex);
+		LazyThetaStarOctree::shutting_down = true;
+	}
+	LazyThetaStarOctree::map_received.notify_one();
+	layers_thread.join();
 }
\ No newline at end of file
@@ -2,6 +2,12 @@
 #include <tf/transform_datatypes.h>
 #include <std_srvs/Empty.h>
 #include <orthogonal_planes.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #define SAVE_CSV 1 			// save measurements of lazyThetaStar into csv file
 #define RUNNING_ROS 1 	// enable to publish markers on rViz
@@ -23,19 +29,88 @@ namespace std
 
 namespace LazyThetaStarOctree{
 
-	int obstacle_avoidance_time;
-	int obstacle_avoidance_calls;
-	int setVertex_time;
-	int updateVertex_time;
-	std::ofstream log_file;
-	int id_unreachable;
-	int id_visibility;
+	PlannerContext default_planner_context ("lazyThetaStar");
 
 
+	uint64_t buildOffsetsShapeId(double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) )
+	{
+		uint64_t h = CorridorKeyHash::mix( std::hash<double>{}(resolution) );
+		h = CorridorKeyHash::mix( h ^ std::hash<double>{}(safety_margin) );
+		h = CorridorKeyHash::mix( h ^ reinterpret_cast<uintptr_t>(startDepthGenerator) );
+		h = CorridorKeyHash::mix( h ^ reinterpret_cast<uintptr_t>(goalDepthGenerator) );
+		return (h == 0) ? 1 : h;
+	}
+
 	void generateOffsets(double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) )
 	{
-		startOffsets = generateOffsetMatrix(safety_margin/2.0, resolution, startDepthGenerator);
-		goalOffsets = generateOffsetMatrix(safety_margin/2.0, resolution, goalDepthGenerator);
+		generateOffsets(default_planner_context, resolution, safety_margin, startDepthGenerator, goalDepthGenerator);
+	}
+
+	struct OffsetShape
+	{
+		Eigen::MatrixXd start;
+		Eigen::MatrixXd goal;
+	};
+
+	// Every shape generated so far by shape id, shared by all contexts. There is one shape per margin and pair of
+	// depth generators in use, so they are never evicted.
+	std::mutex offset_shapes_mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<OffsetShape const>> offset_shapes;
+
+	// Taken to write the files all contexts write to, the computation time csv and the maps without path
+	std::mutex shared_output_mutex;
+
+	std::shared_ptr<OffsetShape const> findOffsetShape(uint64_t shape_id, double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) )
+	{
+		std::lock_guard<std::mutex> lock(offset_shapes_mutex);
+		std::shared_ptr<OffsetShape const> & shape = offset_shapes[shape_id];
+		if(!shape)
+		{
+			std::shared_ptr<OffsetShape> generated (new OffsetShape());
+			Eigen::MatrixXd start = generateOffsetMatrix(safety_margin/2.0, resolution, startDepthGenerator);
+			Eigen::MatrixXd goal = generateOffsetMatrix(safety_margin/2.0, resolution, goalDepthGenerator);
+			// Both discs have the same columns in the same order. They are reordered in a spiral from the center
+			// out, as the lines near the axis of a corridor are the likeliest to find an obstacle
+			std::vector<int> order (start.cols());
+			for (std::size_t i = 0; i < order.size(); ++i)
+			{
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&start](int a, int b)
+			{
+				double radius_a = start(1, a) * start(1, a) + start(2, a) * start(2, a);
+				double radius_b = start(1, b) * start(1, b) + start(2, b) * start(2, b);
+				if(radius_a != radius_b)
+				{
+					return radius_a < radius_b;
+				}
+				return std::atan2(start(2, a), start(1, a)) < std::atan2(start(2, b), start(1, b));
+			});
+			generated->start.resize(start.rows(), start.cols());
+			generated->goal.resize(goal.rows(), goal.cols());
+			for (std::size_t i = 0; i < order.size(); ++i)
+			{
+				generated->start.col(i) = start.col(order[i]);
+				generated->goal.col(i) = goal.col(order[i]);
+			}
+			shape = generated;
+		}
+		return shape;
+	}
+
+	void generateOffsets(PlannerContext & context, double resolution, double safety_margin, double (*startDepthGenerator)(double, double, double), double (*goalDepthGenerator)(double, double, double) )
+	{
+		uint64_t shape_id = buildOffsetsShapeId(resolution, safety_margin, startDepthGenerator, goalDepthGenerator);
+		if(shape_id == context.offsets_shape_id)
+		{
+			// Same shape as the one in use, nothing to regenerate
+			return;
+		}
+		// Switching between shapes that were already generated only copies them, into the same storage when the sizes match
+		std::shared_ptr<OffsetShape const> shape = findOffsetShape(shape_id, resolution, safety_margin, startDepthGenerator, goalDepthGenerator);
+		context.startOffsets = shape->start;
+		context.goalOffsets = shape->goal;
+		context.offsets_shape_id = shape_id;
 	}
 
 
@@ -49,7 +124,7 @@ namespace LazyThetaStarOctree{
 	}
 
 	/*
-		(for getLineStatus and getLineStatusBoundingBox)
+		(for getLineStatus)
 		https://github.com/ethz-asl/volumetric_mapping
 		Copyright (c) 2015, Helen Oleynikova, ETH Zurich, Switzerland
 		You can contact the author at <helen dot oleynikova at mavt dot ethz dot ch>
@@ -101,54 +176,33 @@ namespace LazyThetaStarOctree{
 		return CellStatus::kFree;
 	}
 
-	CellStatus getLineStatusBoundingBox(InputData const& input) 
+	CellStatus toCellStatus(SweptVolume::Status status)
 	{
-		octomath::Vector3 bounding_box_size ( input.margin , input.margin , input.margin );
-		// TODO(helenol): Probably best way would be to get all the coordinates along
-		// the line, then make a set of all the OcTreeKeys in all the bounding boxes
-		// around the nodes... and then just go through and query once.
-		const double epsilon = 0.001;  // Small offset
-		CellStatus ret_forward = CellStatus::kFree;
-		CellStatus ret_backwards = CellStatus::kFree;
-		const double& resolution = input.octree.getResolution();
-
-		// Check corner connections and depending on resolution also interior:
-		// Discretization step is smaller than the octomap resolution, as this way
-		// no cell can possibly be missed
-		double x_disc = bounding_box_size.x() / ceil((bounding_box_size.x() + epsilon) / resolution);
-		double y_disc = bounding_box_size.y() / ceil((bounding_box_size.y() + epsilon) / resolution);
-		double z_disc = bounding_box_size.z() / ceil((bounding_box_size.z() + epsilon) / resolution);
-
-		// Ensure that resolution is not infinit
-		if (x_disc <= 0.0) x_disc = resolution;
-		if (y_disc <= 0.0) y_disc = resolution;
-		if (z_disc <= 0.0) z_disc = resolution;
-
-		const octomath::Vector3 bounding_box_half_size = bounding_box_size * 0.5;
-
-		for (double x = -bounding_box_half_size.x(); x <= bounding_box_half_size.x();
-			x += x_disc) {
-			for (double y = -bounding_box_half_size.y();
-				y <= bounding_box_half_size.y(); y += y_disc) 
-			{
-				for (double z = -bounding_box_half_size.z();
-					z <= bounding_box_half_size.z(); z += z_disc) 
-				{
-					octomath::Vector3 offset(x, y, z);
-					ret_forward = getLineStatus( InputData(input.octree, input.start + offset, input.goal + offset, input.margin) );
-					ret_backwards = getLineStatus( InputData(input.octree, input.goal + offset, input.start + offset, input.margin) );
-					if (ret_forward != CellStatus::kFree || ret_backwards != CellStatus::kFree ) 
-					{
-						return CellStatus::kOccupied;
-					}
-				}
-			}
+		switch(status)
+		{
+			case SweptVolume::kSweepFree: 		return CellStatus::kFree;
+			case SweptVolume::kSweepOccupied: 	return CellStatus::kOccupied;
+			default: 							return CellStatus::kUnknown;
 		}
-		return CellStatus::kFree;
+	}
+
+	CellStatus getLineStatusBoundingBox(InputData const& input) 
+	{
+		// The box of side margin swept along the line, each key queried once
+		SweptVolume sweep;
+		LeafCache leaf_cache;
+		octomap::OcTreeKey blocking_key;
+		return toCellStatus( sweep.findBlocked(input.octree, input.start, input.goal, SweptVolume::kBox, input.margin / 2, true, leaf_cache, blocking_key) );
 	}
 
 	bool hasLineOfSight_UnknownAsFree(InputData const& input,
 		rviz_interface::PublishingInput const& publish_input)
+	{
+		return hasLineOfSight_UnknownAsFree(default_planner_context, input, publish_input);
+	}
+
+	bool hasLineOfSight_UnknownAsFree(PlannerContext & context, InputData const& input,
+		rviz_interface::PublishingInput const& publish_input)
 	{
 		// ROS_WARN_STREAM("Start " << input.start << " goal "  << input.goal);
 
@@ -158,8 +212,8 @@ namespace LazyThetaStarOctree{
 		
     	if(publish_input.publish) 
 		{
-			rviz_interface::publish_arrow_path_visibility(input.start, input.goal, publish_input.marker_pub, is_visible, id_visibility);
-			id_visibility++;
+			rviz_interface::publish_arrow_path_visibility(input.start, input.goal, publish_input.marker_pub, is_visible, context.id_visibility);
+			context.id_visibility++;
 		}
 
 		return is_visible;
@@ -203,85 +257,279 @@ namespace LazyThetaStarOctree{
 		return same;
 	}
 
+	bool distanceFieldApplies(PlannerContext const& context, InputData const& input)
+	{
+		return context.distance_field && context.distance_field->builtFor(context.map_sequence) && context.distance_field->covers(input.margin);
+	}
+
+	CellStatus getCorridorOccupancy_byDistanceField(
+		PlannerContext & context,
+		InputData const& input,
+		rviz_interface::PublishingInput const& publish_input) 
+	{
+		bool free = context.distance_field->corridorFree(input.start, input.goal, input.margin, context.corridor_unknown_as_occupied);
+		if(!free)
+		{
+			context.obstacle_hit_count++;
+		}
+		if(publish_input.publish) 
+		{
+			visualization_msgs::MarkerArray marker_array;
+			rviz_interface::publish_arrow_path_occupancyState(input.start, input.goal, marker_array, free, 100);
+			publish_input.marker_pub.publish(marker_array);
+		}
+		return free ? CellStatus::kFree : CellStatus::kOccupied;
+	}
+
+	CellStatus getCorridorOccupancy_bySweep(
+		PlannerContext & context,
+		InputData const& input,
+		rviz_interface::PublishingInput const& publish_input) 
+	{
+		octomap::OcTreeKey blocking_key;
+		CellStatus status = toCellStatus( context.swept_volume.findBlocked(input.octree, input.start, input.goal, SweptVolume::kCapsule, input.margin / 2, context.corridor_unknown_as_occupied, context.leaf_cache, blocking_key) );
+		if(status != CellStatus::kFree)
+		{
+			context.obstacle_hit_count++;
+		}
+		if(publish_input.publish) 
+		{
+			visualization_msgs::MarkerArray marker_array;
+			rviz_interface::publish_arrow_path_occupancyState(input.start, input.goal, marker_array, status == CellStatus::kFree, 100);
+			publish_input.marker_pub.publish(marker_array);
+		}
+		return status;
+	}
+
 	CellStatus getCorridorOccupancy_byPlanes(
+		PlannerContext & context,
 		InputData const& input,
 		rviz_interface::PublishingInput const& publish_input) 
 	{
 		visualization_msgs::MarkerArray marker_array;
 		CoordinateFrame coordinate_frame = generateCoordinateFrame(input.start, input.goal);
-		Eigen::MatrixXd transformation_matrix_start = generateRotationTranslationMatrix(coordinate_frame, input.start);
-
-		Eigen::MatrixXd transformation_matrix_goal = generateRotationTranslationMatrix(coordinate_frame, input.goal);
-
-		Eigen::MatrixXd points_around_start = transformation_matrix_start * startOffsets;
-		Eigen::MatrixXd points_around_goal = transformation_matrix_goal * goalOffsets;
-
-		octomath::Vector3 temp_start, temp_goal;
-		// geometry_msgs::Point start_point, end_point;
+		// Fixed size so the transform of the offsets is vectorized
+		Eigen::Matrix4d transformation_matrix_start = generateRotationTranslationMatrix(coordinate_frame, input.start);
+		Eigen::Matrix4d transformation_matrix_goal = generateRotationTranslationMatrix(coordinate_frame, input.goal);
+
+		// Into the points of the previous corridor, which have the same size unless the offsets changed
+		CorridorPoints & points_around_start = context.corridor_starts;
+		CorridorPoints & points_around_goal = context.corridor_goals;
+		points_around_start.resize(4, context.startOffsets.cols());
+		points_around_goal.resize(4, context.goalOffsets.cols());
+		points_around_start.noalias() = transformation_matrix_start * context.startOffsets;
+		points_around_goal.noalias() = transformation_matrix_goal * context.goalOffsets;
+
+		int blocked = context.corridor_rays.findBlocked(input.octree, points_around_start, points_around_goal, context.leaf_cache);
 		int id_marker = 100;
-		for (int i = 0; i < points_around_start.cols(); ++i)
-		{
-			// start_point.x = startOffsets(0, i);
-			// start_point.y = startOffsets(1, i);
-			// start_point.z = startOffsets(2, i);
-   //  		rviz_interface::build_sphere_basic(start_point, marker_array, "start_matrix", 1, 0, 0, 60+i);
-			// end_point.x = goalOffsets(0, i);
-			// end_point.y = goalOffsets(1, i);
-			// end_point.z = goalOffsets(2, i);
-   //  		rviz_interface::build_sphere_basic(end_point, marker_array, "end_matrix", 0, 0, 1, 80+i);
-
-			temp_start = octomath::Vector3(points_around_start(0, i), points_around_start(1, i), points_around_start(2, i));
-			temp_goal = octomath::Vector3(points_around_goal(0, i), points_around_goal(1, i), points_around_goal(2, i));
-
-			if(hasLineOfSight( InputData( input.octree, temp_start, temp_goal, input.margin)) == false) 
-			{ 
-				// ROS_ERROR_STREAM (  " Start " << input.start << " to " << input.goal << "   Found obstacle from " << temp_start << " to " << temp_goal );
-				obstacle_hit_count++;
-				if(publish_input.publish) 
-				{
-					rviz_interface::publish_arrow_path_occupancyState(temp_start, temp_goal, marker_array, false, id_marker+i);
-					publish_input.marker_pub.publish(marker_array);
-				}
-				return CellStatus::kOccupied; 
-			}   
-			else if(hasLineOfSight( InputData(input.octree, temp_goal, temp_start, input.margin)) == false) 
-			{ 
-				// ROS_ERROR_STREAM (  " Start " << input.start << " to " << temp_goal << "   Found obstacle from " << temp_start << " to " << temp_goal );
-    			if(publish_input.publish) 
-				{
-					rviz_interface::publish_arrow_path_occupancyState(temp_start, temp_goal, marker_array, false, id_marker+i);
-					publish_input.marker_pub.publish(marker_array);
-				}
-				obstacle_hit_count++;
-				return CellStatus::kOccupied; 
-			}   
-			else
+		if(blocked >= 0)
+		{
+			// ROS_ERROR_STREAM (  " Start " << input.start << " to " << input.goal << "   Found obstacle between offsets " << blocked );
+			context.obstacle_hit_count++;
+			if(publish_input.publish) 
 			{
-    			if(publish_input.publish) rviz_interface::publish_arrow_path_occupancyState(temp_start, temp_goal, marker_array, true, id_marker+i);
-				// ROS_INFO_STREAM (  " Start " << input.start << " to " << input.goal << "   Free from " << temp_start << " to " << temp_goal );
+				octomath::Vector3 temp_start (points_around_start(0, blocked), points_around_start(1, blocked), points_around_start(2, blocked));
+				octomath::Vector3 temp_goal (points_around_goal(0, blocked), points_around_goal(1, blocked), points_around_goal(2, blocked));
+				rviz_interface::publish_arrow_path_occupancyState(temp_start, temp_goal, marker_array, false, id_marker+blocked);
+				publish_input.marker_pub.publish(marker_array);
 			}
+			return CellStatus::kOccupied; 
+		}
+		if(publish_input.publish)
+		{
+			for (int i = 0; i < points_around_start.cols(); ++i)
+			{
+				octomath::Vector3 temp_start (points_around_start(0, i), points_around_start(1, i), points_around_start(2, i));
+				octomath::Vector3 temp_goal (points_around_goal(0, i), points_around_goal(1, i), points_around_goal(2, i));
+				rviz_interface::publish_arrow_path_occupancyState(temp_start, temp_goal, marker_array, true, id_marker+i);
+			}
+			publish_input.marker_pub.publish(marker_array);
 		}
-		if(publish_input.publish) publish_input.marker_pub.publish(marker_array);
 		return CellStatus::kFree; 
 	}
 
+	// The distance field when it can answer, otherwise the check chosen by the context
+	CellStatus getCorridorOccupancy(
+		PlannerContext & context,
+		InputData const& input,
+		rviz_interface::PublishingInput const& publish_input) 
+	{
+		if(distanceFieldApplies(context, input))
+		{
+			return getCorridorOccupancy_byDistanceField(context, input, publish_input);
+		}
+		context.leaf_cache.useMap(context.map_sequence);
+		if(context.corridor_check == kCorridorBySweep)
+		{
+			return getCorridorOccupancy_bySweep(context, input, publish_input);
+		}
+		return getCorridorOccupancy_byPlanes(context, input, publish_input);
+	}
+
+	// Tells the corridors checked on the distance field apart in corridorShapeId, next to the values of CorridorCheck
+	const uint64_t kCorridorByDistanceField = 2;
+
+	// The distance field and the sweep do not depend on the offsets, their results are kept apart from theirs and
+	// from each other. Both depend on corridor_unknown_as_occupied.
+	uint64_t corridorShapeId(PlannerContext const& context, InputData const& input)
+	{
+		uint64_t unknown_bit = context.corridor_unknown_as_occupied ? 1 << 8 : 0;
+		if(distanceFieldApplies(context, input))
+		{
+			return CorridorKeyHash::mix( context.offsets_shape_id ^ kCorridorByDistanceField ^ unknown_bit );
+		}
+		if(context.corridor_check == kCorridorBySweep)
+		{
+			return CorridorKeyHash::mix( context.offsets_shape_id ^ kCorridorBySweep ^ unknown_bit );
+		}
+		return context.offsets_shape_id;
+	}
+
 
 	// Take heed all those who enter here!
 	// If the shape around the start is different from the shape around the end, 
 	// the order to evaluate line of sight is parent -> s -> neighbor
 	// ortherwise path 2 will not fallback on path 1 when needed 
 	// (the line of sight from start to end is not the same as from end to start)
+	// Results are kept in corridor_cache, a corridor that was already checked is not drawn again when publishing.
 	bool is_flight_corridor_free(InputData const& input, rviz_interface::PublishingInput const& publish_input)
 	{
+		return is_flight_corridor_free(default_planner_context, input, publish_input);
+	}
+
+	bool is_flight_corridor_free(PlannerContext & context, InputData const& input, rviz_interface::PublishingInput const& publish_input)
+	{
+		CorridorKey key (input.start, input.goal, input.margin, corridorShapeId(context, input), context.corridor_cache.mapVersion(context.map_sequence));
+		bool free;
+		if(context.corridor_cache.find(key, free))
+		{
+			return free;
+		}
 		// auto start_count = std::chrono::high_resolution_clock::now();
-		bool free = getCorridorOccupancy_byPlanes(input, publish_input) == CellStatus::kFree; 
+		free = getCorridorOccupancy(context, input, publish_input) == CellStatus::kFree; 
 		// auto finish_count = std::chrono::high_resolution_clock::now();
 		// auto time_span = finish_count - start_count;
-		// obstacle_avoidance_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
-		obstacle_avoidance_calls ++;
+		// context.obstacle_avoidance_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
+		context.obstacle_avoidance_calls ++;
+		context.corridor_cache.insert(key, free);
 		return free;
 	}
 
+	bool corridorHasLineOfSight(PlannerContext const& context, InputData const& input)
+	{
+		if(distanceFieldApplies(context, input))
+		{
+			return context.distance_field->corridorFree(input.start, input.goal, input.margin, context.corridor_unknown_as_occupied);
+		}
+		// The sweep, rays and leafs of the context belong to the search thread
+		LeafCache leaf_cache;
+		if(context.corridor_check == kCorridorBySweep)
+		{
+			SweptVolume sweep;
+			octomap::OcTreeKey blocking_key;
+			return sweep.findBlocked(input.octree, input.start, input.goal, SweptVolume::kCapsule, input.margin / 2, context.corridor_unknown_as_occupied, leaf_cache, blocking_key) == SweptVolume::kSweepFree;
+		}
+		CoordinateFrame coordinate_frame = generateCoordinateFrame(input.start, input.goal);
+		Eigen::Matrix4d transformation_matrix_start = generateRotationTranslationMatrix(coordinate_frame, input.start);
+		Eigen::Matrix4d transformation_matrix_goal = generateRotationTranslationMatrix(coordinate_frame, input.goal);
+		CorridorPoints points_around_start = transformation_matrix_start * context.startOffsets;
+		CorridorPoints points_around_goal = transformation_matrix_goal * context.goalOffsets;
+		CorridorRays rays;
+		return rays.findBlocked(input.octree, points_around_start, points_around_goal, leaf_cache) < 0;
+	}
+
+	void setCorridorThreads(PlannerContext & context, int thread_count)
+	{
+		if(thread_count <= 1)
+		{
+			context.corridor_pool.reset();
+		}
+		else if(!context.corridor_pool || context.corridor_pool->threadCount() != (unsigned int)thread_count)
+		{
+			// The search thread takes part, so one worker less
+			context.corridor_pool.reset( new WorkStealingPool(thread_count - 1) );
+		}
+	}
+
+	void setCorridorThreads(int thread_count)
+	{
+		setCorridorThreads(default_planner_context, thread_count);
+	}
+
+	// Corridor flown along the edge between a node of a search tree and its child. The backward tree of
+	// lazyThetaStarBidirectional_ grows from the goal, its edges are flown from child to parent.
+	InputData treeEdge(octomap::OcTree const& octree, double safety_margin, octomath::Vector3 const& parent, octomath::Vector3 const& child, bool backward)
+	{
+		if(backward)
+		{
+			return InputData(octree, child, parent, safety_margin);
+		}
+		return InputData(octree, parent, child, safety_margin);
+	}
+
+	// Replaces neighbors with the ones of s, taken from context.leaf_graph when it belongs to the map of the context and has s
+	void generateNeighbors(PlannerContext const& context, NeighborSet & neighbors, ThetaStarNode const& s, octomap::OcTree const& octree)
+	{
+		neighbors.clear();
+		if(context.leaf_graph && context.leaf_graph->builtFor(context.map_sequence) && context.leaf_graph->neighborsOf(s.voxel_id, neighbors))
+		{
+			return;
+		}
+		generateNeighbors_keys(neighbors, s.voxel_id, octree);
+	}
+
+	enum NeighborCorridor { kCorridorSkipped = 0, kCorridorFree = 1, kCorridorBlocked = 2 };
+
+	// Fills workspace.neighbor_corridors for the current neighbors of s.
+	// Neighbors already in closed are skipped, the rest come from corridor_cache or are checked on the corridor_pool of context.
+	// Counters and cache are only touched from this thread, so the outcome is the same as checking one by one.
+	void checkNeighborCorridors(PlannerContext & context, SearchWorkspace & workspace, InputData const& input, octomath::Vector3 const& s_coordinates, bool backward)
+	{
+		CorridorCache & corridor_cache = context.corridor_cache;
+		NeighborSet const& neighbors = workspace.neighbors;
+		std::vector<char> & status = workspace.neighbor_corridors;
+		std::vector<std::size_t> & pending = workspace.pending_corridors;
+		status.assign(neighbors.size(), kCorridorSkipped);
+		pending.clear();
+		uint64_t map_version = corridor_cache.mapVersion(context.map_sequence);
+		// Every edge has the margin of input
+		uint64_t shape_id = corridorShapeId(context, input);
+		for (std::size_t i = 0; i < neighbors.size(); ++i)
+		{
+			NeighborSet::value_type const& neighbor = *(neighbors.begin() + i);
+			if(workspace.closed.contains(neighbor.first))
+			{
+				continue;
+			}
+			bool free;
+			InputData edge = treeEdge(input.octree, input.margin, s_coordinates, neighbor.second, backward);
+			if(corridor_cache.find( CorridorKey(edge.start, edge.goal, input.margin, shape_id, map_version), free))
+			{
+				status[i] = free ? kCorridorFree : kCorridorBlocked;
+			}
+			else
+			{
+				pending.push_back(i);
+			}
+		}
+		context.corridor_pool->parallelFor(pending.size(), [&](std::size_t k)
+		{
+			octomath::Vector3 const& n_coordinates = (neighbors.begin() + pending[k])->second;
+			status[pending[k]] = corridorHasLineOfSight( context, treeEdge(input.octree, input.margin, s_coordinates, n_coordinates, backward) ) ? kCorridorFree : kCorridorBlocked;
+		});
+		for (std::size_t position : pending)
+		{
+			bool free = status[position] == kCorridorFree;
+			context.obstacle_avoidance_calls ++;
+			if(!free)
+			{
+				context.obstacle_hit_count++;
+			}
+			InputData edge = treeEdge(input.octree, input.margin, s_coordinates, (neighbors.begin() + position)->second, backward);
+			corridor_cache.insert( CorridorKey(edge.start, edge.goal, input.margin, shape_id, map_version), free);
+		}
+	}
+
 	
 	/**
 	 * @brief      Set vertex portion of pseudo code, ln 34.
@@ -291,16 +539,22 @@ namespace LazyThetaStarOctree{
 	 * @param      closed     The closed
 	 * @param      open       The open
 	 * @param[in]  neighbors  The neighbors
+	 *
+	 * @param[in]  backward   s belongs to the tree grown from the goal
+	 *
+	 * @return     False if, with lazy_edge_evaluation, s is not visible from its parent nor from any expanded neighbor
 	 */
 	bool setVertex(
+		PlannerContext 											& 		context,
 		octomap::OcTree 										const& 	octree, 
-		std::shared_ptr<ThetaStarNode> 							& 		s, 
-		std::unordered_map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, Vector3Hash, VectorComparatorEqual> &  closed,
+		ThetaStarNode 											* 		s, 
+		VoxelIdMap<ThetaStarNode*> 								&  		closed,
 		Open 													& 		open, 
 		unordered_set_pointers 									const& 	neighbors,
 		double 															safety_margin,
 		rviz_interface::PublishingInput 										const& 	publish_input,
-		const double 													sidelength_lookup_table[])	
+		const double 													sidelength_lookup_table[],
+		bool 															backward)	
 	{
 		auto start_count = std::chrono::high_resolution_clock::now();
 
@@ -311,7 +565,7 @@ namespace LazyThetaStarOctree{
 		// //  -> will leave this for if implementation is not fast enough
 		// ln 35 if NOT lineofsight(parent(s), s) then
 		// Path 1 by considering the path from s_start to each expanded visible neighbor s′′ of s′
-		if(    !is_flight_corridor_free( InputData( octree, *(s->parentNode->coordinates), *(s->coordinates), safety_margin ), publish_input )   )
+		if(    !is_flight_corridor_free( context, treeEdge( octree, safety_margin, *(s->parentNode->coordinates), *(s->coordinates), backward ), publish_input )   )
 		{
 			// g(s)		= length of the shortest path from the start vertex to s found so far.
 			// c(s,s') 	= straight line distance between vertices s and s'	
@@ -319,7 +573,7 @@ namespace LazyThetaStarOctree{
 			// ln 37 parent(s) := argmin_(s' € (nghb_vis  intersection  closed)_) evaluating ( g(s') + c(s', s) );
 			// ln 38 g(s) := min_s'€ngbr_vis(s) intersection closed ( g(s') + c(s', s) );
 			double min_g = std::numeric_limits<double>::max();
-			std::shared_ptr<ThetaStarNode> candidate_parent;
+			ThetaStarNode* candidate_parent = NULL;
 			bool new_parent_node = false;
 			if(neighbors.empty())
 			{
@@ -327,66 +581,71 @@ namespace LazyThetaStarOctree{
 				return true;
 			}
 			// each expanded & visible & neighbor of s'
-			for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)																	// NEIGHBOR
+			for(auto const& neighbor : neighbors)																	// NEIGHBOR
 			{
-				try
+				octomath::Vector3 const& n_coordinates = neighbor.second;
+				// Here the rule parent -> s -> neighbor for line of sight is not followed
+				// Because when we are looking for path 1, we are replicating the test that was made to do open.insert
+				//     at this point the neighbor was the current s
+				if( ! is_flight_corridor_free( context, treeEdge( octree, safety_margin, n_coordinates, *(s->coordinates), backward ), publish_input) )
 				{
-					// Here the rule parent -> s -> neighbor for line of sight is not followed
-					// Because when we are looking for path 1, we are replicating the test that was made to do open.insert
-					//     at this point the neighbor was the current s
-					if( ! is_flight_corridor_free( InputData( octree, *n_coordinates, *(s->coordinates), safety_margin ), publish_input) )
-					{
-						// auto res_node = octree.search(*n_coordinates);
-						// if(res_node == NULL)
-						// {
-	     				// 	throw std::out_of_range("Skipping cases where unknown neighbors are found.");
-						// }
-						// log_file << "[SetVertex] no line of sight " << *(s->coordinates) << " to " << *n_coordinates << std::endl;
-						continue;
-					}
-					// else
+					// auto res_node = octree.search(*n_coordinates);
+					// if(res_node == NULL)
 					// {
-					// 	log_file << "[SetVertex] visible neighbor " << *n_coordinates << std::endl;
+	     				// 	throw std::out_of_range("Skipping cases where unknown neighbors are found.");
 					// }
+					// log_file << "[SetVertex] no line of sight " << *(s->coordinates) << " to " << *n_coordinates << std::endl;
+					continue;
+				}
+				// else
+				// {
+				// 	log_file << "[SetVertex] visible neighbor " << *n_coordinates << std::endl;
+				// }
 
 
-					// VISIBLE
-					// closed.at(*n_coordinates) throws exception when there is no such element
-					std::shared_ptr<ThetaStarNode> neighbor_in_closed = closed.at(*n_coordinates);  											// EXPANDED
-					double candidate_g = neighbor_in_closed->distanceFromInitialPoint;
-					double c_distance_beetween_s_and_candidate = weightedDistance(  *(neighbor_in_closed->coordinates), *(s->coordinates)  );
-					// ln 38 (...) g(s') + c(s', s)
-					if(   (candidate_g + c_distance_beetween_s_and_candidate) < min_g    )
-					{
-						// ROS_WARN_STREAM(std::setprecision(10) << "[SetVer] " << candidate_g << " + " << c_distance_beetween_s_and_candidate << " - " << min_g 
-						// 	<< " ==> " <<  (candidate_g + c_distance_beetween_s_and_candidate) - min_g << " > " << scale);
-						// ROS_WARN_STREAM("[SetVer] Previous best value " << min_g << " with parent " << s->parentNode << ": " << *(s->parentNode));
-						min_g = candidate_g + c_distance_beetween_s_and_candidate;
-						candidate_parent = neighbor_in_closed;
-						new_parent_node = true;
-						// ROS_WARN_STREAM("[SetVer] " << neighbor_in_closed << "  ==>  Min_G:" << min_g << " = " << candidate_g << " + " << c_distance_beetween_s_and_candidate);
-						// ROS_WARN_STREAM("[SetVer] " << neighbor_in_closed << ": " << *neighbor_in_closed << "  ==>  ");
-						// ROS_WARN_STREAM("[SetVer]  Min_G:" << candidate_g << " from start to " << *(neighbor_in_closed->coordinates) );
-						// ROS_WARN_STREAM("[SetVer]  c    :" << c_distance_beetween_s_and_candidate << " from " << *(neighbor_in_closed->coordinates) << " to " << *(s->coordinates)   );
-					}
+				// VISIBLE
+				ThetaStarNode** found_in_closed = closed.find(neighbor.first);
+				if(found_in_closed == NULL)
+				{
+					// ROS_WARN_STREAM("[N] " << n_coordinates << " is unknown space.");
+					continue;
 				}
-				catch(const std::out_of_range& oor)
+				ThetaStarNode* neighbor_in_closed = *found_in_closed;  											// EXPANDED
+				double candidate_g = neighbor_in_closed->distanceFromInitialPoint;
+				double c_distance_beetween_s_and_candidate = weightedDistance(  *(neighbor_in_closed->coordinates), *(s->coordinates)  );
+				// ln 38 (...) g(s') + c(s', s)
+				if(   (candidate_g + c_distance_beetween_s_and_candidate) < min_g    )
 				{
-					// ROS_WARN_STREAM("[N] " << *n_coordinates << " is unknown space.");
-				} // closed.at(*n_coordinates) throws exception when there is no such element
+					// ROS_WARN_STREAM(std::setprecision(10) << "[SetVer] " << candidate_g << " + " << c_distance_beetween_s_and_candidate << " - " << min_g 
+					// 	<< " ==> " <<  (candidate_g + c_distance_beetween_s_and_candidate) - min_g << " > " << scale);
+					// ROS_WARN_STREAM("[SetVer] Previous best value " << min_g << " with parent " << s->parentNode << ": " << *(s->parentNode));
+					min_g = candidate_g + c_distance_beetween_s_and_candidate;
+					candidate_parent = neighbor_in_closed;
+					new_parent_node = true;
+					// ROS_WARN_STREAM("[SetVer] " << neighbor_in_closed << "  ==>  Min_G:" << min_g << " = " << candidate_g << " + " << c_distance_beetween_s_and_candidate);
+					// ROS_WARN_STREAM("[SetVer] " << neighbor_in_closed << ": " << *neighbor_in_closed << "  ==>  ");
+					// ROS_WARN_STREAM("[SetVer]  Min_G:" << candidate_g << " from start to " << *(neighbor_in_closed->coordinates) );
+					// ROS_WARN_STREAM("[SetVer]  c    :" << c_distance_beetween_s_and_candidate << " from " << *(neighbor_in_closed->coordinates) << " to " << *(s->coordinates)   );
+				}
 			}
 			if(new_parent_node)
 			{
 				// ROS_WARN_STREAM("[SetVer] For " << s << ": " << *s << " parent will now be " << candidate_parent << ": " << *candidate_parent);
 				// There is a parent for path 1
 				s->parentNode = candidate_parent;
-				open.changeDistanceFromInitialPoint(min_g, s);
+				// s was popped already, open has nothing to reorder, only g(s) changes
+				s->distanceFromInitialPoint = min_g;
+			}
+			else if(context.lazy_edge_evaluation)
+			{
+				// s was inserted without checking the corridor and no expanded node can reach it, it is dropped
+				return false;
 			}
 			else
 			{
 				std::ostringstream oss;
 				oss << "s node " << *(s->coordinates) << " has no line of sight with the current parent " << *(s->parentNode->coordinates) << "(path 2)  and node of the neighbors are visible either (path 1). ";
-				log_file << oss.str() << std::endl;
+				context.log_file << oss.str() << std::endl;
 				oss << "No path 1 was found, adding to closed a bad node  ";
 				octree.writeBinaryConst(folder_name + "/out_of_range_.bt");
 				throw std::out_of_range( oss.str() );
@@ -398,7 +657,7 @@ namespace LazyThetaStarOctree{
 
 		auto finish_count = std::chrono::high_resolution_clock::now();
 		auto time_span = finish_count - start_count;
-		setVertex_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
+		context.setVertex_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
 		return true;
 	}
 
@@ -411,13 +670,12 @@ namespace LazyThetaStarOctree{
 	 *
 	 * @return     true is a path from goal node until start node was found (under 500 jumps). False otherwise.
 	 */
-	bool extractPath(std::list<octomath::Vector3> & path, ThetaStarNode const& start, ThetaStarNode & end, bool writeToFile)
+	bool extractPath(PlannerContext & context, std::list<octomath::Vector3> & path, ThetaStarNode const& start, ThetaStarNode & end, bool writeToFile)
 	{
 		bool success = true;
 		std::ofstream pathWaypoints;
         pathWaypoints.open (folder_name + "/current/final_path.txt", std::ofstream::out | std::ofstream::app);
-		std::shared_ptr<ThetaStarNode> current = std::make_shared<ThetaStarNode>(end);
-		std::shared_ptr<ThetaStarNode> parentAdd;
+		ThetaStarNode const* current = &end;
 		int safety_count = 0;
 		int max_steps_count = 50;
 		while(   !( *(current->coordinates) == *(start.coordinates) ) 
@@ -425,7 +683,7 @@ namespace LazyThetaStarOctree{
 		{
 			if( current->parentNode == NULL )
 			{
-				log_file << "[ERROR]  The node with no parent is " << *current << std::endl;
+				context.log_file << "[ERROR]  The node with no parent is " << *current << std::endl;
 				ROS_ERROR_STREAM("The node with no parent is " << *current);
 				return false;
 			}
@@ -437,12 +695,11 @@ namespace LazyThetaStarOctree{
 				// writeToFileWaypoint(*(current->coordinates), current->cell_size, folder_name + "/final_path.txt");
         		pathWaypoints << std::setprecision(5) << current->coordinates->x() << ", " << current->coordinates->y() << ", " << current->coordinates->z() << ", " << current->cell_size << std::endl;
 			}
-			parentAdd = current->parentNode;
-			current = parentAdd;
+			current = current->parentNode;
 			safety_count++;
 			if(safety_count >= max_steps_count)
 			{
-				log_file << "[ERROR]  Possible recursion in generated path detected while extracted path. Full path trunkated at node "<< max_steps_count << std::endl;
+				context.log_file << "[ERROR]  Possible recursion in generated path detected while extracted path. Full path trunkated at node "<< max_steps_count << std::endl;
 				ROS_ERROR_STREAM("Possible recursion in generated path detected while extracted path. Full path trunkated at node "<< max_steps_count);
 				success = false;
 				break;
@@ -467,11 +724,11 @@ namespace LazyThetaStarOctree{
 	 *
 	 * @return     the new cost
 	 */
-	float CalculateCost(ThetaStarNode const& s, ThetaStarNode const& s_neighbour)
+	float CalculateCost(PlannerContext & context, ThetaStarNode const& s, ThetaStarNode const& s_neighbour)
 	{ 
 		if(s.parentNode == NULL)
 		{
-			log_file << "[ERROR] Parent node of s (" << s << ") is null. @ CalculateCost" << std::endl;
+			context.log_file << "[ERROR] Parent node of s (" << s << ") is null. @ CalculateCost" << std::endl;
 			ROS_ERROR_STREAM("Parent node of s (" << s << ") is null. @ CalculateCost");
 		}
 		float g_parent_s =  s.parentNode->distanceFromInitialPoint;
@@ -484,7 +741,7 @@ namespace LazyThetaStarOctree{
 
 	// s' == s_neighbour
 	// ln 20 UpdateVertex(s, s')
-	void UpdateVertex(ThetaStarNode const& s, std::shared_ptr<ThetaStarNode> s_neighbour,
+	void UpdateVertex(PlannerContext & context, ThetaStarNode const& s, ThetaStarNode* s_neighbour,
 		Open & open)
 	{ 
 		auto start_count = std::chrono::high_resolution_clock::now();
@@ -495,12 +752,12 @@ namespace LazyThetaStarOctree{
 		// ln 22 ComputeCost(s, s'); (unrolled de function into UpdatedVertex)
 		// ln 29 /* Path 2 */
 		// ln 30 if  g(parent(s)) + c(parent(s), s') < g(s')  then
-		float cost = CalculateCost(s, *s_neighbour);
+		float cost = CalculateCost(context, s, *s_neighbour);
 		// ROS_WARN_STREAM("if(cost < g_old) <=> " << cost << " < " << g_old);
 		if(cost < g_old)
 		{
 			// ln 24 if s' € open then
-			if(   open.existsInMap( *(s_neighbour->coordinates) )   )
+			if(   open.existsInMap( s_neighbour->voxel_id )   )
 			{
 				// ln 25 open.Remove(s')
 				open.erase(*s_neighbour);
@@ -516,7 +773,7 @@ namespace LazyThetaStarOctree{
 		}
 		auto finish_count = std::chrono::high_resolution_clock::now();
 		auto time_span = finish_count - start_count;
-		updateVertex_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
+		context.updateVertex_time += std::chrono::duration_cast<std::chrono::microseconds>(time_span).count();
 	}
 
 	bool isExplored(octomath::Vector3 const& grid_coordinates_toTest, octomap::OcTree const& octree)
@@ -533,6 +790,87 @@ namespace LazyThetaStarOctree{
 
 
 
+	/**
+	 * @brief      Closes s and updates its visible neighbors, ln 11 to ln 17 of the pseudo code.
+	 *             The neighbors of the workspace must be the ones of s.
+	 *
+	 * @param      workspace         The tree s belongs to
+	 * @param      input             The goal is where the tree is heading, the start and goal of the backward tree are swapped
+	 * @param      heuristic_weight  Multiplies h of the new nodes, 0 for searches without a single goal
+	 */
+	void expandVertex(PlannerContext & context, SearchWorkspace & workspace, InputData const& input, ThetaStarNode* s, double heuristic_weight, bool backward, rviz_interface::PublishingInput const& publish_input, const double sidelength_lookup_table[])
+	{
+		Open & open = workspace.open;
+		VoxelIdMap<ThetaStarNode*> & closed = workspace.closed;
+		unordered_set_pointers & neighbors = workspace.neighbors;
+		ThetaStarNode* s_neighbour = NULL;
+		// ln 11 closed := closed U {s}
+		// log_file << "@"<< used_search_iterations << "  inserting s into closed " << s << " <--> " << *s << std::endl;
+		closed.insert(s->voxel_id, s);
+		if(context.corridor_pool && !context.lazy_edge_evaluation)
+		{
+			checkNeighborCorridors(context, workspace, input, *(s->coordinates), backward);
+		}
+
+		// TODO check code repetition to go over the neighbors of s
+		double cell_size = 0;
+		std::size_t neighbor_index = 0;
+		// ln 12 foreach s' € nghbr_vis(s) do
+		for(auto const& neighbor : neighbors)
+		{
+			octomath::Vector3 const& n_coordinates = neighbor.second;
+			// Find minimum value for those with visibility and that it is in closed
+            int depth = neighbor.first.depth();
+            cell_size = findSideLenght(input.octree.getTreeDepth(), depth, sidelength_lookup_table);
+
+			bool corridor_free;
+			if(context.lazy_edge_evaluation)
+			{
+				// Optimistic, checked by setVertex if s' is ever expanded
+				corridor_free = true;
+			}
+			else if(context.corridor_pool)
+			{
+				corridor_free = workspace.neighbor_corridors[neighbor_index] == kCorridorFree;
+			}
+			else
+			{
+				corridor_free = is_flight_corridor_free( context, treeEdge(input.octree, input.margin, *(s->coordinates), n_coordinates, backward), publish_input);
+			}
+			++neighbor_index;
+			if( ! corridor_free )
+			{
+				// log_file << "  [N] " << n_coordinates << " has obstacle." << std::endl;
+				continue;
+			}
+			// ln 13 if s' !€ closed then
+			bool is_neighbor_in_closed = closed.contains(neighbor.first);
+			if (!is_neighbor_in_closed)
+			{
+				// ln 14 if s' !€ open then
+				if( !open.existsInMap(neighbor.first) )
+				{
+					// ln 15 g(s') := infinity;
+					double g_distanceFromInitialPoint = std::numeric_limits<double>::max();
+					// ln 16 parent(s') := NULL;
+					s_neighbour = workspace.newNode(
+						neighbor.first,
+						n_coordinates, 
+						cell_size, 
+						g_distanceFromInitialPoint, 
+						heuristic_weight * weightedDistance( n_coordinates, input.goal) // lineDistanceToFinalPoint
+						);
+				}
+				else
+				{
+					s_neighbour =  open.getFromMap(neighbor.first);
+				}
+				// ln 17 UpdateVertex(s, s');
+				UpdateVertex(context, *s, s_neighbour, open);
+			}
+		}
+	}
+
 	// TODO 	When making objects out of this, the things that can be set on algorithm configuration are 
 	// 			sidelength_lookup_table, startOffsets and goalOffsets
 	// h(s)		= straight line distance between goal and s vertex
@@ -541,31 +879,132 @@ namespace LazyThetaStarOctree{
 	// c(s,s') 	= straight line distance between vertices s and s'
 	// g(s)		= length of the shortest path from the start vertex to s found so far.
 	// nghbrvis(s) in V 	= set of neighbors of vertex s in V that have line-of-sight to s
+	std::list<octomath::Vector3> lazyThetaStar_(
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		int const& max_time_secs,
+		bool print_resulting_path)
+	{
+		return lazyThetaStar_(default_planner_context, input, resultSet, sidelength_lookup_table, publish_input, max_time_secs, print_resulting_path);
+	}
+
+	// Length of the path through its waypoints
+	double pathLength(std::list<octomath::Vector3> const& path)
+	{
+		double length = 0;
+		for (std::list<octomath::Vector3>::const_iterator previous = path.begin(), current = path.begin(); current != path.end(); previous = current++)
+		{
+			length += weightedDistance(*previous, *current);
+		}
+		return length;
+	}
+
+	std::list<octomath::Vector3> lazyThetaStar_(
+		PlannerContext & context,
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		int const& max_time_secs,
+		bool print_resulting_path)
+	{
+		auto search = [&](double time_secs, double weight)
+		{
+			if(context.bidirectional)
+			{
+				return lazyThetaStarBidirectional_(context, input, resultSet, sidelength_lookup_table, publish_input, time_secs, weight, print_resulting_path);
+			}
+			return lazyThetaStarWeighted_(context, input, resultSet, sidelength_lookup_table, publish_input, time_secs, weight, print_resulting_path);
+		};
+		if(context.anytime_initial_weight <= 1)
+		{
+			std::list<octomath::Vector3> path = search(max_time_secs, 1);
+			context.suboptimality_bound = path.empty() ? 0 : 1;
+			return path;
+		}
+		// Anytime: restart with a smaller weight while there is time left, keep the shortest path found
+		auto start = std::chrono::high_resolution_clock::now();
+		std::list<octomath::Vector3> best_path;
+		double best_length = std::numeric_limits<double>::max();
+		double weight = context.anytime_initial_weight;
+		int iterations_used = 0;
+		context.suboptimality_bound = 0;
+		while(true)
+		{
+			std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+			double remaining_secs = max_time_secs - elapsed.count();
+			if(remaining_secs <= 0)
+			{
+				break;
+			}
+			std::list<octomath::Vector3> path = search(remaining_secs, weight);
+			iterations_used += resultSet.iterations_used;
+			if(path.empty() || context.cancelled)
+			{
+				// Out of time, cancelled or there is no path at all
+				break;
+			}
+			double length = pathLength(path);
+			if(length < best_length)
+			{
+				best_path.swap(path);
+				best_length = length;
+			}
+			// Every path found so far is at least as short as the one of this weight
+			context.suboptimality_bound = weight;
+			// Each search closes the log when publishing, the anytime lines go to the same file
+			if(!context.log_file.is_open())
+			{
+				context.log_file.open(folder_name + "/current/" + context.log_name + ".log", std::ios_base::app);
+			}
+			context.log_file << "[LTStar] Anytime weight " << weight << " path length " << length << ", best " << best_length << " after " << elapsed.count() << " s" << std::endl;
+			if(weight <= 1)
+			{
+				break;
+			}
+			weight = std::max(1.0, weight - context.anytime_weight_step);
+		}
+		if(publish_input.publish)
+		{
+			context.log_file.close();
+		}
+		resultSet.iterations_used = iterations_used;
+		return best_path;
+	}
+
 	/**
-	 * @brief      Lazy Theta Star. Decimal precision in 0.001 both in closed and in open (buildKey)
+	 * @brief      Lazy Theta Star. Both closed and open are keyed by the VoxelId of each cell
 	 *
+	 * @param      context       Offsets, caches, statistics and log of this search. Its workspace is reset at the beginning and at the end
 	 * @param      octree        The octree
 	 * @param      disc_initial  The disc initial
 	 * @param      disc_final    The disc final
+	 * @param      heuristic_weight  Multiplies h, above 1 the path found can be that many times longer than with 1
 	 *
 	 * @return     A list of the ordered waypoints to get from initial to final
 	 */
-	std::list<octomath::Vector3> lazyThetaStar_(
+	std::list<octomath::Vector3> lazyThetaStarWeighted_(
+		PlannerContext & context,
 		InputData const& input,
 		ResultSet & resultSet,
 		const double sidelength_lookup_table[],
 		rviz_interface::PublishingInput const& publish_input,
-		int const& max_time_secs,
+		double max_time_secs,
+		double heuristic_weight,
 		bool print_resulting_path)
 	{
-		obstacle_hit_count = 0;
+		SearchWorkspace & workspace = context.workspace;
+		std::ofstream & log_file = context.log_file;
+		context.resetStatistics();
 		int generate_neighbors_time = 0;
-		obstacle_avoidance_time = 0;
-		obstacle_avoidance_calls = 0;
-		setVertex_time = 0;
-		updateVertex_time = 0;
+		workspace.reset();
 
-    	log_file.open(folder_name + "/current/lazyThetaStar.log", std::ios_base::app);
+		if(!log_file.is_open())
+		{
+	    	log_file.open(folder_name + "/current/" + context.log_name + ".log", std::ios_base::app);
+		}
 		auto start = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<double> max_search_time = std::chrono::duration<double>(max_time_secs);
 		std::list<octomath::Vector3> path;
@@ -588,14 +1027,14 @@ namespace LazyThetaStarOctree{
 		// Init initial and final nodes to have the coordinates of respective cell centers
 		double cell_size_goal = -1;
 		octomath::Vector3 cell_center_coordinates_goal = input.goal;
-		updateToCellCenterAndFindSize( cell_center_coordinates_goal, input.octree, cell_size_goal, sidelength_lookup_table);
-		std::shared_ptr<ThetaStarNode> disc_final_cell_center = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3>(cell_center_coordinates_goal), cell_size_goal);
-		disc_final_cell_center->lineDistanceToFinalPoint = weightedDistance(cell_center_coordinates_goal, input.goal);
+		VoxelId voxel_id_goal = updateToCellCenterAndFindSize( cell_center_coordinates_goal, input.octree, cell_size_goal, sidelength_lookup_table);
+		ThetaStarNode disc_final_cell_center (voxel_id_goal, &cell_center_coordinates_goal, cell_size_goal);
+		disc_final_cell_center.lineDistanceToFinalPoint = weightedDistance(cell_center_coordinates_goal, input.goal);
 		// START
 		// Get distance from start to cell center
 		octomath::Vector3 cell_center_coordinates_start = input.start;
 		double cell_size_start = -1;
-		updateToCellCenterAndFindSize(cell_center_coordinates_start, input.octree, cell_size_start, sidelength_lookup_table);
+		VoxelId voxel_id_start = updateToCellCenterAndFindSize(cell_center_coordinates_start, input.octree, cell_size_start, sidelength_lookup_table);
 
 		if(publish_input.publish)
 		{
@@ -638,16 +1077,18 @@ namespace LazyThetaStarOctree{
 
 		// ln 1 Main()
 		// ln 2 open := closed := 0
-		Open open (cell_center_coordinates_goal);
-		std::unordered_map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, Vector3Hash, VectorComparatorEqual> closed;
+		Open & open = workspace.open;
+		open.reset(cell_center_coordinates_goal);
+		VoxelIdMap<ThetaStarNode*> & closed = workspace.closed;
+		unordered_set_pointers & neighbors = workspace.neighbors;
 
 		// M the starting point is the initial node
 		// [Footnote] open.Insert(s,x) inserts vertex s with key x into open
 		// map open's order = (shortest path from the start vertex to s found so far) + (straight line distance between goal and vertex)
-		std::shared_ptr<ThetaStarNode> disc_initial_cell_center = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3>(cell_center_coordinates_start), cell_size_start, 
+		ThetaStarNode* disc_initial_cell_center = workspace.newNode(voxel_id_start, cell_center_coordinates_start, cell_size_start, 
     		// ln 3 g(s_start) := 0;
 			0, 
-			weightedDistance(cell_center_coordinates_start, input.goal));
+			heuristic_weight * weightedDistance(cell_center_coordinates_start, input.goal));
 	    // ln 4 parent(s_start) := s_start;
 		disc_initial_cell_center->parentNode = disc_initial_cell_center;	// TODO make sure nobody is realing on point pointing to themselves in general
 		// ln 5 open.Insert(s_start, g(s_start) + h(s_start))
@@ -657,13 +1098,13 @@ namespace LazyThetaStarOctree{
 		// 	log_file << "[N]          inserting " << *(disc_initial_cell_center->coordinates) << " into open (start) " << std::endl;
 		// }
 		// ROS_WARN_STREAM("__START__ " << disc_initial_cell_center << ": " << *disc_initial_cell_center);
-		std::shared_ptr<ThetaStarNode> s_neighbour, s, solution_end_node;
+		ThetaStarNode* s = NULL;
+		ThetaStarNode* solution_end_node = NULL;
 		bool solution_found = false;
 		// TODO remove this, for debugging only
 		int used_search_iterations = 0;
 		// ROS_WARN_STREAM("Goal's voxel center " << *disc_final_cell_center);
 		// ln 6 while open != empty do
-		id_unreachable = 0;	
         visualization_msgs::MarkerArray marker_array_closed, marker_array_s;
         int closed_id = 0;
         int s_id = 200;
@@ -685,9 +1126,8 @@ namespace LazyThetaStarOctree{
 			// }
 			s = open.pop();
 			resultSet.addOcurrance(s->cell_size);
-			unordered_set_pointers neighbors;
 			// auto start_count = std::chrono::high_resolution_clock::now();
-			generateNeighbors_filter_pointers(neighbors, *(s->coordinates), s->cell_size, resolution, input.octree);
+			generateNeighbors(context, neighbors, *s, input.octree);
 
 
 			#ifdef RUNNING_ROS
@@ -703,18 +1143,18 @@ namespace LazyThetaStarOctree{
 				// if(neighbors.size() > 100)
 				// {
 					int n_id = 0;
-					for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)
+					for(auto const& neighbor : neighbors)
 					{
-						octomap::OcTreeKey key = input.octree.coordToKey(*n_coordinates);
-			            int depth = getNodeDepth_Octomap(key, input.octree);
+						octomath::Vector3 const& n_coordinates = neighbor.second;
+			            int depth = neighbor.first.depth();
 			            double cell_size = findSideLenght(input.octree.getTreeDepth(), depth, sidelength_lookup_table);
 
 						geometry_msgs::Point neighbor_v;
-						neighbor_v.x = n_coordinates->x();
-						neighbor_v.y = n_coordinates->y();
-						neighbor_v.z = n_coordinates->z();
+						neighbor_v.x = n_coordinates.x();
+						neighbor_v.y = n_coordinates.y();
+						neighbor_v.z = n_coordinates.z();
 						int id =  s_id*1000 + n_id;
-						if( ! is_flight_corridor_free( InputData(input.octree, *(s->coordinates), *n_coordinates, input.margin ), publish_input) )
+						if( ! is_flight_corridor_free( context, InputData(input.octree, *(s->coordinates), n_coordinates, input.margin ), publish_input) )
 						{
 		    				rviz_interface::publish_rejected_neighbor(neighbor_v, publish_input.marker_pub, marker_array_single_loop, id, cell_size);
 							
@@ -737,15 +1177,20 @@ namespace LazyThetaStarOctree{
 			// It is it's own parent, this happens on the first node when the initial position is the center of the voxel (by chance)
 			if(s->hasSameCoordinates(s->parentNode, resolution ) == false)
 			{
-				if (!setVertex(input.octree, s, closed, open, neighbors, input.margin, publish_input, sidelength_lookup_table))
+				if (!setVertex(context, input.octree, s, closed, open, neighbors, input.margin, publish_input, sidelength_lookup_table))
 				{
+					if(context.lazy_edge_evaluation)
+					{
+						// Not in closed, another expanded node that can see it might insert it again
+						continue;
+					}
 					// input.octree.writeBinaryConst(folder_name + "/octree_noPath1s.bt");
 					log_file << "[ERROR] no neighbor of " << *s << " had line of sight. Start " << input.start << " goal " << input.goal << std::endl;
 					ROS_ERROR_STREAM ("[LTStar] no neighbor of " << *s << " had line of sight. Start " << input.start << " goal " << input.goal);
 				}
 			}
 			// ln 9 if s = s_goal then 
-			if( s->hasSameCoordinates(disc_final_cell_center, resolution/2) )
+			if( s->hasSameCoordinates(&disc_final_cell_center, resolution/2) )
 			{
 				// ln 10 return "path found"
 				solution_found = true;
@@ -753,55 +1198,11 @@ namespace LazyThetaStarOctree{
 				if(publish_input.publish)
 				{
 					// log_file  << "[Ortho] at iteration " << used_search_iterations << " open size is " << open.size() << std::endl;
-					// log_file  << "Solution end node:" << *s << " == " << *disc_final_cell_center << std::endl ;
+					// log_file  << "Solution end node:" << *s << " == " << disc_final_cell_center << std::endl ;
 				}
 				continue;
 			}
-			// ln 11 closed := closed U {s}
-			// log_file << "@"<< used_search_iterations << "  inserting s into closed " << s << " <--> " << *s << std::endl;
-			closed.insert( std::pair<octomath::Vector3, std::shared_ptr<ThetaStarNode>>( *(s->coordinates), s));
-
-			// TODO check code repetition to go over the neighbors of s
-			double cell_size = 0;
-			// ln 12 foreach s' € nghbr_vis(s) do
-			for(std::shared_ptr<octomath::Vector3> n_coordinates : neighbors)
-			{
-				// Find minimum value for those with visibility and that it is in closed
-				octomap::OcTreeKey key = input.octree.coordToKey(*n_coordinates);
-	            int depth = getNodeDepth_Octomap(key, input.octree);
-	            cell_size = findSideLenght(input.octree.getTreeDepth(), depth, sidelength_lookup_table);
-
-
-				if( ! is_flight_corridor_free( InputData(input.octree, *(s->coordinates), *n_coordinates, input.margin ), publish_input) )
-				{
-					// log_file << "  [N] " << *n_coordinates << " has obstacle." << std::endl;
-					continue;
-				}
-				// ln 13 if s' !€ closed then
-				bool is_neighbor_in_closed = closed.find(*n_coordinates) != closed.end();
-				if (!is_neighbor_in_closed)
-				{
-					// ln 14 if s' !€ open then
-					if( !open.existsInMap(*n_coordinates) )
-					{
-						// ln 15 g(s') := infinity;
-						double g_distanceFromInitialPoint = std::numeric_limits<double>::max();
-						// ln 16 parent(s') := NULL;
-						s_neighbour = std::make_shared<ThetaStarNode>(
-							n_coordinates, 
-							cell_size, 
-							g_distanceFromInitialPoint, 
-							weightedDistance( *(n_coordinates), input.goal) // lineDistanceToFinalPoint
-							);
-					}
-					else
-					{
-						s_neighbour =  open.getFromMap(*n_coordinates);
-					}
-					// ln 17 UpdateVertex(s, s');
-					UpdateVertex(*s, s_neighbour, open);
-				}
-			}
+			expandVertex(context, workspace, input, s, heuristic_weight, false, publish_input, sidelength_lookup_table);
 			used_search_iterations++;	
 			std::chrono::duration<double> time_lapse = std::chrono::high_resolution_clock::now() - start;
 			if(time_lapse > max_search_time)
@@ -810,6 +1211,11 @@ namespace LazyThetaStarOctree{
 				ROS_ERROR_STREAM("Reached maximum time for A*. Breaking out");
 				break;	
 			}
+			if(context.cancelled)
+			{
+				log_file << "[LTStar] Search cancelled after " << used_search_iterations << " iterations. Start " << input.start << " goal " << input.goal << std::endl;
+				break;
+			}
 			// ros::Duration(1).sleep();
 		}
 		resultSet.iterations_used = used_search_iterations;
@@ -818,7 +1224,7 @@ namespace LazyThetaStarOctree{
 		if(!solution_found)
 		{
 			ROS_WARN_STREAM("No solution found. Giving empty path.");
-			log_file <<  "[ltStar] All nodes were analyzed but the final node center " << *disc_final_cell_center << " was never reached with " << resolution/2 << " tolerance. Start " << input.start << ", end " << input.goal << std::endl;
+			log_file <<  "[ltStar] All nodes were analyzed but the final node center " << disc_final_cell_center << " was never reached with " << resolution/2 << " tolerance. Start " << input.start << ", end " << input.goal << std::endl;
 			// std::stringstream ss;
 			// ss << folder_name << "/" << input.start.x() << "_" << input.start.y() << "_" << input.start.z() << "_" 
 			// 	<<  input.goal.x() << "_" << input.goal.y() << "_" << input.goal.z() << "__noPath.bt";
@@ -830,10 +1236,10 @@ namespace LazyThetaStarOctree{
 			{
 				path.push_front( input.goal );
 			}
-			extractPath(path, *disc_initial_cell_center, *solution_end_node, print_resulting_path);
+			extractPath(context, path, *disc_initial_cell_center, *solution_end_node, print_resulting_path);
 			std::list<octomath::Vector3>::iterator it= path.begin();
 			it++;
-			bool free_path_from_current_to_second_waypoint = is_flight_corridor_free( InputData(input.octree, input.start, cell_center_coordinates_start, input.margin), publish_input);
+			bool free_path_from_current_to_second_waypoint = is_flight_corridor_free( context, InputData(input.octree, input.start, cell_center_coordinates_start, input.margin), publish_input);
 			// bool initial_pos_far_from_initial_voxel_center = equal(input.start, cell_center_coordinates_start, resolution/2) == false;
 			// if(initial_pos_far_from_initial_voxel_center && !free_path_from_current_to_second_waypoint)
 			if(free_path_from_current_to_second_waypoint)
@@ -859,11 +1265,8 @@ namespace LazyThetaStarOctree{
 		{
 			log_file.close();
 		}
-		// Free all nodes in both open and closed
-		open.clear();
-		closed.clear();
-		disc_initial_cell_center->parentNode = NULL;
-		disc_initial_cell_center = NULL;
+		// Release all nodes in both open and closed, the workspace keeps the memory for the next search
+		workspace.reset();
 		std::chrono::duration<double> time_lapse = std::chrono::high_resolution_clock::now() - start;
 		int total_in_microseconds = std::chrono::duration_cast<std::chrono::microseconds>(time_lapse).count();
 		// ROS_WARN_STREAM("[ltstar] [ortho] Total time " << total_in_microseconds << " microseconds.");
@@ -876,6 +1279,328 @@ namespace LazyThetaStarOctree{
 	}
 	// ln 19 end
 
+	std::list<octomath::Vector3> lazyThetaStarBidirectional_(
+		PlannerContext & context,
+		InputData const& input,
+		ResultSet & resultSet,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		double max_time_secs,
+		double heuristic_weight,
+		bool print_resulting_path)
+	{
+		SearchWorkspace & forward = context.workspace;
+		SearchWorkspace & backward = context.backward_workspace;
+		std::ofstream & log_file = context.log_file;
+		context.resetStatistics();
+		forward.reset();
+		backward.reset();
+		if(!log_file.is_open())
+		{
+	    	log_file.open(folder_name + "/current/" + context.log_name + ".log", std::ios_base::app);
+		}
+		auto start = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> max_search_time = std::chrono::duration<double>(max_time_secs);
+		std::list<octomath::Vector3> path;
+
+		if (!isExplored(input.start, input.octree))
+		{
+			ROS_ERROR_STREAM("[LTStar] Start " << input.start << " is unknown.");
+			log_file << "[ERROR] " << "[LTStar] Start " << input.start << " is unknown." << std::endl;
+		} 
+		if (!isExplored(input.goal, input.octree))
+		{
+			ROS_ERROR_STREAM("[LTStar] Goal " << input.goal << " is unknown.");
+			log_file << "[ERROR] " << "[LTStar] Goal " << input.goal << " is unknown." << std::endl;
+			return path;	
+		} 
+		double resolution = input.octree.getResolution();
+		octomath::Vector3 cell_center_coordinates_goal = input.goal;
+		double cell_size_goal = -1;
+		VoxelId voxel_id_goal = updateToCellCenterAndFindSize( cell_center_coordinates_goal, input.octree, cell_size_goal, sidelength_lookup_table);
+		octomath::Vector3 cell_center_coordinates_start = input.start;
+		double cell_size_start = -1;
+		VoxelId voxel_id_start = updateToCellCenterAndFindSize(cell_center_coordinates_start, input.octree, cell_size_start, sidelength_lookup_table);
+		if(equal(cell_center_coordinates_start, cell_center_coordinates_goal, resolution/2))
+		{
+			ROS_WARN_STREAM("[LTStar] Start and goal in the same voxel - flying straight.");
+			path.push_front( input.goal );
+			path.push_front( input.start );
+			return path;
+		}
+
+		// Each tree heads to the root of the other one
+		InputData backward_input (input.octree, input.goal, input.start, input.margin);
+		forward.open.reset(cell_center_coordinates_goal);
+		backward.open.reset(cell_center_coordinates_start);
+		ThetaStarNode* start_node = forward.newNode(voxel_id_start, cell_center_coordinates_start, cell_size_start, 0, heuristic_weight * weightedDistance(cell_center_coordinates_start, input.goal));
+		start_node->parentNode = start_node;
+		forward.open.insert(start_node);
+		ThetaStarNode* goal_node = backward.newNode(voxel_id_goal, cell_center_coordinates_goal, cell_size_goal, 0, heuristic_weight * weightedDistance(cell_center_coordinates_goal, input.start));
+		goal_node->parentNode = goal_node;
+		backward.open.insert(goal_node);
+
+		// Cheapest connection between the trees found so far, both nodes are expanded
+		ThetaStarNode* meet_forward = NULL;
+		ThetaStarNode* meet_backward = NULL;
+		double best_cost = std::numeric_limits<double>::max();
+		int used_search_iterations = 0;
+		while(!forward.open.empty() && !backward.open.empty())
+		{
+			// Stop once no node left in either open can lead to a cheaper connection
+			if(meet_forward != NULL && std::max(forward.open.topKey(), backward.open.topKey()) >= best_cost)
+			{
+				break;
+			}
+			// Grow the smaller frontier
+			bool is_backward = backward.open.size() < forward.open.size();
+			SearchWorkspace & workspace = is_backward ? backward : forward;
+			SearchWorkspace & other = is_backward ? forward : backward;
+			ThetaStarNode* s = workspace.open.pop();
+			resultSet.addOcurrance(s->cell_size);
+			generateNeighbors(context, workspace.neighbors, *s, input.octree);
+			if(s->hasSameCoordinates(s->parentNode, resolution ) == false)
+			{
+				if (!setVertex(context, input.octree, s, workspace.closed, workspace.open, workspace.neighbors, input.margin, publish_input, sidelength_lookup_table, is_backward))
+				{
+					if(context.lazy_edge_evaluation)
+					{
+						continue;
+					}
+					log_file << "[ERROR] no neighbor of " << *s << " had line of sight. Start " << input.start << " goal " << input.goal << std::endl;
+					ROS_ERROR_STREAM ("[LTStar] no neighbor of " << *s << " had line of sight. Start " << input.start << " goal " << input.goal);
+				}
+			}
+			ThetaStarNode** same_in_other = other.closed.find(s->voxel_id);
+			if(same_in_other != NULL && s->distanceFromInitialPoint + (*same_in_other)->distanceFromInitialPoint < best_cost)
+			{
+				best_cost = s->distanceFromInitialPoint + (*same_in_other)->distanceFromInitialPoint;
+				meet_forward = is_backward ? *same_in_other : s;
+				meet_backward = is_backward ? s : *same_in_other;
+			}
+			expandVertex(context, workspace, is_backward ? backward_input : input, s, heuristic_weight, is_backward, publish_input, sidelength_lookup_table);
+			// Meet in the middle: a neighbor expanded by the other tree that s can see joins both trees
+			for(auto const& neighbor : workspace.neighbors)
+			{
+				ThetaStarNode** in_other = other.closed.find(neighbor.first);
+				if(in_other == NULL)
+				{
+					continue;
+				}
+				double cost = s->distanceFromInitialPoint + weightedDistance(*(s->coordinates), neighbor.second) + (*in_other)->distanceFromInitialPoint;
+				if( cost >= best_cost
+					|| !is_flight_corridor_free( context, treeEdge(input.octree, input.margin, *(s->coordinates), neighbor.second, is_backward), publish_input) )
+				{
+					continue;
+				}
+				best_cost = cost;
+				meet_forward = is_backward ? *in_other : s;
+				meet_backward = is_backward ? s : *in_other;
+			}
+			used_search_iterations++;	
+			std::chrono::duration<double> time_lapse = std::chrono::high_resolution_clock::now() - start;
+			if(time_lapse > max_search_time)
+			{
+				log_file << "[ERROR] Reached maximum time for A*. Breaking out" << std::endl;
+				ROS_ERROR_STREAM("Reached maximum time for A*. Breaking out");
+				break;	
+			}
+			if(context.cancelled)
+			{
+				log_file << "[LTStar] Search cancelled after " << used_search_iterations << " iterations. Start " << input.start << " goal " << input.goal << std::endl;
+				break;
+			}
+		}
+		resultSet.iterations_used = used_search_iterations;
+		if(meet_forward == NULL)
+		{
+			ROS_WARN_STREAM("No solution found. Giving empty path.");
+			log_file <<  "[ltStar] The trees from start " << input.start << " and goal " << input.goal << " never met." << std::endl;
+		}
+		else
+		{
+			extractPath(context, path, *start_node, *meet_forward, print_resulting_path);
+			// From the meeting point to the goal following the backward tree
+			ThetaStarNode const* current = meet_backward;
+			if(current->voxel_id == meet_forward->voxel_id)
+			{
+				current = (current->parentNode == current) ? NULL : current->parentNode;
+			}
+			int safety_count = 0;
+			while(current != NULL && safety_count < 50)
+			{
+				path.push_back( *(current->coordinates) );
+				current = (current->parentNode == current) ? NULL : current->parentNode;
+				safety_count++;
+			}
+			if(current != NULL)
+			{
+				log_file << "[ERROR]  Possible recursion in the backward tree. Path trunkated." << std::endl;
+				ROS_ERROR_STREAM("Possible recursion in the backward tree. Path trunkated.");
+			}
+			if( equal(input.goal, cell_center_coordinates_goal) == false)
+			{
+				path.push_back( input.goal );
+			}
+			if( is_flight_corridor_free( context, InputData(input.octree, input.start, cell_center_coordinates_start, input.margin), publish_input) )
+			{
+				path.push_front( input.start );
+			}
+			log_file << "[LTStar] Bidirectional search met after " << used_search_iterations << " iterations, " << forward.nodesInUse() << " nodes from the start and " << backward.nodesInUse() << " from the goal." << std::endl;
+		}
+		if(publish_input.publish)
+		{
+			log_file.close();
+		}
+		forward.reset();
+		backward.reset();
+		return path;
+	}
+
+	int lazyThetaStarToTargets(
+		PlannerContext & context,
+		octomap::OcTree const& octree,
+		octomath::Vector3 const& start,
+		double safety_margin,
+		std::vector<octomath::Vector3> const& targets,
+		std::vector<TargetResult> & results,
+		const double sidelength_lookup_table[],
+		rviz_interface::PublishingInput const& publish_input,
+		int const& max_time_secs,
+		bool extract_paths)
+	{
+		SearchWorkspace & workspace = context.workspace;
+		std::ofstream & log_file = context.log_file;
+		context.resetStatistics();
+		workspace.reset();
+		results.assign(targets.size(), TargetResult());
+
+		if(!log_file.is_open())
+		{
+	    	log_file.open(folder_name + "/current/" + context.log_name + ".log", std::ios_base::app);
+		}
+		auto start_time = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> max_search_time = std::chrono::duration<double>(max_time_secs);
+		// No goal, the heuristic is 0 everywhere
+		InputData input (octree, start, start, safety_margin);
+		double resolution = octree.getResolution();
+
+		if (!isExplored(start, octree))
+		{
+			ROS_ERROR_STREAM("[LTStar] Start " << start << " is unknown.");
+			log_file << "[ERROR] " << "[LTStar] Start " << start << " is unknown." << std::endl;
+		}
+		octomath::Vector3 cell_center_coordinates_start = start;
+		double cell_size_start = -1;
+		VoxelId voxel_id_start = updateToCellCenterAndFindSize(cell_center_coordinates_start, octree, cell_size_start, sidelength_lookup_table);
+		double start_to_center = weightedDistance(start, cell_center_coordinates_start);
+		bool free_start_to_center = is_flight_corridor_free( context, InputData(octree, start, cell_center_coordinates_start, safety_margin), publish_input);
+
+		// Targets of each voxel, several targets can share one
+		VoxelIdMap<std::vector<std::size_t>> target_voxels;
+		std::vector<octomath::Vector3> target_centers (targets.size());
+		int reached = 0;
+		for (std::size_t i = 0; i < targets.size(); ++i)
+		{
+			// One descent tells whether the target is known and gives its voxel
+			LeafLocation location;
+			if (!locateLeaf(targets[i], octree, location))
+			{
+				log_file << "[LTStar] Target " << targets[i] << " is unknown, it will not be reached." << std::endl;
+				continue;
+			}
+			target_centers[i] = location.center;
+			VoxelId const& voxel_id = location.voxel_id;
+			if(voxel_id == voxel_id_start)
+			{
+				results[i].cost = weightedDistance(start, targets[i]);
+				if(extract_paths)
+				{
+					results[i].path.push_back(start);
+					results[i].path.push_back(targets[i]);
+				}
+				++reached;
+				continue;
+			}
+			target_voxels[voxel_id].push_back(i);
+		}
+
+		Open & open = workspace.open;
+		open.reset(cell_center_coordinates_start);
+		VoxelIdMap<ThetaStarNode*> & closed = workspace.closed;
+		unordered_set_pointers & neighbors = workspace.neighbors;
+		ThetaStarNode* disc_initial_cell_center = workspace.newNode(voxel_id_start, cell_center_coordinates_start, cell_size_start, 0, 0);
+		disc_initial_cell_center->parentNode = disc_initial_cell_center;
+		open.insert(disc_initial_cell_center);
+		int used_search_iterations = 0;
+		while(!open.empty() && !target_voxels.empty())
+		{
+			ThetaStarNode* s = open.pop();
+			generateNeighbors(context, neighbors, *s, octree);
+			if(s->hasSameCoordinates(s->parentNode, resolution ) == false)
+			{
+				if (!setVertex(context, octree, s, closed, open, neighbors, safety_margin, publish_input, sidelength_lookup_table))
+				{
+					if(context.lazy_edge_evaluation)
+					{
+						continue;
+					}
+					log_file << "[ERROR] no neighbor of " << *s << " had line of sight. Start " << start << std::endl;
+					ROS_ERROR_STREAM ("[LTStar] no neighbor of " << *s << " had line of sight. Start " << start);
+				}
+			}
+			// Without a heuristic, the first time a voxel is popped its g is final
+			std::vector<std::size_t> const* settled = target_voxels.find(s->voxel_id);
+			if(settled != NULL)
+			{
+				std::list<octomath::Vector3> center_path;
+				if(extract_paths)
+				{
+					extractPath(context, center_path, *disc_initial_cell_center, *s);
+					if(free_start_to_center)
+					{
+						center_path.push_front(start);
+					}
+				}
+				for (std::size_t i : *settled)
+				{
+					results[i].cost = start_to_center + s->distanceFromInitialPoint + weightedDistance(target_centers[i], targets[i]);
+					if(extract_paths)
+					{
+						results[i].path = center_path;
+						if( equal(targets[i], target_centers[i]) == false)
+						{
+							results[i].path.push_back(targets[i]);
+						}
+					}
+					++reached;
+				}
+				target_voxels.erase(s->voxel_id);
+			}
+			expandVertex(context, workspace, input, s, 0, false, publish_input, sidelength_lookup_table);
+			used_search_iterations++;
+			std::chrono::duration<double> time_lapse = std::chrono::high_resolution_clock::now() - start_time;
+			if(time_lapse > max_search_time)
+			{
+				log_file << "[ERROR] Reached maximum time for the targets search with " << target_voxels.size() << " target voxels left. Breaking out" << std::endl;
+				ROS_ERROR_STREAM("Reached maximum time for the targets search. Breaking out");
+				break;
+			}
+			if(context.cancelled)
+			{
+				log_file << "[LTStar] Targets search cancelled after " << used_search_iterations << " iterations. Start " << start << std::endl;
+				break;
+			}
+		}
+		log_file << "[LTStar] Targets search from " << start << " reached " << reached << " of " << targets.size() << " targets in " << used_search_iterations << " iterations." << std::endl;
+		if(publish_input.publish)
+		{
+			log_file.close();
+		}
+		workspace.reset();
+		return reached;
+	}
+
 	void qualityCheck(octomap::OcTree const& octree, octomath::Vector3 const& disc_initial, octomath::Vector3 const& disc_final, double straigh_line_distance, double distance_total, bool has_flight_corridor_free,  std::list<octomath::Vector3> const&resulting_path, std::stringstream const& generated_path_distance_ss)
 	{
 		std::ofstream log_file;
@@ -906,12 +1631,12 @@ namespace LazyThetaStarOctree{
 	    log_file.close();
 	}
 
-	bool avoidWaypoint(octomap::OcTree const& octree, lazy_theta_star_msgs::LTStarReply & reply, double safety_margin, int index, rviz_interface::PublishingInput const& publish_input)
+	bool avoidWaypoint(PlannerContext & context, octomap::OcTree const& octree, lazy_theta_star_msgs::LTStarReply & reply, double safety_margin, int index, rviz_interface::PublishingInput const& publish_input)
 	{
 		octomath::Vector3 start (reply.waypoints[index-1].position.x, reply.waypoints[index-1].position.y, reply.waypoints[index-1].position.z); 
 		octomath::Vector3 end (reply.waypoints[index+1].position.x, reply.waypoints[index+1].position.y, reply.waypoints[index+1].position.z); 
 		InputData input (octree, start, end, safety_margin);
-		if( is_flight_corridor_free(input, publish_input) )
+		if( is_flight_corridor_free(context, input, publish_input) )
 		{
 			reply.waypoints.erase(reply.waypoints.begin() + index);
 			return true;
@@ -924,6 +1649,11 @@ namespace LazyThetaStarOctree{
 
 	bool processLTStarRequest(octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input)
 	{
+		return processLTStarRequest(default_planner_context, octree, request, reply, sidelength_lookup_table, publish_input);
+	}
+
+	bool processLTStarRequest(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input)
+	{
 
 #ifdef SAVE_CSV
 		std::srand(std::time(0));
@@ -938,7 +1668,15 @@ namespace LazyThetaStarOctree{
 		// octomap_name_stream << std::setprecision(2) << folder_name << "/current/from_" << disc_initial.x() << "_" << disc_initial.y() << "_"  << disc_initial.z() << "_to_"<< disc_final.x() << "_"  << disc_final.y() << "_"  << disc_final.z() << ".bt";
 		// 	octree.writeBinary(octomap_name_stream.str());
 		InputData input (octree, disc_initial, disc_final, request.safety_margin);
-		resulting_path = lazyThetaStar_( input, statistical_data, sidelength_lookup_table, publish_input, request.max_time_secs, true);
+		resulting_path = lazyThetaStar_( context, input, statistical_data, sidelength_lookup_table, publish_input, request.max_time_secs, true);
+		if(context.cancelled)
+		{
+			// Nobody is waiting for this reply, skip the statistics and the no path dump
+			reply.success = false;
+			reply.waypoint_amount = 0;
+			reply.request_id = request.request_id;
+			return false;
+		}
 #ifdef SAVE_CSV
 		std::stringstream generated_path_distance_ss;
     	generated_path_distance_ss << "Generated path distance:\n";
@@ -965,14 +1703,12 @@ namespace LazyThetaStarOctree{
 		double straigh_line_distance = weightedDistance(disc_initial, disc_final);
 
 
-		bool has_flight_corridor_free = is_flight_corridor_free( InputData(octree, disc_initial, disc_final, request.safety_margin), rviz_interface::PublishingInput( publish_input.marker_pub, false));
+		bool has_flight_corridor_free = is_flight_corridor_free( context, InputData(octree, disc_initial, disc_final, request.safety_margin), rviz_interface::PublishingInput( publish_input.marker_pub, false));
 		// qualityCheck(octree, disc_initial, disc_final, straigh_line_distance, distance_total, has_flight_corridor_free, resulting_path, generated_path_distance_ss);
 
 
-		std::ofstream csv_file;
 		std::stringstream csv_stream, csv_stream_name;
 		csv_stream_name << folder_name << "/current/lazyThetaStar_computation_time.csv";
-		csv_file.open (csv_stream_name.str(), std::ofstream::app);
 		std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
 		std::chrono::milliseconds millis = std::chrono::duration_cast<std::chrono::milliseconds>(time_span);
 		csv_stream << (resulting_path.size()>0);
@@ -985,11 +1721,16 @@ namespace LazyThetaStarOctree{
 		csv_stream << "," << request.safety_margin;
 		csv_stream << "," << request.max_time_secs ;
 		csv_stream << "," << statistical_data.iterations_used ;
-		csv_stream << "," << obstacle_hit_count ;
-		csv_stream << "," << obstacle_avoidance_calls ;
+		csv_stream << "," << context.obstacle_hit_count ;
+		csv_stream << "," << context.obstacle_avoidance_calls ;
 		csv_stream << "," << publish_input.dataset_name << std::endl;
-		csv_file << csv_stream.str();
-		csv_file.close();
+		{
+			std::lock_guard<std::mutex> lock(shared_output_mutex);
+			std::ofstream csv_file;
+			csv_file.open (csv_stream_name.str(), std::ofstream::app);
+			csv_file << csv_stream.str();
+			csv_file.close();
+		}
 #endif
 #ifdef RUNNING_ROS
 		if(publish_input.publish)
@@ -1002,14 +1743,17 @@ namespace LazyThetaStarOctree{
 			reply.success = false;
 			// std::stringstream octomap_name_stream;
 			octomap_name_stream << std::setprecision(2) << folder_name << "/current/octree_noPath_(" << disc_initial.x() << "_" << disc_initial.y() << "_"  << disc_initial.z() << ")_("<< disc_final.x() << "_"  << disc_final.y() << "_"  << disc_final.z() << ").bt";
-			octree.writeBinary(octomap_name_stream.str());
+			{
+				std::lock_guard<std::mutex> lock(shared_output_mutex);
+				octree.writeBinaryConst(octomap_name_stream.str());
+			}
 			std::stringstream to_log_file_ss;
 			to_log_file_ss << "!!! No path !!!   " ;
 			to_log_file_ss << "Straight line length " << weightedDistance(disc_initial, disc_final);
 			to_log_file_ss <<  std::setprecision(2) << " from  " << "(" << disc_initial.x() << ", " << disc_initial.y() <<  ", " << disc_initial.z() << ")" ;
 			to_log_file_ss <<  std::setprecision(2) << " to " << "(" << disc_final.x() <<  ", " << disc_final.y() <<  ", " << disc_final.z() << ")" << std::endl;
 			std::ofstream log_file;
-    		log_file.open(folder_name + "/current/lazyThetaStar.log", std::ios_base::app);
+    		log_file.open(folder_name + "/current/" + context.log_name + ".log", std::ios_base::app);
     		log_file << to_log_file_ss.str();
 	    	log_file.close();
 		}
@@ -1025,16 +1769,147 @@ namespace LazyThetaStarOctree{
 	            waypoint.orientation = tf::createQuaternionMsgFromYaw(0);
 	            reply.waypoints.push_back(waypoint);
 			}
-			avoidWaypoint(octree, reply, request.safety_margin, 1, publish_input);
-			avoidWaypoint(octree, reply, request.safety_margin, reply.waypoints.size()-2, publish_input);
+			avoidWaypoint(context, octree, reply, request.safety_margin, 1, publish_input);
+			avoidWaypoint(context, octree, reply, request.safety_margin, reply.waypoints.size()-2, publish_input);
 
 
 			reply.success = true;
 		}
 		reply.waypoint_amount = resulting_path.size();
 		reply.request_id = request.request_id;
+		reply.suboptimality_bound = context.suboptimality_bound;
 		return true;
 	}
 
+	bool processLTStarQuery(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarRequest const& request, lazy_theta_star_msgs::LTStarReply & reply, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input)
+	{
+		octomath::Vector3 start(request.start.x, request.start.y, request.start.z);
+		octomath::Vector3 goal (request.goal.x, request.goal.y, request.goal.z);
+		generateOffsets(context, octree.getResolution(), request.safety_margin, semiSphereIn, semiSphereOut );
+		InputData input (octree, start, goal, request.safety_margin);
+		if( is_flight_corridor_free(context, input, rviz_interface::PublishingInput( publish_input.marker_pub, false)) )
+		{
+			reply.success = true;
+			reply.request_id = request.request_id;
+			reply.waypoint_amount = 2;
+			reply.suboptimality_bound = 1;
+			reply.waypoints.clear();
+			geometry_msgs::Pose waypoint;
+			waypoint.position = request.start;
+			waypoint.orientation = tf::createQuaternionMsgFromYaw(0);
+			reply.waypoints.push_back(waypoint);
+			waypoint.position = request.goal;
+			reply.waypoints.push_back(waypoint);
+			return true;
+		}
+		generateOffsets(context, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		return processLTStarRequest(context, octree, request, reply, sidelength_lookup_table, publish_input);
+	}
+
+	double pathCost(lazy_theta_star_msgs::LTStarReply const& reply)
+	{
+		if(!reply.success)
+		{
+			return -1;
+		}
+		double cost = 0;
+		for (std::size_t i = 1; i < reply.waypoints.size(); ++i)
+		{
+			octomath::Vector3 previous (reply.waypoints[i-1].position.x, reply.waypoints[i-1].position.y, reply.waypoints[i-1].position.z);
+			octomath::Vector3 current (reply.waypoints[i].position.x, reply.waypoints[i].position.y, reply.waypoints[i].position.z);
+			cost += weightedDistance(previous, current);
+		}
+		return cost;
+	}
+
+	void processLTStarBatch(PlannerContext & context, octomap::OcTree & octree, lazy_theta_star_msgs::LTStarBatch::Request const& request, lazy_theta_star_msgs::LTStarBatch::Response & response, const double sidelength_lookup_table[], rviz_interface::PublishingInput const& publish_input, std::vector<std::unique_ptr<PlannerContext>> const& helper_contexts)
+	{
+		std::size_t query_count = request.queries.size();
+		response.replies.assign(query_count, lazy_theta_star_msgs::LTStarReply());
+		response.path_costs.assign(query_count, -1);
+		response.planning_times_secs.assign(query_count, 0);
+		if(query_count == 0)
+		{
+			return;
+		}
+		std::atomic<std::size_t> next_query (0);
+		auto planQueries = [&](PlannerContext & query_context)
+		{
+			for (std::size_t i = next_query++; i < query_count; i = next_query++)
+			{
+				lazy_theta_star_msgs::LTStarQuery const& query = request.queries[i];
+				lazy_theta_star_msgs::LTStarRequest query_request;
+				query_request.header = request.header;
+				query_request.request_id = i;
+				query_request.start = query.start;
+				query_request.goal = query.goal;
+				query_request.max_time_secs = request.max_time_secs;
+				query_request.safety_margin = query.safety_margin;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				processLTStarQuery(query_context, octree, query_request, response.replies[i], sidelength_lookup_table, publish_input);
+				response.planning_times_secs[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				response.path_costs[i] = pathCost(response.replies[i]);
+			}
+		};
+		std::size_t helper_count = 0;
+		if(request.parallel)
+		{
+			helper_count = std::min(helper_contexts.size(), query_count - 1);
+		}
+		std::vector<std::exception_ptr> helper_errors (helper_count);
+		std::vector<std::thread> helpers;
+		for (std::size_t i = 0; i < helper_count; ++i)
+		{
+			PlannerContext & helper_context = *helper_contexts[i];
+			helper_context.copySettings(context);
+			// Same map, so the same layers
+			helper_context.map_sequence = context.map_sequence;
+			helper_context.leaf_graph = context.leaf_graph;
+			helper_context.distance_field = context.distance_field;
+			std::exception_ptr & helper_error = helper_errors[i];
+			helpers.push_back( std::thread([&planQueries, &helper_context, &helper_error]()
+			{
+				try
+				{
+					planQueries(helper_context);
+				}
+				catch(...)
+				{
+					helper_error = std::current_exception();
+				}
+			}) );
+		}
+		std::exception_ptr error;
+		try
+		{
+			planQueries(context);
+		}
+		catch(...)
+		{
+			error = std::current_exception();
+		}
+		for (std::thread & helper : helpers)
+		{
+			helper.join();
+		}
+		// The helpers keep their caches, which are tied to map_sequence, but not the layers until the next batch
+		for (std::size_t i = 0; i < helper_count; ++i)
+		{
+			helper_contexts[i]->leaf_graph.reset();
+			helper_contexts[i]->distance_field.reset();
+		}
+		for (std::exception_ptr const& helper_error : helper_errors)
+		{
+			if(!error && helper_error)
+			{
+				error = helper_error;
+			}
+		}
+		if(error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
 
 }
\ No newline at end of file
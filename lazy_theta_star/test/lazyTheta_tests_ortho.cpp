@@ -1,11 +1,32 @@
 #include <ltStar_lib_ortho.h>
 #include <ltStarOctree_common.h>
+#include <request_queue.h>
 #include <gtest/gtest.h>
 #include <queue>
+#include <thread>
 
 
 namespace LazyThetaStarOctree{
 
+	// Map with a wall between the start and the goal of throughWallRequest
+	std::string const kThroughWallMap = "data/(-11.2177; -18.2778; 2.39616)_(-8.5; 6.5; 3.5)_throughWall.bt";
+
+	lazy_theta_star_msgs::LTStarRequest throughWallRequest()
+	{
+		lazy_theta_star_msgs::LTStarRequest request;
+		request.header.seq = 2;
+		request.request_id = 3;
+		request.start.x = -11.2177;
+		request.start.y = -18.2778;
+		request.start.z = 2.39616;
+		request.goal.x = -8.5;
+		request.goal.y = 6.5;
+		request.goal.z = 3.5;
+		request.max_time_secs = 1000;
+		request.safety_margin = 1;
+		return request;
+	}
+
 	void testStraightLinesForwardNoObstacles(octomap::OcTree & octree, octomath::Vector3 disc_initial, octomath::Vector3 disc_final,
 		int const& max_time_secs = 55, double safety_margin = 0.1)
 	{
@@ -106,46 +127,175 @@ namespace LazyThetaStarOctree{
 
 	TEST(LazyThetaStarTests, ClosedInsert_Test)
 	{
+		double resolution = 0.2;
+		SearchWorkspace workspace;
 		octomath::Vector3 key_inside(-6.900000095, -2.5, 0.5);
-		std::shared_ptr<ThetaStarNode> dummy_node = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3>(key_inside), 0, 0, 0);
-		std::unordered_map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, Vector3Hash, VectorComparatorEqual> closed;
-		closed.insert( std::pair<octomath::Vector3, std::shared_ptr<ThetaStarNode>>(key_inside, dummy_node));
+		ThetaStarNode* dummy_node = workspace.newNode(voxelIdFromCoordinates(key_inside, resolution), key_inside, 0, 0, 0);
+		VoxelIdMap<ThetaStarNode*> & closed = workspace.closed;
+		closed.insert(dummy_node->voxel_id, dummy_node);
 
 		ASSERT_EQ(closed.size(), 1);
 
-		bool not_found = closed.find(key_inside) == closed.end();
+		bool not_found = closed.find(voxelIdFromCoordinates(key_inside, resolution)) == NULL;
 		ASSERT_FALSE(not_found);
 
 		octomath::Vector3 toFind(-7, -1.599999905, 0.200000003);
-		auto search_closed_result= closed.find(toFind);
-		ASSERT_EQ(search_closed_result, closed.end()) << search_closed_result->first;
+		ThetaStarNode** search_closed_result = closed.find(voxelIdFromCoordinates(toFind, resolution));
+		ASSERT_TRUE(search_closed_result == NULL) << *((*search_closed_result)->coordinates);
 	}
 
 	TEST(LazyThetaStarTests, Map_Insert_Duplicate_Test)
 	{
-		std::unordered_map<octomath::Vector3, std::shared_ptr<ThetaStarNode>, Vector3Hash, VectorComparatorEqual> closed;
+		double resolution = 0.2;
+		SearchWorkspace workspace;
+		VoxelIdMap<ThetaStarNode*> & closed = workspace.closed;
 
-		std::shared_ptr <octomath::Vector3> v1 = std::make_shared <octomath::Vector3>(-6.3000002, -3.0999999, 0.5000001);
-		std::shared_ptr<ThetaStarNode> s1 = std::make_shared<ThetaStarNode>(
+		octomath::Vector3 v1 (-6.3000002, -3.0999999, 0.5000001);
+		ThetaStarNode* s1 = workspace.newNode(
+							voxelIdFromCoordinates(v1, resolution),
 							v1, 
 							0.2, 
 							0.1999998, 
 							0.8000002 // lineDistanceToFinalPoint
 							);
-		closed.insert( std::pair<octomath::Vector3, std::shared_ptr<ThetaStarNode>>( *v1, s1));
+		closed.insert(s1->voxel_id, s1);
 
-		std::shared_ptr <octomath::Vector3> v2 = std::make_shared <octomath::Vector3>(-6.3000002, -3.0999999, 0.5000000);
-		std::shared_ptr<ThetaStarNode> s2 = std::make_shared<ThetaStarNode>(
+		octomath::Vector3 v2 (-6.3000002, -3.0999999, 0.5000000);
+		ThetaStarNode* s2 = workspace.newNode(
+							voxelIdFromCoordinates(v2, resolution),
 							v2, 
 							0.2, 
 							0.1999998, 
 							0.8000002 // lineDistanceToFinalPoint
 							);
-		closed.insert( std::pair<octomath::Vector3, std::shared_ptr<ThetaStarNode>>( *v2, s2));
+		closed.insert(s2->voxel_id, s2);
 
 		ASSERT_EQ(closed.size(), 1);
 	}
 
+	TEST(LazyThetaStarTests, CorridorCache_LeastRecentlyUsed_Test)
+	{
+		CorridorCache cache (2);
+		octomath::Vector3 a (0, 0, 0);
+		octomath::Vector3 b (1, 0, 0);
+		octomath::Vector3 c (2, 0, 0);
+		bool free = false;
+		cache.insert(CorridorKey(a, b, 0.5, 1, 1), true);
+		cache.insert(CorridorKey(b, c, 0.5, 1, 1), false);
+		// The corridor is directional
+		ASSERT_FALSE(cache.find(CorridorKey(b, a, 0.5, 1, 1), free));
+		ASSERT_TRUE(cache.find(CorridorKey(a, b, 0.5, 1, 1), free));
+		ASSERT_TRUE(free);
+		// Margin, shape and map version are part of the key
+		ASSERT_FALSE(cache.find(CorridorKey(a, b, 0.6, 1, 1), free));
+		ASSERT_FALSE(cache.find(CorridorKey(a, b, 0.5, 2, 1), free));
+		ASSERT_FALSE(cache.find(CorridorKey(a, b, 0.5, 1, 2), free));
+		// (b, c) is now the least recently used and is the one evicted
+		cache.insert(CorridorKey(a, c, 0.5, 1, 1), true);
+		ASSERT_EQ(cache.size(), 2);
+		ASSERT_FALSE(cache.find(CorridorKey(b, c, 0.5, 1, 1), free));
+		ASSERT_TRUE(cache.find(CorridorKey(a, b, 0.5, 1, 1), free));
+		ASSERT_TRUE(cache.find(CorridorKey(a, c, 0.5, 1, 1), free));
+		ASSERT_EQ(cache.hits, 3);
+	}
+
+	TEST(LazyThetaStarTests, GenerateOffsets_SharedShapes_Test)
+	{
+		double resolution = 0.2;
+		PlannerContext context;
+		generateOffsets(context, resolution, 1, semiSphereIn, semiSphereOut );
+		Eigen::MatrixXd start_offsets = context.startOffsets;
+		Eigen::MatrixXd goal_offsets = context.goalOffsets;
+		uint64_t shape_id = context.offsets_shape_id;
+		// The columns of generateOffsetMatrix, from the center out
+		Eigen::MatrixXd generated_start = generateOffsetMatrix(0.5, resolution, semiSphereIn);
+		Eigen::MatrixXd generated_goal = generateOffsetMatrix(0.5, resolution, semiSphereOut);
+		ASSERT_EQ(generated_start.cols(), start_offsets.cols());
+		ASSERT_EQ(0, start_offsets(1, 0));
+		ASSERT_EQ(0, start_offsets(2, 0));
+		for (int i = 0; i < start_offsets.cols(); ++i)
+		{
+			if(i > 0)
+			{
+				ASSERT_LE( start_offsets.col(i - 1).segment(1, 2).squaredNorm(), start_offsets.col(i).segment(1, 2).squaredNorm() );
+			}
+			bool found = false;
+			for (int j = 0; j < generated_start.cols() && !found; ++j)
+			{
+				found = generated_start.col(j) == start_offsets.col(i) && generated_goal.col(j) == goal_offsets.col(i);
+			}
+			ASSERT_TRUE(found);
+		}
+		// Switching shapes back and forth, or in another context, gives the same offsets
+		generateOffsets(context, resolution, 1, dephtZero, semiSphereOut );
+		ASSERT_NE(shape_id, context.offsets_shape_id);
+		ASSERT_EQ(generateOffsetMatrix(0.5, resolution, dephtZero).cols(), context.startOffsets.cols());
+		generateOffsets(context, resolution, 1, semiSphereIn, semiSphereOut );
+		ASSERT_EQ(shape_id, context.offsets_shape_id);
+		ASSERT_TRUE( context.startOffsets == start_offsets );
+		ASSERT_TRUE( context.goalOffsets == goal_offsets );
+		PlannerContext other;
+		generateOffsets(other, resolution, 1, semiSphereIn, semiSphereOut );
+		ASSERT_TRUE( other.startOffsets == start_offsets );
+		ASSERT_TRUE( other.goalOffsets == goal_offsets );
+	}
+
+	TEST(LazyThetaStarTests, WorkStealingPool_EveryTaskOnce_Test)
+	{
+		WorkStealingPool pool (3);
+		ASSERT_EQ(pool.threadCount(), 4);
+		std::vector<int> runs (1000, 0);
+		// Consecutive batches reuse the same threads and queues
+		for (int batch = 0; batch < 50; ++batch)
+		{
+			pool.parallelFor(runs.size(), [&](std::size_t i)
+			{
+				// Uneven tasks so that some threads run out of work and steal
+				if(i % 97 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+				runs[i]++;
+			});
+		}
+		for (int count : runs)
+		{
+			ASSERT_EQ(count, 50);
+		}
+		pool.parallelFor(0, [](std::size_t i){ FAIL(); });
+	}
+
+	TEST(LazyThetaStarTests, RequestQueue_SupersedeAndCapacity_Test)
+	{
+		RequestQueue queue (2);
+		lazy_theta_star_msgs::LTStarRequest request;
+		request.request_id = 1;
+		RequestQueue::Request first (new lazy_theta_star_msgs::LTStarRequest(request));
+		RequestQueue::Request first_again (new lazy_theta_star_msgs::LTStarRequest(request));
+		request.request_id = 2;
+		RequestQueue::Request second (new lazy_theta_star_msgs::LTStarRequest(request));
+		ASSERT_TRUE(queue.push(first).empty());
+		std::atomic<bool> cancel (true);
+		RequestQueue::Request popped;
+		ASSERT_TRUE(queue.pop(popped, cancel));
+		ASSERT_EQ(popped, first);
+		ASSERT_FALSE(cancel);
+		// Same id, the search goes on and the queue keeps both
+		ASSERT_TRUE(queue.push(first_again).empty());
+		ASSERT_FALSE(cancel);
+		ASSERT_EQ(queue.size(), 1);
+		// A new id drops what is queued and cancels what is running
+		std::vector<RequestQueue::Request> dropped = queue.push(second);
+		ASSERT_EQ(dropped.size(), 1);
+		ASSERT_EQ(dropped[0], first_again);
+		ASSERT_TRUE(cancel);
+		queue.done(cancel);
+		// Full, the oldest one goes
+		queue.push(second);
+		dropped = queue.push(second);
+		ASSERT_EQ(dropped.size(), 1);
+		ASSERT_EQ(queue.size(), 2);
+		queue.close();
+		ASSERT_FALSE(queue.pop(popped, cancel));
+	}
+
 	TEST(LazyThetaStarTests, LazyThetaStar_StraighLine_NoSolution_MemoryLeak_Test)
 	{
 		ros::Publisher marker_pub;
@@ -300,26 +450,240 @@ namespace LazyThetaStarOctree{
 	{
 		ros::Publisher marker_pub;
 		// (0.420435 0.313896 1.92169) to (-2.5 -10.5 3.5)
-		octomap::OcTree octree ("data/(-11.2177; -18.2778; 2.39616)_(-8.5; 6.5; 3.5)_throughWall.bt");
+		octomap::OcTree octree (kThroughWallMap);
 		double sidelength_lookup_table  [octree.getTreeDepth()];
 	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
-		lazy_theta_star_msgs::LTStarRequest request;
-		request.header.seq = 2;
-		request.request_id = 3;
-		request.start.x = -11.2177;
-		request.start.y = -18.2778;
-		request.start.z = 2.39616;
-		request.goal.x = -8.5;
-		request.goal.y = 6.5;
-		request.goal.z = 3.5;
-		request.max_time_secs = 1000;
-		request.safety_margin = 1;
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
 		lazy_theta_star_msgs::LTStarReply reply;
 		processLTStarRequest(octree, request, reply, sidelength_lookup_table, marker_pub);
 		ASSERT_TRUE(reply.success);
 		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
 	}
 
+	TEST(LazyThetaStarTests, LazyThetaStar_avoidWall_LazyEdgeEvaluation)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
+		lazy_theta_star_msgs::LTStarReply reply;
+		PlannerContext eager;
+		generateOffsets(eager, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		processLTStarRequest(eager, octree, request, reply, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(reply.success);
+
+		PlannerContext lazy;
+		lazy.lazy_edge_evaluation = true;
+		generateOffsets(lazy, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		processLTStarRequest(lazy, octree, request, reply, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(reply.success);
+		// Only the corridors of expanded nodes are checked
+		ASSERT_LT(lazy.obstacle_avoidance_calls, eager.obstacle_avoidance_calls);
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_avoidWall_Anytime)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
+		lazy_theta_star_msgs::LTStarReply reply;
+		PlannerContext plain;
+		generateOffsets(plain, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		processLTStarRequest(plain, octree, request, reply, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(reply.success);
+		ASSERT_EQ(reply.suboptimality_bound, 1);
+		double plain_cost = pathCost(reply);
+
+		PlannerContext anytime;
+		anytime.anytime_initial_weight = 3;
+		anytime.anytime_weight_step = 1;
+		generateOffsets(anytime, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		lazy_theta_star_msgs::LTStarReply anytime_reply;
+		processLTStarRequest(anytime, octree, request, anytime_reply, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(anytime_reply.success);
+		// Enough time to get down to weight 1, which is the plain search
+		ASSERT_EQ(anytime_reply.suboptimality_bound, 1);
+		ASSERT_LE(pathCost(anytime_reply), plain_cost + 0.001);
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_avoidWall_Bidirectional)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
+		PlannerContext context;
+		context.bidirectional = true;
+		generateOffsets(context, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		lazy_theta_star_msgs::LTStarReply reply;
+		processLTStarRequest(context, octree, request, reply, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(reply.success);
+		ASSERT_NEAR(reply.waypoints.front().position.x, request.start.x, 0.001);
+		ASSERT_NEAR(reply.waypoints.back().position.x, request.goal.x, 0.001);
+		// Every leg is checked in the direction it is flown. The last one, to the goal from its voxel center, is not checked by lazyThetaStar_ either
+		for (std::size_t i = 1; i + 1 < reply.waypoints.size(); ++i)
+		{
+			octomath::Vector3 from (reply.waypoints[i-1].position.x, reply.waypoints[i-1].position.y, reply.waypoints[i-1].position.z);
+			octomath::Vector3 to (reply.waypoints[i].position.x, reply.waypoints[i].position.y, reply.waypoints[i].position.z);
+			ASSERT_TRUE( is_flight_corridor_free(context, InputData(octree, from, to, request.safety_margin), rviz_interface::PublishingInput(marker_pub)) );
+		}
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_avoidWall_LeafGraph)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
+		PlannerContext context;
+		generateOffsets(context, octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+		lazy_theta_star_msgs::LTStarReply generated;
+		processLTStarRequest(context, octree, request, generated, sidelength_lookup_table, marker_pub);
+		std::shared_ptr<LeafGraph> graph (new LeafGraph());
+		graph->build(octree, 1);
+		ASSERT_TRUE(graph->builtFor(1));
+		ASSERT_FALSE(graph->builtFor(2));
+		ASSERT_GT(graph->leafCount(), 0);
+		ASSERT_GT(graph->edgeCount(), 0);
+		// Only the occupied neighbors are missing and no corridor goes through them, so the path costs the same
+		context.leaf_graph = graph;
+		context.map_sequence = 1;
+		lazy_theta_star_msgs::LTStarReply from_graph;
+		processLTStarRequest(context, octree, request, from_graph, sidelength_lookup_table, marker_pub);
+		ASSERT_TRUE(generated.success);
+		ASSERT_TRUE(from_graph.success);
+		ASSERT_NEAR(pathCost(generated), pathCost(from_graph), 0.001);
+		ASSERT_NEAR(from_graph.waypoints.back().position.x, request.goal.x, 0.001);
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_ConcurrentContexts_Test)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarRequest request = throughWallRequest();
+		// One context per thread, the octree is only read. Each checks its corridors on a pool of its own.
+		PlannerContext contexts [2];
+		lazy_theta_star_msgs::LTStarReply replies [2];
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 2; ++i)
+		{
+			generateOffsets(contexts[i], octree.getResolution(), request.safety_margin, dephtZero, semiSphereOut );
+			setCorridorThreads(contexts[i], 2);
+			threads.push_back( std::thread([&, i]
+			{
+				processLTStarRequest(contexts[i], octree, request, replies[i], sidelength_lookup_table, rviz_interface::PublishingInput(marker_pub));
+			}) );
+		}
+		for (std::thread & thread : threads)
+		{
+			thread.join();
+		}
+		ASSERT_TRUE(replies[0].success);
+		ASSERT_TRUE(replies[1].success);
+		ASSERT_EQ(replies[0].waypoints.size(), replies[1].waypoints.size());
+		ASSERT_EQ(contexts[0].obstacle_avoidance_calls, contexts[1].obstacle_avoidance_calls);
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_Batch_SequentialAndParallel_Test)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		lazy_theta_star_msgs::LTStarBatch::Request request;
+		request.max_time_secs = 1000;
+		lazy_theta_star_msgs::LTStarRequest through_wall = throughWallRequest();
+		lazy_theta_star_msgs::LTStarQuery query;
+		query.start = through_wall.start;
+		query.goal = through_wall.goal;
+		query.safety_margin = through_wall.safety_margin;
+		request.queries.push_back(query);
+		std::swap(query.start, query.goal);
+		request.queries.push_back(query);
+		request.queries.push_back(request.queries[0]);
+		std::vector<std::unique_ptr<PlannerContext>> helpers;
+		helpers.push_back( std::unique_ptr<PlannerContext>(new PlannerContext()) );
+		helpers.push_back( std::unique_ptr<PlannerContext>(new PlannerContext()) );
+		request.parallel = false;
+		PlannerContext sequential_context;
+		lazy_theta_star_msgs::LTStarBatch::Response sequential;
+		processLTStarBatch(sequential_context, octree, request, sequential, sidelength_lookup_table, rviz_interface::PublishingInput(marker_pub), helpers);
+		// Left alone without request.parallel
+		ASSERT_EQ(0, helpers[0]->corridor_cache.size());
+		request.parallel = true;
+		PlannerContext parallel_context;
+		lazy_theta_star_msgs::LTStarBatch::Response parallel;
+		processLTStarBatch(parallel_context, octree, request, parallel, sidelength_lookup_table, rviz_interface::PublishingInput(marker_pub), helpers);
+		ASSERT_EQ(sequential.replies.size(), 3);
+		ASSERT_EQ(parallel.replies.size(), 3);
+		for (int i = 0; i < 3; ++i)
+		{
+			ASSERT_TRUE(sequential.replies[i].success);
+			ASSERT_EQ(sequential.replies[i].request_id, i);
+			ASSERT_GT(sequential.path_costs[i], weightedDistance(octomath::Vector3(-11.2177, -18.2778, 2.39616), octomath::Vector3(-8.5, 6.5, 3.5)) - 0.001);
+			ASSERT_NEAR(sequential.path_costs[i], parallel.path_costs[i], 0.001);
+		}
+		ASSERT_NEAR(sequential.path_costs[0], sequential.path_costs[2], 0.001);
+		// The repeated query finds the corridors of the first one in the cache
+		ASSERT_GT(sequential_context.corridor_cache.hits, 0);
+		// The helpers keep their caches for the next batch on the same map, but not the layers
+		std::size_t cached = 0;
+		for (std::unique_ptr<PlannerContext> const& helper : helpers)
+		{
+			cached += helper->corridor_cache.size();
+			ASSERT_FALSE(helper->leaf_graph);
+			ASSERT_FALSE(helper->distance_field);
+		}
+		ASSERT_GT(cached, 0);
+		// An empty batch replies with nothing, in parallel too
+		request.queries.clear();
+		processLTStarBatch(parallel_context, octree, request, parallel, sidelength_lookup_table, rviz_interface::PublishingInput(marker_pub), helpers);
+		ASSERT_EQ(parallel.replies.size(), 0);
+		ASSERT_EQ(parallel.path_costs.size(), 0);
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_ToTargets_Test)
+	{
+		ros::Publisher marker_pub;
+		octomap::OcTree octree (kThroughWallMap);
+		double sidelength_lookup_table  [octree.getTreeDepth()];
+	   	LazyThetaStarOctree::fillLookupTable(octree.getResolution(), octree.getTreeDepth(), sidelength_lookup_table); 
+		octomath::Vector3 start (-11.2177, -18.2778, 2.39616);
+		std::vector<octomath::Vector3> targets;
+		targets.push_back( octomath::Vector3(-8.5, 6.5, 3.5) );		// behind the wall
+		targets.push_back( octomath::Vector3(-10.5, -17.5, 2.5) );	// next to the start
+		targets.push_back( octomath::Vector3(1000, 1000, 1000) );		// unknown
+		PlannerContext context;
+		generateOffsets(context, octree.getResolution(), 1, dephtZero, semiSphereOut );
+		std::vector<TargetResult> results;
+		int reached = lazyThetaStarToTargets(context, octree, start, 1, targets, results, sidelength_lookup_table, rviz_interface::PublishingInput(marker_pub), 1000, true);
+		ASSERT_EQ(reached, 2);
+		ASSERT_EQ(results.size(), 3);
+		ASSERT_GT(results[0].cost, weightedDistance(start, targets[0]));
+		ASSERT_LT(results[1].cost, results[0].cost);
+		ASSERT_EQ(results[2].cost, -1);
+		ASSERT_TRUE(results[2].path.empty());
+		for (int i = 0; i < 2; ++i)
+		{
+			ASSERT_GE(results[i].path.size(), 2);
+			ASSERT_TRUE( equal(results[i].path.back(), targets[i]) );
+		}
+		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
+	}
+
 	TEST(LazyThetaStarTests, LazyThetaStar_AddingBadNode)
 	{
 		ros::Publisher marker_pub;
@@ -346,6 +710,248 @@ namespace LazyThetaStarOctree{
 		ASSERT_EQ(0, ThetaStarNode::OustandingObjects());
 	}
 
+	TEST(LazyThetaStarTests, LazyThetaStar_CorridorRays_InFreeLeafs)
+	{
+		// Free cube from 0 to 4 meters, pruned into large leafs
+		octomap::OcTree octree (0.2);
+		for (double x = 0.1; x < 4; x += 0.2)
+		{
+			for (double y = 0.1; y < 4; y += 0.2)
+			{
+				for (double z = 0.1; z < 4; z += 0.2)
+				{
+					octree.updateNode(octomath::Vector3(x, y, z), false);
+				}
+			}
+		}
+		octree.prune();
+		PlannerContext context;
+		double safety_margin = 0.4;
+		generateOffsets(context, octree.getResolution(), safety_margin, dephtZero, semiSphereOut );
+		octomath::Vector3 start (1.2, 1.6, 1.6);
+		octomath::Vector3 goal (2, 1.6, 1.6);
+		LeafLocation location;
+		ASSERT_TRUE(locateLeaf(octree.coordToKey(start), octree, location));
+		ASSERT_LT(location.depth, octree.getTreeDepth() - 2);
+		CoordinateFrame coordinate_frame = generateCoordinateFrame(start, goal);
+		CorridorPoints points_around_start = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, start) ) * context.startOffsets;
+		CorridorPoints points_around_goal = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, goal) ) * context.goalOffsets;
+		CorridorRays rays;
+		LeafCache leaf_cache;
+		// Accepted without casting a ray, with the answer of the lines one by one
+		ASSERT_TRUE(rays.inFreeLeafs(octree, points_around_start, points_around_goal, leaf_cache));
+		ASSERT_EQ(-1, rays.findBlocked(octree, points_around_start, points_around_goal, leaf_cache));
+		for (int i = 0; i < points_around_start.cols(); ++i)
+		{
+			octomath::Vector3 temp_start (points_around_start(0, i), points_around_start(1, i), points_around_start(2, i));
+			octomath::Vector3 temp_goal (points_around_goal(0, i), points_around_goal(1, i), points_around_goal(2, i));
+			ASSERT_TRUE( hasLineOfSight( InputData(octree, temp_start, temp_goal, safety_margin) ) );
+			ASSERT_TRUE( hasLineOfSight( InputData(octree, temp_goal, temp_start, safety_margin) ) );
+		}
+		// Reaching out of the cube is left to the rays
+		octomath::Vector3 outside (4.5, 1.6, 1.6);
+		CoordinateFrame outside_frame = generateCoordinateFrame(start, outside);
+		points_around_start = Eigen::Matrix4d( generateRotationTranslationMatrix(outside_frame, start) ) * context.startOffsets;
+		points_around_goal = Eigen::Matrix4d( generateRotationTranslationMatrix(outside_frame, outside) ) * context.goalOffsets;
+		ASSERT_FALSE(rays.inFreeLeafs(octree, points_around_start, points_around_goal, leaf_cache));
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_CorridorRays_SameAsLineOfSight)
+	{
+		octomap::OcTree octree (kThroughWallMap);
+		PlannerContext context;
+		double safety_margin = 1;
+		generateOffsets(context, octree.getResolution(), safety_margin, dephtZero, semiSphereOut );
+		octomath::Vector3 start (-11.2177, -18.2778, 2.39616);
+		std::vector<octomath::Vector3> goals = { octomath::Vector3(-8.5, 6.5, 3.5), octomath::Vector3(-11, -15, 3), 
+			octomath::Vector3(-11.5, -13.5, 3.5), octomath::Vector3(-9, -17, 2.5), octomath::Vector3(-11.2, -10, 2.4) };
+		CorridorRays rays;
+		LeafCache leaf_cache;
+		for (octomath::Vector3 const& goal : goals)
+		{
+			CoordinateFrame coordinate_frame = generateCoordinateFrame(start, goal);
+			CorridorPoints points_around_start = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, start) ) * context.startOffsets;
+			CorridorPoints points_around_goal = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, goal) ) * context.goalOffsets;
+			bool line_of_sight = true;
+			for (int i = 0; i < points_around_start.cols(); ++i)
+			{
+				octomath::Vector3 temp_start (points_around_start(0, i), points_around_start(1, i), points_around_start(2, i));
+				octomath::Vector3 temp_goal (points_around_goal(0, i), points_around_goal(1, i), points_around_goal(2, i));
+				line_of_sight = line_of_sight && hasLineOfSight( InputData(octree, temp_start, temp_goal, safety_margin) )
+					&& hasLineOfSight( InputData(octree, temp_goal, temp_start, safety_margin) );
+			}
+			int blocked = rays.findBlocked(octree, points_around_start, points_around_goal, leaf_cache);
+			ASSERT_EQ(line_of_sight, blocked < 0);
+			if(blocked >= 0)
+			{
+				octomath::Vector3 temp_start (points_around_start(0, blocked), points_around_start(1, blocked), points_around_start(2, blocked));
+				octomath::Vector3 temp_goal (points_around_goal(0, blocked), points_around_goal(1, blocked), points_around_goal(2, blocked));
+				ASSERT_FALSE( hasLineOfSight( InputData(octree, temp_start, temp_goal, safety_margin) )
+					&& hasLineOfSight( InputData(octree, temp_goal, temp_start, safety_margin) ) );
+				octomap::OcTreeNode* blocking_node = octree.search(rays.blockingKey());
+				ASSERT_TRUE(blocking_node == NULL || octree.isNodeOccupied(blocking_node));
+			}
+		}
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_DistanceField_SameAsRays)
+	{
+		octomap::OcTree octree (kThroughWallMap);
+		PlannerContext context;
+		double safety_margin = 1;
+		generateOffsets(context, octree.getResolution(), safety_margin, dephtZero, semiSphereOut );
+		DistanceField field (2);
+		field.build(octree, 1);
+		ASSERT_TRUE(field.builtFor(1));
+		ASSERT_TRUE(field.covers(safety_margin));
+		for (octomap::OcTree::leaf_iterator it = octree.begin_leafs(); it != octree.end_leafs(); ++it)
+		{
+			if(octree.isNodeOccupied(*it) && it.getDepth() == octree.getTreeDepth())
+			{
+				ASSERT_EQ(0, field.distance(it.getCoordinate(), false));
+				break;
+			}
+		}
+		octomath::Vector3 start (-11.2177, -18.2778, 2.39616);
+		ASSERT_GT(field.distance(start, false), 0);
+		// A corridor free on the field is free for the rays too
+		std::vector<octomath::Vector3> goals = { octomath::Vector3(-8.5, 6.5, 3.5), octomath::Vector3(-11, -15, 3), 
+			octomath::Vector3(-11.5, -13.5, 3.5), octomath::Vector3(-9, -17, 2.5), octomath::Vector3(-11.2, -10, 2.4) };
+		CorridorRays rays;
+		LeafCache leaf_cache;
+		for (octomath::Vector3 const& goal : goals)
+		{
+			if(!field.corridorFree(start, goal, safety_margin, true))
+			{
+				continue;
+			}
+			CoordinateFrame coordinate_frame = generateCoordinateFrame(start, goal);
+			CorridorPoints points_around_start = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, start) ) * context.startOffsets;
+			CorridorPoints points_around_goal = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, goal) ) * context.goalOffsets;
+			ASSERT_EQ(-1, rays.findBlocked(octree, points_around_start, points_around_goal, leaf_cache));
+		}
+		// Following a map that did not change recomputes nothing
+		ASSERT_EQ(0, field.update(octree, 1));
+		// Following a change gives the field of a full build
+		octomap::OcTree changed (octree);
+		octomath::Vector3 obstacle (-11.2177, -16.5, 2.39616);
+		changed.setNodeValue(obstacle, changed.getClampingThresMaxLog());
+		ASSERT_GT(field.update(changed, 2), 0);
+		ASSERT_TRUE(field.builtFor(2));
+		ASSERT_FALSE(field.builtFor(1));
+		DistanceField rebuilt (2);
+		rebuilt.build(changed, 2);
+		for (double y = -18.5; y < -14.5; y += 0.2)
+		{
+			octomath::Vector3 point (-11.2, y, 2.4);
+			ASSERT_EQ(rebuilt.distance(point, true), field.distance(point, true));
+			ASSERT_EQ(rebuilt.distance(point, false), field.distance(point, false));
+		}
+		// A map that reaches out of the grid grows it in place instead of building it again
+		octomap::OcTree grown (changed);
+		double metric_max [3];
+		grown.getMetricMax(metric_max[0], metric_max[1], metric_max[2]);
+		octomath::Vector3 beyond (metric_max[0] + 3, -17, 2.4);
+		grown.updateNode(beyond, false);
+		std::size_t cells_before = field.cellCount();
+		std::size_t recomputed = field.update(grown, 3);
+		ASSERT_GT(field.cellCount(), cells_before);
+		ASSERT_LT(recomputed, field.cellCount());
+		rebuilt.build(grown, 3);
+		for (double x = metric_max[0] - 3; x < beyond.x() + 1; x += 0.2)
+		{
+			octomath::Vector3 point (x, -17, 2.4);
+			ASSERT_EQ(rebuilt.distance(point, true), field.distance(point, true));
+			ASSERT_EQ(rebuilt.distance(point, false), field.distance(point, false));
+		}
+		// With unknown space taken as free the corridor must still start and end in known free voxels
+		octomap::OcTree free_box (0.2);
+		for (double x = 0.1; x < 4; x += 0.2)
+		{
+			for (double y = 0.1; y < 4; y += 0.2)
+			{
+				for (double z = 0.1; z < 4; z += 0.2)
+				{
+					free_box.updateNode(octomath::Vector3(x, y, z), false);
+				}
+			}
+		}
+		DistanceField box_field (2);
+		box_field.build(free_box, 1);
+		octomath::Vector3 inside (1.5, 2, 2);
+		octomath::Vector3 also_inside (2.5, 2, 2);
+		octomath::Vector3 unknown (4.5, 2, 2);
+		ASSERT_TRUE(box_field.corridorFree(inside, also_inside, 0.2, true));
+		ASSERT_TRUE(box_field.corridorFree(inside, also_inside, 0.2, false));
+		ASSERT_FALSE(box_field.corridorFree(inside, unknown, 0.2, true));
+		ASSERT_FALSE(box_field.corridorFree(inside, unknown, 0.2, false));
+		ASSERT_FALSE(box_field.corridorFree(unknown, inside, 0.2, false));
+	}
+
+	TEST(LazyThetaStarTests, LazyThetaStar_SweptVolume_SameAsRays)
+	{
+		octomap::OcTree octree (kThroughWallMap);
+		PlannerContext context;
+		double safety_margin = 1;
+		generateOffsets(context, octree.getResolution(), safety_margin, dephtZero, semiSphereOut );
+		octomath::Vector3 start (-11.2177, -18.2778, 2.39616);
+		std::vector<octomath::Vector3> goals = { octomath::Vector3(-8.5, 6.5, 3.5), octomath::Vector3(-11, -15, 3), 
+			octomath::Vector3(-11.5, -13.5, 3.5), octomath::Vector3(-9, -17, 2.5), octomath::Vector3(-11.2, -10, 2.4) };
+		SweptVolume sweep;
+		CorridorRays rays;
+		LeafCache leaf_cache;
+		bool found_blocked = false;
+		for (octomath::Vector3 const& goal : goals)
+		{
+			octomap::OcTreeKey blocking_key;
+			SweptVolume::Status status = sweep.findBlocked(octree, start, goal, SweptVolume::kCapsule, safety_margin / 2, true, leaf_cache, blocking_key);
+			// The capsule holds every line of the corridor
+			CoordinateFrame coordinate_frame = generateCoordinateFrame(start, goal);
+			CorridorPoints points_around_start = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, start) ) * context.startOffsets;
+			CorridorPoints points_around_goal = Eigen::Matrix4d( generateRotationTranslationMatrix(coordinate_frame, goal) ) * context.goalOffsets;
+			if(status == SweptVolume::kSweepFree)
+			{
+				ASSERT_EQ(-1, rays.findBlocked(octree, points_around_start, points_around_goal, leaf_cache));
+			}
+			else
+			{
+				found_blocked = true;
+				octomap::OcTreeNode* node = octree.search(blocking_key);
+				ASSERT_EQ(status == SweptVolume::kSweepUnknown, node == NULL);
+				ASSERT_TRUE(node == NULL || octree.isNodeOccupied(node));
+			}
+			// The box is the same both ways
+			ASSERT_EQ( getLineStatusBoundingBox( InputData(octree, start, goal, safety_margin) ) == CellStatus::kFree, 
+				getLineStatusBoundingBox( InputData(octree, goal, start, safety_margin) ) == CellStatus::kFree );
+		}
+		// The path from the start goes through the wall
+		ASSERT_TRUE(found_blocked);
+		// With unknown space taken as free the corridor must still start and end in known free voxels
+		octomap::OcTree free_box (0.2);
+		for (double x = 0.1; x < 4; x += 0.2)
+		{
+			for (double y = 0.1; y < 4; y += 0.2)
+			{
+				for (double z = 0.1; z < 4; z += 0.2)
+				{
+					free_box.updateNode(octomath::Vector3(x, y, z), false);
+				}
+			}
+		}
+		octomath::Vector3 inside (1.5, 2, 2);
+		octomath::Vector3 also_inside (2.5, 2, 2);
+		octomath::Vector3 unknown (4.5, 2, 2);
+		LeafCache box_cache;
+		octomap::OcTreeKey blocking_key;
+		ASSERT_EQ(SweptVolume::kSweepFree, sweep.findBlocked(free_box, inside, also_inside, SweptVolume::kCapsule, 0.1, true, box_cache, blocking_key));
+		ASSERT_EQ(SweptVolume::kSweepFree, sweep.findBlocked(free_box, inside, also_inside, SweptVolume::kCapsule, 0.1, false, box_cache, blocking_key));
+		ASSERT_EQ(SweptVolume::kSweepUnknown, sweep.findBlocked(free_box, inside, unknown, SweptVolume::kCapsule, 0.1, true, box_cache, blocking_key));
+		ASSERT_EQ(SweptVolume::kSweepUnknown, sweep.findBlocked(free_box, inside, unknown, SweptVolume::kCapsule, 0.1, false, box_cache, blocking_key));
+		ASSERT_TRUE(blocking_key == free_box.coordToKey(unknown));
+		ASSERT_EQ(SweptVolume::kSweepUnknown, sweep.findBlocked(free_box, unknown, inside, SweptVolume::kCapsule, 0.1, false, box_cache, blocking_key));
+		ASSERT_TRUE(blocking_key == free_box.coordToKey(unknown));
+	}
+
 	TEST(LazyThetaStarTests, LazyThetaStar_corridorFree_2)
 	{
 		ros::Publisher marker_pub;
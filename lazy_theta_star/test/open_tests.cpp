@@ -1,24 +1,33 @@
 #include <open.h>
+#include <search_workspace.h>
 #include <gtest/gtest.h>
 
 namespace LazyThetaStarOctree{
+	// Fine resolution so that every coordinate used in these tests is a different voxel
+	VoxelId testVoxelId(octomath::Vector3 const& coordinates)
+	{
+		return voxelIdFromCoordinates(coordinates, 0.05);
+	}
+
 	TEST(OpenTest, InsertTest)
 	{
 		int initial_object_count = ThetaStarNode::OustandingObjects();
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;	
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 16, 10, 5) ;	
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);	
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 16, 10, 5);	
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
 		// ASSERT
-		ASSERT_TRUE(open.existsInMap(key) );
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ASSERT_TRUE(open.existsInMap(testVoxelId(key)) );
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ( *(poped->coordinates), *(toInsert->coordinates));
 		toInsert = poped = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(0, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -28,18 +37,19 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key), 15, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> toInsert2 = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2), 15, 10, 10) ;
+		ThetaStarNode* toInsert2 = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		toInsert->parentNode = toInsert2;
 		toInsert2->parentNode = toInsert;
 		// ACT 
 		open.insert(toInsert);
 		open.insert(toInsert2);
 		// ASSERT
-		ASSERT_TRUE(open.existsInMap(key) );
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ASSERT_TRUE(open.existsInMap(testVoxelId(key)) );
+		ThetaStarNode* poped = open.pop();
 
 		ASSERT_EQ( *(poped->coordinates), *(toInsert->coordinates));
 		ASSERT_FALSE(open.empty());
@@ -50,6 +60,7 @@ namespace LazyThetaStarOctree{
 		toInsert = NULL;
 		poped = NULL;
 		toInsert2 = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());    // TODO This should actually be 0 but can't find why it is not
 	}
 	TEST(OpenTest, InsertDuplicatedTest)
@@ -58,21 +69,23 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 16, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 16, 10, 5);
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
 		open.insert(toInsert);
 		ASSERT_EQ(open.size(), 1);
 		// ASSERT
-		ASSERT_TRUE(open.existsInMap(key) );
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ASSERT_TRUE(open.existsInMap(testVoxelId(key)) );
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ( *(poped->coordinates), *(toInsert->coordinates));
 		ASSERT_TRUE(open.empty());
 		toInsert = poped = parent = NULL;
 		open.clear();
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 	// ExistsTest is Tested in insert
@@ -84,7 +97,7 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 key(0,0,0);
 		// ACT 
 		// ASSERT
-		ASSERT_FALSE(open.existsInMap(key) );
+		ASSERT_FALSE(open.existsInMap(testVoxelId(key)) );
 	}
 	TEST(OpenTest, DoesNotExistsTest)
 	{
@@ -92,17 +105,19 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
 		octomath::Vector3 inexistentKey(0,0,1);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 16, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 16, 10, 5);
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
 		// ASSERT
-		ASSERT_FALSE(open.existsInMap(inexistentKey) );
+		ASSERT_FALSE(open.existsInMap(testVoxelId(inexistentKey)) );
 		open.clear();
 		toInsert = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -113,18 +128,20 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 15, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 15, 10, 5);
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
 		// ASSERT
-		ASSERT_TRUE(open.existsInMap(key) );
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ASSERT_TRUE(open.existsInMap(testVoxelId(key)) );
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ( *(poped->coordinates), *(toInsert->coordinates));
 		open.clear();
 		toInsert = poped = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());   
 	}
 
@@ -146,9 +163,10 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 15, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 15, 10, 5);
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
@@ -156,6 +174,7 @@ namespace LazyThetaStarOctree{
 		ASSERT_FALSE(open.empty() );
 		open.clear();
 		toInsert = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());   // TODO This should actually be 0 but can't find why it is not
 	}
 
@@ -165,17 +184,19 @@ namespace LazyThetaStarOctree{
 		// ARRANGE
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5) ;
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 15, 10, 5) ;
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 15, 10, 5);
 		toInsert-> parentNode = parent;
 		// ACT 
 		open.insert(toInsert);
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		// ASSERT
 		ASSERT_EQ( *(poped->coordinates), *(toInsert->coordinates));
 		open.clear();
 		toInsert = poped = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 	TEST(OpenTest, PopLowerHeuristicValueTest)
@@ -189,14 +210,15 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 coordinates(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(coordinates), coordinates, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates2(0,1,0);
 		lineDistanceToFinalPoint = 10;
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates2) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(coordinates2), coordinates2, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates3(0,3,0);
 		distanceFromInitialPoint = 9;
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates3) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(coordinates3), coordinates3, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -204,7 +226,7 @@ namespace LazyThetaStarOctree{
 		open.insert(high);
 		open.insert(low);
 		open.insert(middle);
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		// ASSERT
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
 		poped = open.pop();
@@ -214,6 +236,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 	TEST(OpenTest, AcknowledgeDuplicateIdTest)
@@ -222,12 +245,13 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2), 15, 10, 10);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		octomath::Vector3 key3(0,1,0);
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key3), 15, 9, 10);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(key3), key3, 15, 9, 10);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -235,7 +259,7 @@ namespace LazyThetaStarOctree{
 		open.insert(high);
 		open.insert(low);
 		open.insert(middle);
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		// ASSERT
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
 		poped = open.pop();
@@ -244,6 +268,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 	TEST(OpenTest, PopWithSomeLeftTest)
@@ -252,12 +277,13 @@ namespace LazyThetaStarOctree{
 		octomath::Vector3 final_voxel_center(700,0,0);
 		// ARRANGE
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2) , 15, 10, 10);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		octomath::Vector3 key3(0,10,0);
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key3) , 15, 9, 10);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(key3), key3, 15, 9, 10);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -265,7 +291,7 @@ namespace LazyThetaStarOctree{
 		open.insert(high);
 		open.insert(low);
 		open.insert(middle); 
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		// ASSERT
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
 		poped = open.pop();
@@ -276,6 +302,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -307,16 +334,17 @@ namespace LazyThetaStarOctree{
 		// ARRANGE
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2) , 15, 10, 10);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		low->parentNode = high;
 		high->parentNode = low;
 		// ACT 
 		open.insert(high);
 		open.insert(low);
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
 		poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(high->coordinates));
@@ -335,6 +363,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = poped = high = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -344,10 +373,11 @@ namespace LazyThetaStarOctree{
 		// ARRANGE
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2) , 15, 10, 10);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		octomath::Vector3 key3(0,1,0);
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key3) , 15, 9, 10);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(key3), key3, 15, 9, 10);
 		middle->parentNode = high;
 		high->parentNode = middle;
 		open.insert(high);
@@ -361,6 +391,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		middle->parentNode = high->parentNode = NULL;
 		middle = high = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());   // TODO This should actually be 0 but can't find why it is not
 	}
 
@@ -370,12 +401,13 @@ namespace LazyThetaStarOctree{
 		// ARRANGE
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
 		octomath::Vector3 key2(0,1,0);
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key2) , 15, 10, 10);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(key2), key2, 15, 10, 10);
 		octomath::Vector3 key3(0,2,0);
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key3) , 15, 9, 10);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(key3), key3, 15, 9, 10);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -389,6 +421,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = NULL;
 		low = middle = high = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());  // TODO This should actually be 0 but can't find why it is not
 	}
 
@@ -398,18 +431,20 @@ namespace LazyThetaStarOctree{
 		// ARRANGE
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 key(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (key) , 15, 10, 5);
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (2, 5, 2) , 16, 10, 5) ;	
+		ThetaStarNode* low = workspace.newNode(testVoxelId(key), key, 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 16, 10, 5);	
 		low-> parentNode = parent;
 		open.insert(low);
 		// ACT 
-		std::shared_ptr<ThetaStarNode> node = open.getFromMap(key);
+		ThetaStarNode* node = open.getFromMap(testVoxelId(key));
 		// ASSERT
 		ASSERT_EQ( *(node->coordinates), *(low->coordinates));
 		open.clear();
 		low->parentNode = node->parentNode = parent->parentNode = NULL;
 		low = node = parent = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());    // TODO This should actually be 0 but can't find why it is not
 	}	
 
@@ -424,7 +459,7 @@ namespace LazyThetaStarOctree{
 		bool oor_exception_thrown = false;
 		try
 		{
-			open.getFromMap(key);
+			open.getFromMap(testVoxelId(key));
 		}
 		catch (const std::out_of_range& oor)
 		{
@@ -444,14 +479,15 @@ namespace LazyThetaStarOctree{
 		float lineDistanceToFinalPoint = 5;
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 coordinates(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(coordinates), coordinates, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates2(0,1,0);
 		lineDistanceToFinalPoint = 10;
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates2) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(coordinates2), coordinates2, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates3(0,3,0);
 		distanceFromInitialPoint = 9;
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates3) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(coordinates3), coordinates3, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -467,7 +503,7 @@ namespace LazyThetaStarOctree{
 		high->distanceFromInitialPoint = 0;
 		open.insert(high);
 
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		// ASSERT
 		ASSERT_EQ(*(poped->coordinates), *(high->coordinates));
 
@@ -482,6 +518,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 		
 	}
@@ -495,14 +532,15 @@ namespace LazyThetaStarOctree{
 		float lineDistanceToFinalPoint = 5;
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 coordinates(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(coordinates), coordinates, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates2(0,1,0);
 		lineDistanceToFinalPoint = 10;
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates2) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(coordinates2), coordinates2, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates3(0,3,0);
 		distanceFromInitialPoint = 9;
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates3) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(coordinates3), coordinates3, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -515,7 +553,7 @@ namespace LazyThetaStarOctree{
 		ASSERT_TRUE(open.changeDistanceFromInitialPoint(0, high));
 
 		// ASSERT that the internal ordering is ok
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(high->coordinates));
 		poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
@@ -524,6 +562,7 @@ namespace LazyThetaStarOctree{
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -536,14 +575,15 @@ namespace LazyThetaStarOctree{
 		float lineDistanceToFinalPoint = 5;
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 coordinates(0,0,0);
-		std::shared_ptr<ThetaStarNode> low = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* low = workspace.newNode(testVoxelId(coordinates), coordinates, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates2(0,1,0);
 		lineDistanceToFinalPoint = 10;
-		std::shared_ptr<ThetaStarNode> high = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates2) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* high = workspace.newNode(testVoxelId(coordinates2), coordinates2, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		octomath::Vector3 coordinates3(0,3,0);
 		distanceFromInitialPoint = 9;
-		std::shared_ptr<ThetaStarNode> middle = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates3) , cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
+		ThetaStarNode* middle = workspace.newNode(testVoxelId(coordinates3), coordinates3, cell_size, distanceFromInitialPoint, lineDistanceToFinalPoint);
 		low->parentNode = high;
 		middle->parentNode = high;
 		high->parentNode = middle;
@@ -553,13 +593,14 @@ namespace LazyThetaStarOctree{
 		ASSERT_FALSE(open.changeDistanceFromInitialPoint(0, high));
 
 		// ASSERT that the internal ordering is ok
-		std::shared_ptr<ThetaStarNode> poped = open.pop();
+		ThetaStarNode* poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(low->coordinates));
 		poped = open.pop();
 		ASSERT_EQ(*(poped->coordinates), *(middle->coordinates));
 		open.clear();
 		low->parentNode = middle->parentNode = high->parentNode = poped->parentNode = NULL;
 		low = middle = high = poped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 	}
 
@@ -579,29 +620,163 @@ namespace LazyThetaStarOctree{
 		int initial_object_count = ThetaStarNode::OustandingObjects();
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 parent_coordinates(-0.7, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (parent_coordinates) , 0.2, 0, 1) ;	
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(parent_coordinates), parent_coordinates, 0.2, 0, 1);	
 		octomath::Vector3 coordinates(0.1, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , 0.2, 0.8, 0.2) ;	
+		ThetaStarNode* toInsert = workspace.newNode(testVoxelId(coordinates), coordinates, 0.2, 0.8, 0.2);	
 		toInsert->parentNode = parent;
 		open.insert(toInsert);
 
 		octomath::Vector3 opposite_direction_neighbor_coordinates (-0.9, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> opposite_direction_neighbor = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (opposite_direction_neighbor_coordinates) , 0.2, 0.2, 1.2) ;	
+		ThetaStarNode* opposite_direction_neighbor = workspace.newNode(testVoxelId(opposite_direction_neighbor_coordinates), opposite_direction_neighbor_coordinates, 0.2, 0.2, 1.2);	
 		opposite_direction_neighbor->parentNode = parent;
 		open.insert(opposite_direction_neighbor);
 		// ACT
 		// There is no direct way to generate the heuristics of a node as it is a private method
 		// ASSERT
 		// open.printNodes();
-		std::shared_ptr<ThetaStarNode> popped = open.pop();
+		ThetaStarNode* popped = open.pop();
 		ASSERT_TRUE(popped->hasSameCoordinates(toInsert, 0.2));
 
 		open.clear();
 		parent = toInsert = opposite_direction_neighbor = popped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 		
 	}
+	TEST(OpenTest, SameHeuristicPopsInInsertionOrderTest)
+	{
+		int initial_object_count = ThetaStarNode::OustandingObjects();
+		// ARRANGE
+		octomath::Vector3 final_voxel_center(700,0,0);
+		Open open (final_voxel_center);
+		SearchWorkspace workspace;
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 15, 10, 5);
+		std::vector<ThetaStarNode*> inserted;
+		for (int i = 0; i < 10; ++i)
+		{
+			ThetaStarNode* node = workspace.newNode(testVoxelId(octomath::Vector3 (0, i, 0)), octomath::Vector3 (0, i, 0), 1, 10, 5);
+			node->parentNode = parent;
+			inserted.push_back(node);
+			open.insert(node);
+		}
+		// ACT & ASSERT
+		ASSERT_EQ(open.size(), 10);
+		for (int i = 0; i < 10; ++i)
+		{
+			ThetaStarNode* poped = open.pop();
+			ASSERT_EQ(*(poped->coordinates), *(inserted[i]->coordinates));
+		}
+		ASSERT_TRUE(open.empty());
+		inserted.clear();
+		parent = NULL;
+		workspace.reset();
+		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
+	}
+
+	TEST(OpenTest, DecreaseKeyManyNodesTest)
+	{
+		int initial_object_count = ThetaStarNode::OustandingObjects();
+		// ARRANGE
+		octomath::Vector3 final_voxel_center(700,0,0);
+		Open open (final_voxel_center);
+		SearchWorkspace workspace;
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 1, 10, 5);
+		std::vector<ThetaStarNode*> inserted;
+		for (int i = 0; i < 100; ++i)
+		{
+			// g is scrambled so that insertion order is not heap order
+			ThetaStarNode* node = workspace.newNode(testVoxelId(octomath::Vector3 (i*0.2, 0, 0)), octomath::Vector3 (i*0.2, 0, 0), 0.2, 10 + (i*37)%100, 5);
+			node->parentNode = parent;
+			inserted.push_back(node);
+			open.insert(node);
+		}
+		// ACT
+		ASSERT_TRUE(open.changeDistanceFromInitialPoint(1, inserted[42]));
+		ASSERT_TRUE(open.erase(*(inserted[0])));
+		ASSERT_FALSE(open.existsInMap(inserted[0]->voxel_id));
+		ASSERT_TRUE(open.existsInMap(testVoxelId(octomath::Vector3(42*0.2, 0, 0))));
+		// ASSERT
+		ASSERT_EQ(open.size(), 99);
+		ThetaStarNode* poped = open.pop();
+		ASSERT_EQ(*(poped->coordinates), *(inserted[42]->coordinates));
+		float previous_heuristic = poped->calculateH_();
+		while(!open.empty())
+		{
+			poped = open.pop();
+			ASSERT_LE(previous_heuristic, poped->calculateH_());
+			previous_heuristic = poped->calculateH_();
+		}
+		inserted.clear();
+		parent = poped = NULL;
+		workspace.reset();
+		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
+	}
+	TEST(OpenTest, InsertWithoutVoxelIdTest)
+	{
+		int initial_object_count = ThetaStarNode::OustandingObjects();
+		// ARRANGE
+		octomath::Vector3 final_voxel_center(700,0,0);
+		Open open (final_voxel_center);
+		SearchWorkspace workspace;
+		ThetaStarNode* toInsert = workspace.newNode(VoxelId(), octomath::Vector3 (0, 0, 0), 15, 10, 5);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 16, 10, 5);
+		toInsert->parentNode = parent;
+		// ACT
+		bool logic_exception_thrown = false;
+		try
+		{
+			open.insert(toInsert);
+		}
+		catch (const std::logic_error& le)
+		{
+			logic_exception_thrown = true;
+		}
+		// ASSERT
+		ASSERT_TRUE(logic_exception_thrown);
+		ASSERT_TRUE(open.empty());
+		toInsert = parent = NULL;
+		workspace.reset();
+		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
+	}
+	TEST(OpenTest, WorkspaceReuseTest)
+	{
+		int initial_object_count = ThetaStarNode::OustandingObjects();
+		// ARRANGE
+		octomath::Vector3 final_voxel_center(700,0,0);
+		SearchWorkspace workspace;
+		workspace.open.reset(final_voxel_center);
+		ThetaStarNode* parent = workspace.newNode(testVoxelId(octomath::Vector3 (2, 5, 2)), octomath::Vector3 (2, 5, 2), 1, 10, 5);
+		parent->parentNode = parent;
+		for (int i = 0; i < 2000; ++i)
+		{
+			ThetaStarNode* node = workspace.newNode(testVoxelId(octomath::Vector3 (i*0.1, 0, 0)), octomath::Vector3 (i*0.1, 0, 0), 0.1, 10, 5);
+			node->parentNode = parent;
+			workspace.open.insert(node);
+			workspace.closed.insert(node->voxel_id, node);
+		}
+		// Parent links survive growing the pool
+		ASSERT_EQ(*(workspace.open.pop()->parentNode->coordinates), octomath::Vector3 (2, 5, 2));
+		ASSERT_EQ(initial_object_count + 2001, ThetaStarNode::OustandingObjects());
+		std::size_t capacity = workspace.capacity();
+		// ACT
+		workspace.reset();
+		// ASSERT
+		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects());
+		ASSERT_EQ(0, workspace.nodesInUse());
+		ASSERT_TRUE(workspace.open.empty());
+		ASSERT_TRUE(workspace.closed.empty());
+		ASSERT_FALSE(workspace.closed.contains(parent->voxel_id));
+		// The same memory is handed out again
+		ThetaStarNode* reused = workspace.newNode(testVoxelId(octomath::Vector3 (0, 1, 0)), octomath::Vector3 (0, 1, 0), 0.1, 0, 5);
+		ASSERT_EQ(parent, reused);
+		ASSERT_TRUE(reused->parentNode == NULL);
+		ASSERT_EQ(octomath::Vector3 (0, 1, 0), *(reused->coordinates));
+		ASSERT_EQ(capacity, workspace.capacity());
+		workspace.reset();
+		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
+	}
 }
 
 int main(int argc, char **argv){
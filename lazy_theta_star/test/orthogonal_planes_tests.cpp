@@ -309,7 +309,7 @@ namespace LazyThetaStarOctree{
 		// For each start and goal
 		CoordinateFrame coordinate_frame = generateCoordinateFrame(start, goal);
 		Eigen::MatrixXd transformation_matrix = generateRotationTranslationMatrix(coordinate_frame, start);
-		Eigen::MatrixXd points_around_start = transformation_matrix * startOffsets;
+		Eigen::MatrixXd points_around_start = transformation_matrix * default_planner_context.startOffsets;
 
 	}
 
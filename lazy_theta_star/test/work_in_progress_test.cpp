@@ -29,15 +29,16 @@ namespace LazyThetaStarOctree
 		int initial_object_count = ThetaStarNode::OustandingObjects();
 		octomath::Vector3 final_voxel_center(700,0,0);
 		Open open (final_voxel_center);
+		SearchWorkspace workspace;
 		octomath::Vector3 parent_coordinates(-0.7, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> parent = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (parent_coordinates) , 0.2, 0, 1) ;	
+		ThetaStarNode* parent = workspace.newNode(voxelIdFromCoordinates(parent_coordinates, 0.2), parent_coordinates, 0.2, 0, 1);	
 		octomath::Vector3 coordinates(0.1, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> toInsert = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (coordinates) , 0.2, 0.8, 0.2) ;	
+		ThetaStarNode* toInsert = workspace.newNode(voxelIdFromCoordinates(coordinates, 0.2), coordinates, 0.2, 0.8, 0.2);	
 		toInsert->parentNode = parent;
 		open.insert(toInsert);
 		open.printNodes("========= toInsert ");
 		octomath::Vector3 opposite_direction_neighbor_coordinates (-0.9, -11.7, 0.5 );
-		std::shared_ptr<ThetaStarNode> opposite_direction_neighbor = std::make_shared<ThetaStarNode>(std::make_shared<octomath::Vector3> (opposite_direction_neighbor_coordinates) , 0.2, 0.2, 1.2) ;	
+		ThetaStarNode* opposite_direction_neighbor = workspace.newNode(voxelIdFromCoordinates(opposite_direction_neighbor_coordinates, 0.2), opposite_direction_neighbor_coordinates, 0.2, 0.2, 1.2);	
 		opposite_direction_neighbor->parentNode = parent;
 		open.insert(opposite_direction_neighbor);
 		open.printNodes("========= opposite_direction_neighbor ");
@@ -45,11 +46,12 @@ namespace LazyThetaStarOctree
 		// There is no direct way to generate the heuristics of a node as it is a private method
 		// ASSERT
 		// open.printNodes();
-		std::shared_ptr<ThetaStarNode> popped = open.pop();
+		ThetaStarNode* popped = open.pop();
 		ASSERT_TRUE(popped->hasSameCoordinates(toInsert, 0.2));
 
 		open.clear();
 		parent = toInsert = opposite_direction_neighbor = popped = NULL;
+		workspace.reset();
 		ASSERT_EQ(initial_object_count, ThetaStarNode::OustandingObjects()); 
 		
 	}